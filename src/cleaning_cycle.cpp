@@ -1,6 +1,7 @@
 #include "cleaning_cycle.h"
 
 #include "debug.h"
+#include "pid_autotune.h"
 #include "shot_stopper.h"
 
 // ============================================================================
@@ -204,7 +205,7 @@ void cleaningUpdate(float pressureBar) {
   }
   if (cleaningStartRequest) {
     cleaningStartRequest = false;
-    if (!cleaningActive() && !shot.brewing) {
+    if (!cleaningActive() && !shot.brewing && !autotuneActive()) {
       DEBUG_CLEANING_PRINT("Cleaning cycle started: %d flushes, max %.1f bar, %.0f s soak",
                            cleaningConfig.cyclesPerPhase, cleaningConfig.maxPressureBar,
                            cleaningConfig.soakS);
@@ -0,0 +1,156 @@
+#include "live_config.h"
+
+#include "debug.h"
+#include "pressure_control.h"
+#include "profile_library.h"
+#include "settings.h"
+#include "shot_stopper.h"
+
+// Guards the staged config (web server stages, control task applies)
+static portMUX_TYPE stageMux = portMUX_INITIALIZER_UNLOCKED;
+static LiveConfig staged;
+static volatile bool stagedPending = false;
+
+static uint32_t appliedCount = 0;
+static uint32_t rejectedCount = 0;
+
+// Persisted by settingsSave(); the PID gains are RAM-only, as with /set_pid
+#define PERSISTED_SECTIONS (LIVE_CONFIG_GOAL_WEIGHT | LIVE_CONFIG_WEIGHT_OFFSET | LIVE_CONFIG_PROFILE \
+                            | LIVE_CONFIG_CLEANING | LIVE_CONFIG_CONTROL_LAW | LIVE_CONFIG_WEIGHT_FILTER)
+
+static bool inRange(float v, float lo, float hi) {
+  return !isnan(v) && v >= lo && v <= hi;
+}
+
+void liveConfigSnapshot(const PIDController* pid, LiveConfig* out) {
+  portENTER_CRITICAL(&stageMux);
+  bool pending = stagedPending;
+  if (pending) {
+    *out = staged;
+  }
+  portEXIT_CRITICAL(&stageMux);
+  out->sections = 0;
+  if (pending) {
+    return;
+  }
+
+  out->goalWeight = shot.goalWeight;
+  out->weightOffset = shot.weightOffset;
+  profileSnapshot(&out->profile);
+  out->cleaning = cleaningConfig;
+  PidGains gains = pid ? pid->getGains() : PidGains{};
+  out->kp = gains.kp;
+  out->ki = gains.ki;
+  out->kd = gains.kd;
+  out->controlLaw = pressureControlSelected;
+  scaleFilterConfig(&out->weightFilter);
+}
+
+const char* liveConfigValidate(const LiveConfig& config) {
+  uint8_t touched = config.sections;
+  if ((touched & LIVE_CONFIG_GOAL_WEIGHT) && !inRange(config.goalWeight, 10, 200)) {
+    return "goalWeight must be 10..200";
+  }
+  if ((touched & LIVE_CONFIG_WEIGHT_OFFSET) && !inRange(config.weightOffset, 0, MAX_OFFSET)) {
+    return "weightOffset out of range";
+  }
+  if (touched & LIVE_CONFIG_PROFILE) {
+    const char* err = profileValidate(config.profile);
+    if (err) {
+      return err;
+    }
+  }
+  if (touched & LIVE_CONFIG_CLEANING) {
+    const CleaningConfig& c = config.cleaning;
+    if (!inRange(c.maxPressureBar, 4, 12)) {
+      return "cleaning maxPressure must be 4..12";
+    }
+    if (c.cyclesPerPhase < 1 || c.cyclesPerPhase > 10) {
+      return "cleaning cycles must be 1..10";
+    }
+    if (!inRange(c.holdS, 0, 30)) {
+      return "cleaning holdS must be 0..30";
+    }
+    if (!inRange(c.pauseS, 2, 60)) {
+      return "cleaning pauseS must be 2..60";
+    }
+    if (!inRange(c.soakS, 0, 600)) {
+      return "cleaning soakS must be 0..600";
+    }
+  }
+  if (touched & LIVE_CONFIG_PID) {
+    const char* err = pidGainsValidate({ config.kp, config.ki, config.kd });
+    if (err) {
+      return err;
+    }
+  }
+  if ((touched & LIVE_CONFIG_CONTROL_LAW) && !pressureControlLaw(config.controlLaw)) {
+    return "controlLaw must be pid, gaggiuino or mpc";
+  }
+  if (touched & LIVE_CONFIG_WEIGHT_FILTER) {
+    return weightFilterValidate(config.weightFilter);
+  }
+  return nullptr;
+}
+
+void liveConfigStage(const LiveConfig& config) {
+  portENTER_CRITICAL(&stageMux);
+  uint8_t sections = stagedPending ? staged.sections : 0;
+  staged = config;
+  staged.sections |= sections;
+  stagedPending = true;
+  portEXIT_CRITICAL(&stageMux);
+}
+
+bool liveConfigUpdate(PIDController* pid) {
+  if (!stagedPending) {
+    return false;  // Nothing staged; the flag alone says so, no need to lock
+  }
+  // Static: a PressureProfile is too much for the control task's stack to
+  // copy around
+  static LiveConfig c;
+  portENTER_CRITICAL(&stageMux);
+  c = staged;
+  stagedPending = false;
+  portEXIT_CRITICAL(&stageMux);
+
+  if (c.sections & LIVE_CONFIG_GOAL_WEIGHT) {
+    shot.goalWeight = c.goalWeight;
+  }
+  if (c.sections & LIVE_CONFIG_WEIGHT_OFFSET) {
+    shot.weightOffset = c.weightOffset;
+  }
+  if (c.sections & LIVE_CONFIG_PROFILE) {
+    profileLibraryApplyCustom(c.profile);
+  }
+  if (c.sections & LIVE_CONFIG_CLEANING) {
+    cleaningConfig = c.cleaning;
+  }
+  if (c.sections & LIVE_CONFIG_PID) {
+    pid->setGains({ c.kp, c.ki, c.kd });
+  }
+  if (c.sections & LIVE_CONFIG_CONTROL_LAW) {
+    pressureControlSelected = c.controlLaw;
+  }
+  if (c.sections & LIVE_CONFIG_WEIGHT_FILTER) {
+    scaleFilterConfigure(c.weightFilter);
+  }
+  if (c.sections & PERSISTED_SECTIONS) {
+    settingsSave();
+  }
+  appliedCount++;
+  DEBUG_SHOT_PRINT("Config patch applied (sections 0x%02x)", c.sections);
+  return true;
+}
+
+void liveConfigCountRejected() {
+  rejectedCount++;
+}
+
+uint32_t liveConfigAppliedCount() {
+  return appliedCount;
+}
+
+uint32_t liveConfigRejectedCount() {
+  return rejectedCount;
+}
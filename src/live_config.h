@@ -0,0 +1,69 @@
+#ifndef LIVE_CONFIG_H
+#define LIVE_CONFIG_H
+
+// ============================================================================
+// LIVE CONFIG - ALL TUNABLES AS ONE TRANSACTION
+// ============================================================================
+// The parameters the /set_* endpoints change one at a time (goal weight,
+// weight offset, pressure profile, cleaning cycle, PID gains, control law,
+// weight filter), as one record. /config reads it and PATCHes any subset of
+// it: the web server merges the patch into the current config, validates
+// the sections it touched and stages the result; the control task applies
+// everything staged at the top of its next iteration, so no iteration ever
+// runs on half a patch, and has it persisted with a single settingsSave().
+//
+// Only the sections a patch touched are applied: a patch without a profile
+// leaves the profile library's selection alone. The web server stages, the
+// control task applies; the staged copy is spinlock-protected.
+
+#include <Arduino.h>
+
+#include "cleaning_cycle.h"
+#include "pid_controller.h"
+#include "pressure_profile.h"
+#include "weight_filter.h"
+
+// Sections, as bits of LiveConfig::sections
+#define LIVE_CONFIG_GOAL_WEIGHT   0x01
+#define LIVE_CONFIG_WEIGHT_OFFSET 0x02
+#define LIVE_CONFIG_PROFILE       0x04
+#define LIVE_CONFIG_CLEANING      0x08
+#define LIVE_CONFIG_PID           0x10
+#define LIVE_CONFIG_CONTROL_LAW   0x20
+#define LIVE_CONFIG_WEIGHT_FILTER 0x40
+
+struct LiveConfig {
+  uint8_t sections;  // Set by a patch: what to apply
+  float goalWeight;
+  float weightOffset;
+  PressureProfile profile;
+  CleaningConfig cleaning;
+  float kp, ki, kd;
+  int controlLaw;
+  WeightFilterConfig weightFilter;
+};
+
+// The config in force - or, while a patch is staged, the config it will
+// put in force, so a GET right after a PATCH reads its own write (any task)
+void liveConfigSnapshot(const PIDController* pid, LiveConfig* out);
+
+// Null if the sections config.sections marks are usable, otherwise what is
+// wrong with them. Same ranges as the /set_* handlers. Untouched sections
+// hold the config in force and aren't checked: whatever is wrong there
+// shouldn't block a patch to something else.
+const char* liveConfigValidate(const LiveConfig& config);
+
+// Stage a validated config for the control task; merges with a patch that
+// is still staged (its sections stay set). Web server.
+void liveConfigStage(const LiveConfig& config);
+
+// Control task, once per iteration: apply the staged config and request
+// one settings commit for it. True if one was applied.
+bool liveConfigUpdate(PIDController* pid);
+
+// Patches applied and rejected since boot (/metrics)
+void liveConfigCountRejected();
+uint32_t liveConfigAppliedCount();
+uint32_t liveConfigRejectedCount();
+
+#endif // LIVE_CONFIG_H
@@ -1,16 +1,26 @@
 #include <Arduino.h>
 #include <ESP32Encoder.h>
-#include <AcaiaArduinoBLE.h>
 #include <WiFi.h>
 
 #include "cleaning_cycle.h"
 #include "debug.h"
+#include "live_config.h"
+#include "metrics.h"
+#include "pid_autotune.h"
 #include "pid_controller.h"
+#include "pressure_control.h"
+#include "pressure_mpc.h"
+#include "pressure_profile.h"
+#include "profile_library.h"
+#include "pump_calibration.h"
 #include "pump_dimmer.h"
 #include "pump_model.h"
+#include "scale.h"
+#include "scale_commands.h"
 #include "settings.h"
 #include "shot_history.h"
 #include "shot_stopper.h"
+#include "sim_worker.h"
 #include "webserver.h"
 
 // ============================================================================
@@ -20,13 +30,20 @@
 #define TESTING_MODE_NO_SCALE false     // Set to true to disable scale/BLE connection during testing
 #define TESTING_PRINT_SCALE_STATUS true // Print scale connection and pressure health status
 
-// Pressure control law during shots: gaggiuino-style feedforward from the
-// pump model (pump_model.cpp, needs PUMP_PSM_MODE for click counting) or the
-// classic PID (pid_controller.cpp, /set_pid stays functional either way)
-#define GAGGIUINO_PUMP_CONTROL true
+// Scale the scale task starts on (scale.h): the Acaia over BLE, or the
+// virtual scale replaying a weight trace - shots without a scale, and BLE
+// is never started. /set_scale switches at runtime.
+#define SCALE_DRIVER SCALE_DRIVER_ACAIA
 
-// Window for the click-rate flow estimate and dP/dt (10 windows/s; clicks
-// per window 0-5, EMA-smoothed on top)
+// Default pressure control law until one is picked via /set_controller
+// (pressure_control.h): gaggiuino-style feedforward from the pump model
+// (pump_model.cpp), model-predictive (pressure_mpc.cpp) - both need
+// PUMP_PSM_MODE for click counting - or the classic PID (pid_controller.cpp,
+// /set_pid stays functional either way). GET /controller_benchmark compares
+// them on a simulated group, GET /controllers on real shots.
+#define PRESSURE_CONTROL_LAW PRESSURE_CONTROL_GAGGIUINO
+
+// Window for dP/dt and the MPC model identification (10 windows/s)
 #define DERIVED_STATE_PERIOD_MS 100
 
 // ============================================================================
@@ -66,6 +83,17 @@ ESP32Encoder encoder;
 // old values limit-cycled (+/-2-3 bar swings every few seconds).
 PIDController pressurePID(15.0f, 1.0f, 5.0f);
 
+// Model-predictive controller state: identified group model (control task only)
+MpcState pressureMpc;
+
+// The laws' working state on the machine (control task only)
+static ControllerState pressureController = { &pressurePID, &pressureMpc, 1.0f, -1.0f };
+
+// Profile preview for laws that look ahead (MPC horizon)
+static float profilePressureAt(float shotTimeS) {
+  return profileGoalPressure(&shot, shotTimeS, shot.expectedEndS - shotTimeS);
+}
+
 // Real-time control loop task (defined below), started from setup()
 void controlTask(void* param);
 // Background scale connection/polling task (defined below), started from setup()
@@ -91,7 +119,9 @@ void setup() {
   // Load persisted settings (goal weight, offset, pressure profile, cleaning
   // config, WiFi credentials) from EEPROM and apply them to the live state.
   // Must run before the tasks start and before initializeWiFi().
+  pressureControlSelected = PRESSURE_CONTROL_LAW;  // Default for settingsLoad()
   settingsLoad();
+  mpcInit(&pressureMpc);
 
   // GPIO pin initialization
   pinMode(LED_BUILTIN, OUTPUT);
@@ -121,10 +151,9 @@ void setup() {
                       ZERO_CROSS_PIN);
 
   #if !TESTING_MODE_NO_SCALE
-  // BLE initialization (for Acaia Lunar scale connection)
-  BLE.begin();
-  BLE.setLocalName("shotStopper");
-  DEBUG_STARTUP_PRINT("Bluetooth initialized for scale connection");
+  // BLE comes up with the first Acaia connection attempt (scale.cpp)
+  scaleDriverSelected = SCALE_DRIVER;
+  DEBUG_STARTUP_PRINT("Scale driver: %s", scaleDriverName(SCALE_DRIVER));
   #else
   DEBUG_STARTUP_PRINT("TESTING MODE: Scale/BLE connection disabled");
   scaleConnected = true;  // Pretend connected so the dashboard start button works
@@ -133,6 +162,9 @@ void setup() {
   // Shot history buffer (RAM-only, read by the web server)
   initShotHistory();
 
+  // Benchmark jobs the web server queues (sim_worker.h)
+  simWorkerInit();
+
   // WiFi and web server (LAN dashboard). Boot continues without the
   // dashboard if WiFi is unavailable (15s timeout).
   if (initializeWiFi()) {
@@ -144,11 +176,19 @@ void setup() {
   // in loop() can never stall scale polling, trajectory updates, or pump PWM.
   xTaskCreatePinnedToCore(controlTask, "control", 10240, nullptr, 2, nullptr, 1);
 
+  // Settings commits run in their own task at the lowest priority above
+  // idle, so no caller ever waits for flash (settings.h)
+  xTaskCreatePinnedToCore(settingsTask, "settings", 4096, nullptr, 1, nullptr, 0);
+
+  // Offline simulations at idle priority, so the web server that queued
+  // them stays responsive while they run (sim_worker.h)
+  xTaskCreatePinnedToCore(simWorkerTask, "sim", 8192, nullptr, tskIDLE_PRIORITY, nullptr, 0);
+
   #if !TESTING_MODE_NO_SCALE
   // Scale connection runs as a background task at priority 1 (below the
   // control task) so a missing scale can never stall brewing logic or the
   // web dashboard. Core 1: the task-watchdogged core-0 idle task must not
-  // be starved by the blocking 10 s BLE scan inside scale.init().
+  // be starved by the blocking 10 s BLE discovery scan.
   xTaskCreatePinnedToCore(scaleTask, "scale", 8192, nullptr, 1, nullptr, 1);
   #endif
 
@@ -197,6 +237,14 @@ void printWifiStatus() {
 // on core 0 can never stall scale polling, trajectory updates, or pump PWM.
 
 void controlIteration() {
+  // ========================================================================
+  // LIVE CONFIG (/config PATCH, live_config.cpp)
+  // ========================================================================
+  // A staged patch lands here, whole, before anything in this iteration
+  // reads the parameters it changes.
+
+  liveConfigUpdate(&pressurePID);
+
   // ========================================================================
   // PRESSURE SAMPLING (every iteration, ~20 Hz)
   // ========================================================================
@@ -207,41 +255,69 @@ void controlIteration() {
 
   updatePressureSensor(&shot);
 
-  // Derived state for the feedforward control law: dP/dt of the filtered
-  // pressure, and the model-estimated pump flow from the PSM click counter
-  // (one conducted mains cycle = one pump stroke). Computed over a 100 ms
-  // window - per-iteration click deltas at 100 Hz would only ever be 0 or 1
-  // and quantize the flow estimate to useless extremes.
+  // Pump flow for the feedforward control law, every iteration: the dimmer
+  // timestamps each conducted stroke (one conducted mains cycle = one pump
+  // stroke), and each stroke counts with the volume it moves at the
+  // pressure of its own instant (interpolated between this iteration's
+  // sample and the previous one).
+  static uint32_t clickCursor = pumpDimmerClickCount();
+  static uint32_t lastSampleUs = micros();
+  static float lastSamplePressure = shot.pressure;
+  static float smoothedPumpFlow = 0.0f;
+
+  uint32_t sampleUs = micros();
+  uint32_t clickUs[PUMP_CLICK_RING_SIZE];
+  int newClicks = pumpDimmerReadClicks(&clickCursor, clickUs, PUMP_CLICK_RING_SIZE);
+  uint32_t sampleSpanUs = sampleUs - lastSampleUs;
+  for (int i = 0; i < newClicks; i++) {
+    float pressureAtClick = shot.pressure;
+    uint32_t clickAgeUs = sampleUs - clickUs[i];
+    if (sampleSpanUs > 0 && clickAgeUs < sampleSpanUs) {
+      float f = (float)clickAgeUs / sampleSpanUs;
+      pressureAtClick = shot.pressure + f * (lastSamplePressure - shot.pressure);
+    } else if (clickAgeUs >= sampleSpanUs) {
+      pressureAtClick = lastSamplePressure;
+    }
+    pumpFlowAddClick(clickUs[i], pressureAtClick);
+    pumpCalibrationAddClick(pressureAtClick);
+  }
+  smoothedPumpFlow = pumpFlowEstimate(sampleUs);
+  shot.pumpFlow = smoothedPumpFlow;
+  lastSampleUs = sampleUs;
+  lastSamplePressure = shot.pressure;
+
+  // Derived state at 10 Hz: dP/dt of the filtered pressure over a 100 ms
+  // window (per-iteration differences of the filtered signal are mostly
+  // noise), the detected mains frequency, and a new /state snapshot
   static unsigned long lastDerivedMs = 0;
-  static uint32_t lastClickCount = 0;
   static float lastPressure = 0.0f;
   static float pressureChangeSpeed = 0.0f;
-  static float smoothedPumpFlow = 0.0f;
 
   unsigned long nowMs = millis();
   if (lastDerivedMs == 0) {
     lastDerivedMs = nowMs;
     lastPressure = shot.pressure;
-    lastClickCount = pumpDimmerClickCount();
   } else if (nowMs - lastDerivedMs >= DERIVED_STATE_PERIOD_MS) {
     float dt = (nowMs - lastDerivedMs) / 1000.0f;
     pressureChangeSpeed = (shot.pressure - lastPressure) / dt;
-
-    uint32_t clicks = pumpDimmerClickCount();
-    float clicksPerSecond = (clicks - lastClickCount) / dt;
-    lastClickCount = clicks;
-    float flow = getPumpFlow(clicksPerSecond, shot.pressure);
-    smoothedPumpFlow += PUMP_FLOW_FILTER_ALPHA * (flow - smoothedPumpFlow);
-    shot.pumpFlow = smoothedPumpFlow;
+    setMaxPumpClicksPerSecond(pumpDimmerMainsHz());
+    if (shot.brewing) {
+      mpcIdentify(&pressureMpc, smoothedPumpFlow, shot.pressure, pressureChangeSpeed);
+    }
 
     lastPressure = shot.pressure;
     lastDerivedMs = nowMs;
+    webStateGeneration++;  // New snapshot for the cached /state JSON
   }
 
   // ========================================================================
   // SCALE CONNECTION AND DATA POLLING
   // ========================================================================
 
+  // Last weight through the sanitizer: what the shot end and the offset
+  // learning judge by (currentWeight is the raw reading, for display)
+  static float filteredWeight = 0.0f;
+
   #if !TESTING_MODE_NO_SCALE
   // Scale connection/polling is handled by scaleTask in the background;
   // this task never blocks on BLE and just consumes the shared state.
@@ -254,13 +330,25 @@ void controlIteration() {
       shot.brewing = false;
       setBrewingState(false);
     }
-  } else if (scaleNewWeight) {
-    scaleNewWeight = false;
-
-    DEBUG_SCALE_PRINT("Weight: %.1f g | Offset: %.1f g", currentWeight, shot.weightOffset);
-
-    // Update shot trajectory with new weight datapoint
-    updateShotTrajectory(&shot, currentWeight);
+  } else {
+    // Every packet since the last iteration, each at the time it arrived:
+    // back-dated from now by its age (wrap-safe in micros()), then through
+    // the weight sanitizer so spikes and tare transients never reach the
+    // regression
+    ScaleSample sample;
+    while (scaleQueuePop(&sample)) {
+      float receivedS = secondsSinceBoot() - (uint32_t)(micros() - sample.receivedUs) / 1e6f;
+      DEBUG_SCALE_PRINT("Weight: %.1f g at %.3f s | Offset: %.1f g",
+                        sample.weight, receivedS, shot.weightOffset);
+      float weight;
+      float sampleS;
+      if (!scaleFilterApply(sample, receivedS, &weight, &sampleS)) {
+        continue;
+      }
+      filteredWeight = weight;
+      updateShotTrajectory(&shot, weight, sampleS, receivedS);
+      pumpCalibrationAddWeight(weight, pressureChangeSpeed, sampleS);
+    }
   }
   #else
   // TESTING MODE: Skip scale connection and keep current weight at 0
@@ -275,7 +363,7 @@ void controlIteration() {
 
   if (webStartRequest) {
     webStartRequest = false;
-    if (!shot.brewing && !cleaningActive()) {
+    if (!shot.brewing && !cleaningActive() && !autotuneActive()) {
       DEBUG_SHOT_PRINT("Shot start requested via web - pressing machine button");
       if (MOMENTARY) {
         // Pulse the opto-coupled button to start the machine
@@ -319,38 +407,83 @@ void controlIteration() {
   cleaningUpdate(shot.pressure);
 
   // ========================================================================
-  // PUMP DIMMER CONTROL (PID during shot, 100% when idle)
+  // PID AUTOTUNE (relay experiment against a blind basket, pid_autotune.cpp)
+  // ========================================================================
+  // Same ownership rules as the cleaning cycle: presses the machine button
+  // itself and dictates the pump level while active.
+
+  autotuneUpdate(shot.pressure);
+
+  // ========================================================================
+  // PUMP DIMMER CONTROL (pressure control during shot, 100% when idle)
   // ========================================================================
 
   long encoderPosition = encoder.getCount();
 
+  // A profile picked from the library takes over here, never mid-shot: while
+  // idle, or before the first goal of a shot is evaluated
+  if (!shot.brewing || shot.datapoints == 0) {
+    profileLibraryUpdate();
+  }
+
   int pwmValue = 255;
   if (cleaningActive()) {
     // Full power while pressurizing, dimmed while holding at max pressure
     pwmValue = cleaningPumpLevel();
+  } else if (autotuneActive()) {
+    // Relay output: one of two fixed levels
+    pwmValue = autotunePumpLevel();
   } else if (!shot.brewing) {
     // IDLE STATE: Pump at full speed (100% = 255)
     pwmValue = 255;
   } else if (shot.datapoints == 0) {
-    // Shot just started, no pressure data yet - reset PID and run full power
-    pressurePID.reset();
+    // Shot just started, no pressure data yet - latch the selected law for
+    // this shot, reset it and the score, and run full power
+    shot.controlLaw = pressureControlSelected;
+    pressureControlLaw(shot.controlLaw)->shotStart(&pressureController);
+    controlScoreStart(&shot.controlScorer);
     pwmValue = 255;
     DEBUG_ENCODER_PRINT("BREWING - waiting for pressure data, PWM: %d", pwmValue);
   } else {
-    // BREWING STATE: pressure regulation
-    float goalPressure = shot.currentGoalPressure;
-    #if GAGGIUINO_PUMP_CONTROL
-    // Feedforward from the pump model plus proportional trim (pump_model.cpp)
-    float pct = getPumpPct(goalPressure, 0.0f, shot.pressure,
-                           smoothedPumpFlow, pressureChangeSpeed);
-    pwmValue = (int)roundf(pct * 255.0f);
-    DEBUG_ENCODER_PRINT("BREWING - target %.1f bar, current %.1f bar, flow %.2f ml/s, PWM: %d",
-                        goalPressure, shot.pressure, smoothedPumpFlow, pwmValue);
-    #else
-    pwmValue = pressurePID.calculate(goalPressure, shot.pressure);
-    DEBUG_ENCODER_PRINT("BREWING - target %.1f bar, current %.1f bar, PWM: %d",
-                        goalPressure, shot.pressure, pwmValue);
-    #endif
+    // BREWING STATE: the profile goal at this instant (pressure_profile.cpp)
+    float shotTime = secondsSinceBoot() - shot.startTimestampS;
+    ProfileGoal goal;
+    profileGoal(&shot, shotTime, shot.expectedEndS - shotTime, &goal);
+    shot.currentGoalPressure = goal.pressure;
+    shot.currentGoalFlow = goal.targetFlow;
+    shot.currentMaxFlow = goal.maxFlow;
+
+    const PressureControlLaw* law = pressureControlLaw(shot.controlLaw);
+    static unsigned long lastBrewIterationMs = 0;
+    float dtS = (nowMs - lastBrewIterationMs) / 1000.0f;
+    if (dtS <= 0.0f || dtS > 0.1f) {
+      dtS = 0.01f;  // First iteration of the shot (or a stall): nominal period
+    }
+    lastBrewIterationMs = nowMs;
+
+    if (goal.targetFlow > 0.0f) {
+      // Flow goal: open loop through the pump curve whatever the pressure
+      // law, the goal pressure only acting as a limit (pump_model.cpp)
+      float pct = getPumpPctForFlow(goal.targetFlow, goal.pressure, shot.pressure,
+                                    smoothedPumpFlow, pressureChangeSpeed);
+      pwmValue = (int)roundf(pct * 255.0f);
+      // Keep the law ready for a following pressure goal; not scored
+      law->track(&pressureController, pct);
+      controlScoreBreak(&shot.controlScorer);
+      DEBUG_ENCODER_PRINT("BREWING - target %.2f ml/s (limit %.1f bar), flow %.2f ml/s, current %.1f bar, PWM: %d",
+                          goal.targetFlow, goal.pressure, smoothedPumpFlow, shot.pressure, pwmValue);
+    } else {
+      ControlInput in = {
+        nowMs / 1000.0f, dtS, shotTime, goal.pressure, goal.maxFlow,
+        shot.pressure, smoothedPumpFlow, pressureChangeSpeed, profilePressureAt
+      };
+      float pct = law->pumpPct(&pressureController, in);
+      pwmValue = (int)roundf(pct * 255.0f);
+      controlScoreUpdate(&shot.controlScorer, shotTime, dtS, goal.pressure, goal.endPressure,
+                         shot.pressure, pct);
+      DEBUG_ENCODER_PRINT("BREWING (%s) - target %.1f bar, current %.1f bar, flow %.2f ml/s, PWM: %d",
+                          law->name, goal.pressure, shot.pressure, smoothedPumpFlow, pwmValue);
+    }
   }
 
   DEBUG_ENCODER_PRINT("Encoder count: %ld | PWM output: %d", encoderPosition, pwmValue);
@@ -377,20 +510,25 @@ void controlIteration() {
   handleMaxDurationReached(&shot);
 
   // Detect shot end conditions (weight target, time limit, button release)
-  handleShotEnd(&shot, currentWeight);
+  handleShotEnd(&shot, filteredWeight);
 
   // Post-shot error detection and EEPROM learning
   // Learns weight offset if final weight is within 5g of goal
-  detectShotError(&shot, currentWeight);
+  detectShotError(&shot, filteredWeight);
 }
 
 // Control task: run the control iteration at a fixed ~10 ms cadence (100 Hz,
 // gaggiuino's ballpark) so the pump level updates every mains cycle or two
 // and the PSM pattern stays finely interleaved instead of bursting.
 // The web server runs asynchronously in the AsyncTCP task and never blocks this.
+// Execution time and start-to-start period are recorded for /metrics.
 void controlTask(void* param) {
+  uint32_t lastStartUs = micros();
   for (;;) {
+    uint32_t startUs = micros();
     controlIteration();
+    metricsRecordControlIteration(micros() - startUs, startUs - lastStartUs);
+    lastStartUs = startUs;
     vTaskDelay(pdMS_TO_TICKS(10));
   }
 }
@@ -399,16 +537,34 @@ void controlTask(void* param) {
 // SCALE TASK: background BLE connection management and weight polling
 // ============================================================================
 // Owns ALL scale/BLE calls; everyone else talks to it via the flags in
-// shot_stopper.h. scale.init() blocks up to 10 s while scanning - fine here,
-// the control task and web server keep running. Between failed attempts the
-// scan is stopped and the task backs off, because BLE scanning and WiFi share
-// the one 2.4 GHz radio: scanning back-to-back starves WiFi until it drops.
-
-#define SCALE_RETRY_BACKOFF_MS 5000
+// shot_stopper.h. Between failed attempts the scan is stopped and the task
+// backs off, because BLE scanning and WiFi share the one 2.4 GHz radio:
+// scanning back-to-back starves WiFi until it drops.
+//
+// The scale itself sits behind a ScaleDriver (scale.h): the Acaia over BLE
+// or the virtual scale replaying a trace. /set_scale switches at runtime;
+// the task drops the old driver's link and connects the new one.
 
 void scaleTask(void* param) {
+  int driverId = scaleDriverSelected;
+  const ScaleDriver* driver = scaleDriver(driverId);
+  unsigned long lostAtMs = 0;  // When a live link was found dropped, 0 = none
+  uint8_t taredFlag = 0;
   for (;;) {
-    if (!scale.isConnected()) {
+    if (scaleDriverSelected != driverId && scaleDriver(scaleDriverSelected)) {
+      driver->disconnect();
+      driverId = scaleDriverSelected;
+      driver = scaleDriver(driverId);
+      scaleConnected = false;
+      lostAtMs = 0;  // A switch is not a dropped link
+      DEBUG_SCALE_PRINT("Scale driver: %s", driver->name);
+    }
+
+    if (!driver->isConnected()) {
+      if (scaleConnected) {
+        lostAtMs = millis();
+        DEBUG_SCALE_PRINT("Scale link lost - reconnecting");
+      }
       scaleConnected = false;
       currentWeight = 0;
       // Drop commands queued while disconnected: they belong to a dead shot
@@ -416,47 +572,64 @@ void scaleTask(void* param) {
       scaleStopTimerRequest = false;
       scaleTareRequest = false;
 
-      if (!scale.init()) {
-        BLE.stopScan();  // init() leaves the scan running on timeout
-        vTaskDelay(pdMS_TO_TICKS(SCALE_RETRY_BACKOFF_MS));
+      bool fast;
+      if (!driver->connect(&fast)) {
+        vTaskDelay(pdMS_TO_TICKS(fast ? SCALE_FAST_RETRY_MS : SCALE_RETRY_BACKOFF_MS));
         continue;
       }
-      DEBUG_SCALE_PRINT("Scale connected");
+      DEBUG_SCALE_PRINT("Scale connected (%s, %s)", driver->name,
+                        fast ? "fast path" : "discovery scan");
+      scaleCommandsReset();
+      scaleConnectCount++;
+      if (lostAtMs != 0) {
+        scaleRecordReconnect(millis() - lostAtMs, fast);
+        lostAtMs = 0;
+      }
     }
     scaleConnected = true;
 
-    // Heartbeat every ~30 s keeps the BLE connection alive
-    if (scale.heartbeatRequired()) {
-      scale.heartbeat();
-    }
-
-    // Poll continuously; without this the connection goes stale
-    if (scale.newWeightAvailable()) {
-      currentWeight = scale.getWeight();
-      scaleNewWeight = true;
-    }
+    driver->maintain();
 
-    // Execute commands queued by the control task
+    // Commands requested by the control task go through the acknowledged
+    // pipeline (scale_commands.h), back to back as each one is confirmed
     if (scaleStartSequenceRequest) {
       scaleStartSequenceRequest = false;
-      scale.resetTimer();
-      vTaskDelay(pdMS_TO_TICKS(50));  // Let the scale process each command
-      scale.startTimer();
+      scaleCommandEnqueue(SCALE_CMD_RESET_TIMER);
+      scaleCommandEnqueue(SCALE_CMD_START_TIMER);
       if (AUTOTARE) {
-        vTaskDelay(pdMS_TO_TICKS(50));
-        scale.tare();
+        scaleCommandEnqueue(SCALE_CMD_TARE);
       }
     }
     if (scaleStopTimerRequest) {
       scaleStopTimerRequest = false;
-      scale.stopTimer();
+      scaleCommandEnqueue(SCALE_CMD_STOP_TIMER);
     }
     if (scaleTareRequest) {
       scaleTareRequest = false;
-      scale.tare();
+      scaleCommandEnqueue(SCALE_CMD_TARE);
+    }
+
+    // Poll continuously; without this the connection goes stale. The
+    // library has no notification callback, so the poll is the receipt:
+    // stamp it here, and poll often enough that the stamp stays close
+    float weight;
+    bool received = driver->readWeight(&weight);
+    uint32_t receivedUs = micros();
+    scaleCommandsUpdate(driver, received ? &weight : nullptr, millis());
+    if (scaleCommandsTakeTared()) {
+      taredFlag = SCALE_SAMPLE_TARED;  // Rides on the next packet pushed
+    }
+    if (received) {
+      weight -= scaleCommandsSoftTareG();
+      currentWeight = weight;
+      // Packets from before a pending tare would poison the trajectory
+      if (!scaleCommandsTarePending() && scaleQueuePush(weight, receivedUs, taredFlag)) {
+        taredFlag = 0;
+      }
+      scalePacketCount++;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(20));
+    vTaskDelay(pdMS_TO_TICKS(SCALE_POLL_MS));
   }
 }
 
@@ -471,8 +644,10 @@ void loop() {
   if (webRebootRequest) {
     // Requested via /reboot (e.g. to apply new WiFi credentials); the handler
     // already refused it while brewing/cleaning. Short delay so the HTTP
-    // response gets flushed before the restart.
+    // response gets flushed before the restart; pending settings (the new
+    // credentials) must not wait out the debounce.
     vTaskDelay(pdMS_TO_TICKS(500));
+    settingsFlush();
     ESP.restart();
   }
   if (WiFi.status() != WL_CONNECTED) {
@@ -0,0 +1,271 @@
+#include "metrics.h"
+
+#include <esp_heap_caps.h>
+
+#include "live_config.h"
+#include "pump_calibration.h"
+#include "pump_dimmer.h"
+#include "scale_commands.h"
+#include "settings.h"
+#include "shot_history.h"
+#include "shot_stopper.h"
+
+// ============================================================================
+// CONTROL LOOP TIMING (written by the control task, read by /metrics)
+// ============================================================================
+
+// The control task (core 1) and the AsyncTCP task (core 0) both touch these;
+// a spinlock keeps the 64-bit sums and the read-and-reset maxima consistent
+static portMUX_TYPE controlStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t controlIterations = 0;
+static uint64_t controlDurationSumUs = 0;
+static uint32_t controlDurationMaxUs = 0;  // Since the last scrape
+static uint32_t controlPeriodMaxUs = 0;    // Since the last scrape
+static uint32_t controlOverruns = 0;
+
+void metricsRecordControlIteration(uint32_t durationUs, uint32_t periodUs) {
+  portENTER_CRITICAL(&controlStatsMux);
+  controlIterations++;
+  controlDurationSumUs += durationUs;
+  if (durationUs > controlDurationMaxUs) {
+    controlDurationMaxUs = durationUs;
+  }
+  if (periodUs > controlPeriodMaxUs) {
+    controlPeriodMaxUs = periodUs;
+  }
+  if (periodUs > 2 * METRICS_CONTROL_PERIOD_US) {
+    controlOverruns++;
+  }
+  portEXIT_CRITICAL(&controlStatsMux);
+}
+
+// ============================================================================
+// EXPOSITION FORMAT
+// ============================================================================
+
+void metricsWriteHeader(String& out, const char* name, const char* type, const char* help) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void metricsWriteSample(String& out, const char* name, double value, const char* labels) {
+  char line[128];
+  snprintf(line, sizeof(line), "%s%s%s%s %.10g\n",
+           name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "", value);
+  out += line;
+}
+
+void metricsWrite(String& out, const char* name, const char* type, const char* help,
+                  double value) {
+  metricsWriteHeader(out, name, type, help);
+  metricsWriteSample(out, name, value);
+}
+
+void metricsRender(String& out) {
+  out.reserve(out.length() + 4096);
+
+  portENTER_CRITICAL(&controlStatsMux);
+  uint32_t iterations = controlIterations;
+  uint64_t durationSumUs = controlDurationSumUs;
+  uint32_t durationMaxUs = controlDurationMaxUs;
+  uint32_t periodMaxUs = controlPeriodMaxUs;
+  uint32_t overruns = controlOverruns;
+  controlDurationMaxUs = 0;
+  controlPeriodMaxUs = 0;
+  portEXIT_CRITICAL(&controlStatsMux);
+
+  metricsWrite(out, "espresso_uptime_seconds", "gauge",
+               "Seconds since boot", millis() / 1000.0);
+
+  // Control loop
+  metricsWriteHeader(out, "espresso_control_iteration_seconds", "summary",
+                     "Execution time of one control iteration");
+  metricsWriteSample(out, "espresso_control_iteration_seconds_sum", durationSumUs / 1e6);
+  metricsWriteSample(out, "espresso_control_iteration_seconds_count", iterations);
+  metricsWrite(out, "espresso_control_iteration_max_seconds", "gauge",
+               "Longest control iteration since the previous scrape", durationMaxUs / 1e6);
+  metricsWrite(out, "espresso_control_period_max_seconds", "gauge",
+               "Longest start-to-start control period since the previous scrape",
+               periodMaxUs / 1e6);
+  metricsWrite(out, "espresso_control_overruns_total", "counter",
+               "Control periods longer than twice the nominal 10 ms", overruns);
+
+  // Mains sync and pump
+  metricsWrite(out, "espresso_zero_crosses_total", "counter",
+               "Accepted mains zero crossings", pumpDimmerZcCount());
+  metricsWrite(out, "espresso_zero_cross_glitches_total", "counter",
+               "Zero-cross detector edges rejected as glitches", pumpDimmerZcGlitchCount());
+  metricsWrite(out, "espresso_zero_cross_synthetic_total", "counter",
+               "Crossings emulated while the detector was silent", pumpDimmerZcSyntheticCount());
+  metricsWrite(out, "espresso_zero_cross_healthy", "gauge",
+               "1 while zero crossings are arriving", pumpDimmerZcHealthy() ? 1 : 0);
+  metricsWrite(out, "espresso_zero_cross_pll_locked", "gauge",
+               "1 while the zero-cross PLL is locked", pumpDimmerPllLocked() ? 1 : 0);
+  metricsWrite(out, "espresso_mains_frequency_hertz", "gauge",
+               "Mains frequency measured by the zero-cross PLL", pumpDimmerMainsFrequency());
+  metricsWrite(out, "espresso_zero_cross_phase_error_max_seconds", "gauge",
+               "Largest zero-cross deviation from the PLL prediction since the previous scrape",
+               pumpDimmerPllPhaseErrorMaxUs() / 1e6);
+  metricsWrite(out, "espresso_pump_clicks_total", "counter",
+               "Conducted mains cycles (pump strokes, PSM mode)", pumpDimmerClickCount());
+
+  PumpLatencyStats latency;
+  if (pumpDimmerLatencyStats(&latency)) {
+    metricsWriteHeader(out, "espresso_dimmer_gate_latency_seconds", "histogram",
+                       "Delay from zero crossing (or scheduled firing) to gate write");
+    uint32_t cumulative = 0;
+    for (int i = 0; i < PUMP_LATENCY_BUCKETS; i++) {
+      cumulative += latency.buckets[i];
+      uint32_t boundUs = pumpDimmerLatencyBucketUs(i);
+      char labels[24];
+      if (boundUs == UINT32_MAX) {
+        snprintf(labels, sizeof(labels), "le=\"+Inf\"");
+      } else {
+        snprintf(labels, sizeof(labels), "le=\"%g\"", boundUs / 1e6);
+      }
+      metricsWriteSample(out, "espresso_dimmer_gate_latency_seconds_bucket", cumulative, labels);
+    }
+    metricsWriteSample(out, "espresso_dimmer_gate_latency_seconds_sum", latency.sumUs / 1e6);
+    metricsWriteSample(out, "espresso_dimmer_gate_latency_seconds_count", latency.count);
+    metricsWrite(out, "espresso_dimmer_gate_latency_max_seconds", "gauge",
+                 "Longest gate latency since the previous scrape", latency.maxUs / 1e6);
+  }
+  metricsWrite(out, "espresso_pump_calibration_windows", "gauge",
+               "Shot windows fitted into the learned pump curve", pumpCalibrationSamples());
+  metricsWrite(out, "espresso_pump_calibration_confidence", "gauge",
+               "Confidence of the learned pump curve (0 = model curve in use)",
+               pumpCalibrationConfidence());
+  metricsWrite(out, "espresso_pump_level", "gauge",
+               "Last pump dimmer level (0-255)", shot.pumpPwm);
+
+  // Scale
+  metricsWrite(out, "espresso_scale_connected", "gauge",
+               "1 while the BLE scale is connected", scaleConnected ? 1 : 0);
+  metricsWrite(out, "espresso_scale_packets_total", "counter",
+               "Weight packets received from the scale", scalePacketCount);
+  metricsWrite(out, "espresso_scale_queue_drops_total", "counter",
+               "Weight packets dropped because the control task fell behind",
+               scaleQueueDropCount());
+  metricsWrite(out, "espresso_scale_connects_total", "counter",
+               "Successful scale (re)connects", scaleConnectCount);
+
+  ScaleReconnectStats reconnects;
+  scaleReconnectStats(&reconnects);
+  metricsWriteHeader(out, "espresso_scale_reconnect_seconds", "histogram",
+                     "Time from a lost scale link until connected again");
+  uint32_t reconnectsCumulative = 0;
+  for (int i = 0; i < SCALE_RECONNECT_BUCKETS; i++) {
+    reconnectsCumulative += reconnects.buckets[i];
+    uint32_t boundMs = scaleReconnectBucketMs(i);
+    char labels[24];
+    if (boundMs == UINT32_MAX) {
+      snprintf(labels, sizeof(labels), "le=\"+Inf\"");
+    } else {
+      snprintf(labels, sizeof(labels), "le=\"%g\"", boundMs / 1e3);
+    }
+    metricsWriteSample(out, "espresso_scale_reconnect_seconds_bucket", reconnectsCumulative, labels);
+  }
+  metricsWriteSample(out, "espresso_scale_reconnect_seconds_sum", reconnects.sumMs / 1e3);
+  metricsWriteSample(out, "espresso_scale_reconnect_seconds_count", reconnects.count);
+  metricsWrite(out, "espresso_scale_reconnects_fast_total", "counter",
+               "Reconnects made via the cached scale address, without a scan", reconnects.fast);
+  metricsWrite(out, "espresso_scale_reconnect_last_seconds", "gauge",
+               "Duration of the most recent scale reconnect", reconnects.lastMs / 1e3);
+
+  ScaleCommandStats commands[SCALE_CMD_COUNT];
+  for (int c = 0; c < SCALE_CMD_COUNT; c++) {
+    scaleCommandStats(c, &commands[c]);
+  }
+  metricsWriteHeader(out, "espresso_scale_commands_total", "counter",
+                     "Scale commands by outcome (confirmed, or failed after all retries)");
+  for (int c = 0; c < SCALE_CMD_COUNT; c++) {
+    char labels[48];
+    snprintf(labels, sizeof(labels), "command=\"%s\",result=\"confirmed\"", scaleCommandName(c));
+    metricsWriteSample(out, "espresso_scale_commands_total", commands[c].confirmed, labels);
+    snprintf(labels, sizeof(labels), "command=\"%s\",result=\"failed\"", scaleCommandName(c));
+    metricsWriteSample(out, "espresso_scale_commands_total", commands[c].failed, labels);
+  }
+  metricsWriteHeader(out, "espresso_scale_command_retries_total", "counter",
+                     "Scale command resends after a timeout or a rejected write");
+  for (int c = 0; c < SCALE_CMD_COUNT; c++) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "command=\"%s\"", scaleCommandName(c));
+    metricsWriteSample(out, "espresso_scale_command_retries_total", commands[c].retries, labels);
+  }
+  metricsWriteHeader(out, "espresso_scale_command_latency_seconds_total", "counter",
+                     "Time from first send to confirmation, summed over confirmed commands");
+  for (int c = 0; c < SCALE_CMD_COUNT; c++) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "command=\"%s\"", scaleCommandName(c));
+    metricsWriteSample(out, "espresso_scale_command_latency_seconds_total", commands[c].sumMs / 1e3, labels);
+  }
+  metricsWriteHeader(out, "espresso_scale_command_last_latency_seconds", "gauge",
+                     "Time from first send to confirmation of the most recent confirmed command");
+  for (int c = 0; c < SCALE_CMD_COUNT; c++) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "command=\"%s\"", scaleCommandName(c));
+    metricsWriteSample(out, "espresso_scale_command_last_latency_seconds", commands[c].lastMs / 1e3, labels);
+  }
+  metricsWrite(out, "espresso_scale_soft_tare_grams", "gauge",
+               "Weight subtracted in software after an unconfirmed tare (0 = scale tared)",
+               scaleCommandsSoftTareG());
+
+  WeightFilterStats filter;
+  scaleFilterStats(&filter);
+  metricsWriteHeader(out, "espresso_weight_filter_packets_total", "counter",
+                     "Scale packets through the weight sanitizer by outcome");
+  metricsWriteSample(out, "espresso_weight_filter_packets_total", filter.accepted, "result=\"accepted\"");
+  metricsWriteSample(out, "espresso_weight_filter_packets_total", filter.spikes, "result=\"spike\"");
+  metricsWriteSample(out, "espresso_weight_filter_packets_total", filter.blanked, "result=\"blanked\"");
+  metricsWrite(out, "espresso_weight_filter_steps_total", "counter",
+               "Weight level changes the rate gate took over as real", filter.steps);
+
+  // Shots
+  metricsWriteHeader(out, "espresso_shots_total", "counter", "Ended shots by end reason");
+  const EndType ends[] = { EndType::BUTTON, EndType::WEIGHT, EndType::TIME,
+                           EndType::WEB, EndType::UNDEF };
+  for (EndType end : ends) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "end=\"%s\"", endReasonName(end));
+    metricsWriteSample(out, "espresso_shots_total", shotEndCount(end), labels);
+  }
+
+  // Persistence and locks
+  metricsWrite(out, "espresso_settings_save_requests_total", "counter",
+               "Settings save requests (coalesced into commits)", settingsSaveRequestCount());
+  metricsWrite(out, "espresso_settings_commits_total", "counter",
+               "EEPROM settings commits", settingsCommitCount());
+  metricsWrite(out, "espresso_settings_commit_seconds_total", "counter",
+               "Total time spent in EEPROM commits", settingsCommitTotalS());
+  metricsWrite(out, "espresso_settings_commit_last_seconds", "gauge",
+               "Duration of the most recent EEPROM commit", settingsCommitLastS());
+  metricsWrite(out, "espresso_settings_commits_deferred_total", "counter",
+               "Commits held back until a shot, cleaning cycle or autotune ended",
+               settingsDeferredCount());
+  metricsWrite(out, "espresso_settings_pending", "gauge",
+               "1 while changed settings await their commit", settingsPending() ? 1 : 0);
+  metricsWriteHeader(out, "espresso_config_patches_total", "counter",
+                     "/config PATCH requests, applied or rejected as a whole");
+  metricsWriteSample(out, "espresso_config_patches_total", liveConfigAppliedCount(), "result=\"applied\"");
+  metricsWriteSample(out, "espresso_config_patches_total", liveConfigRejectedCount(), "result=\"rejected\"");
+  metricsWrite(out, "espresso_history_lock_contended_total", "counter",
+               "Shot history lock takes that had to wait", shotHistoryLockContended());
+  metricsWrite(out, "espresso_history_lock_timeouts_total", "counter",
+               "Shot history lock takes that timed out", shotHistoryLockTimeouts());
+
+  // Heap
+  metricsWrite(out, "espresso_heap_free_bytes", "gauge",
+               "Free heap", ESP.getFreeHeap());
+  metricsWrite(out, "espresso_heap_min_free_bytes", "gauge",
+               "Lowest free heap since boot", ESP.getMinFreeHeap());
+  metricsWrite(out, "espresso_heap_largest_free_block_bytes", "gauge",
+               "Largest allocatable heap block",
+               heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
@@ -0,0 +1,39 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// ============================================================================
+// FIRMWARE METRICS (Prometheus text exposition at /metrics)
+// ============================================================================
+// Counters and gauges for long-term observation of the running machine: a
+// scraper on the LAN polls /metrics and graphs control-loop timing, mains
+// sync, pump clicks, scale link health, shot outcomes, flash commits and
+// heap over days. Counters live in their owning modules (pump_dimmer,
+// shot_stopper, settings, shot_history) behind plain accessors; this module
+// only owns the control-loop timing and renders the exposition text.
+//
+// Counters are cumulative since boot (a reboot looks like a counter reset,
+// which Prometheus' rate() handles). "_max" gauges are maxima since the
+// previous scrape and reset when read.
+
+#include <Arduino.h>
+
+// Nominal control task period (main.cpp: vTaskDelay(10 ms)); iterations whose
+// start-to-start period exceeds twice this are counted as overruns
+#define METRICS_CONTROL_PERIOD_US 10000
+
+// Record one control iteration: its execution time and the time since the
+// previous iteration started. Called by the control task only.
+void metricsRecordControlIteration(uint32_t durationUs, uint32_t periodUs);
+
+// Append the full exposition text for all firmware metrics to out
+void metricsRender(String& out);
+
+// Helpers for modules appending their own series (e.g. the web server's
+// /state cache counters). type is "counter" or "gauge".
+void metricsWriteHeader(String& out, const char* name, const char* type, const char* help);
+void metricsWriteSample(String& out, const char* name, double value,
+                        const char* labels = nullptr);
+void metricsWrite(String& out, const char* name, const char* type, const char* help,
+                  double value);
+
+#endif // METRICS_H
@@ -0,0 +1,306 @@
+#include "pid_autotune.h"
+
+#include "cleaning_cycle.h"
+#include "debug.h"
+#include "pressure_control.h"
+#include "shot_stopper.h"
+
+// Defaults: oscillate a little below brew pressure with the pump switching
+// between off and ~80 %, which keeps the limit cycle well clear of the OPV.
+// 0.1 bar hysteresis is a few times the filtered sensor noise.
+AutotuneConfig autotuneConfig = {
+  6.0f,   // setpointBar
+  0.1f,   // hysteresisBar
+  200,    // relayHigh
+  0,      // relayLow
+  4,      // cycles
+  120.0f, // timeoutS
+  11.0f   // maxPressureBar
+};
+
+volatile bool autotuneStartRequest = false;
+volatile bool autotuneStopRequest = false;
+
+// Offline runs step the simulated group at the control task's cadence
+static const float SIM_DT_S = 0.01f;
+
+// ============================================================================
+// RELAY EXPERIMENT
+// ============================================================================
+
+static void fail(RelayExperiment* e, const char* reason) {
+  e->status = AutotuneStatus::FAILED;
+  e->failReason = reason;
+}
+
+void relayExperimentStart(RelayExperiment* e, const AutotuneConfig& cfg, float nowS) {
+  memset(e, 0, sizeof(*e));
+  e->cfg = cfg;
+  e->status = AutotuneStatus::PRESSURIZE;
+  e->startS = nowS;
+  e->lastOnS = -1.0f;
+}
+
+uint8_t relayExperimentStep(RelayExperiment* e, float pressureBar, float nowS) {
+  const AutotuneConfig& c = e->cfg;
+  if (e->status != AutotuneStatus::PRESSURIZE && e->status != AutotuneStatus::RELAY) {
+    return c.relayLow;
+  }
+  if (pressureBar > c.maxPressureBar) {
+    fail(e, "overpressure");
+    return c.relayLow;
+  }
+  if (nowS - e->startS > c.timeoutS) {
+    fail(e, e->status == AutotuneStatus::PRESSURIZE
+                ? "setpoint never reached - blind basket inserted?"
+                : "no stable limit cycle before the timeout");
+    return c.relayLow;
+  }
+
+  float upper = c.setpointBar + c.hysteresisBar;
+  float lower = c.setpointBar - c.hysteresisBar;
+
+  if (e->status == AutotuneStatus::PRESSURIZE) {
+    if (pressureBar < upper) {
+      return c.relayHigh;
+    }
+    e->status = AutotuneStatus::RELAY;
+    e->relayOn = false;
+  }
+
+  // A cycle runs from one switch-on to the next. Its maximum comes after
+  // the switch-off; its minimum shortly after the switch-on (the dead
+  // time), so the minimum's timing is only tracked while the relay is on -
+  // the slow fall before the next switch-on would otherwise win
+  e->cycleMax = fmaxf(e->cycleMax, pressureBar);
+  if (pressureBar < e->cycleMin) {
+    e->cycleMin = pressureBar;
+    if (e->relayOn) {
+      e->cycleMinS = nowS;
+    }
+  }
+
+  if (e->relayOn && pressureBar >= upper) {
+    e->relayOn = false;
+    e->lastOffS = nowS;
+  } else if (!e->relayOn && pressureBar <= lower) {
+    if (e->lastOnS >= 0.0f && ++e->cyclesSeen > AUTOTUNE_SETTLE_CYCLES) {
+      e->periodSum += nowS - e->lastOnS;
+      e->onTimeSum += e->lastOffS - e->lastOnS;
+      e->amplitudeSum += (e->cycleMax - e->cycleMin) / 2.0f;
+      e->deadTimeSum += e->cycleMinS - e->lastOnS;
+      if (++e->measured >= c.cycles) {
+        e->status = AutotuneStatus::DONE;
+        return c.relayLow;
+      }
+    }
+    e->relayOn = true;
+    e->lastOnS = nowS;
+    e->cycleMax = pressureBar;
+    e->cycleMin = pressureBar;
+    e->cycleMinS = nowS;
+  }
+  return e->relayOn ? c.relayHigh : c.relayLow;
+}
+
+// Ku/Tu tables: proportional factor, Ti and Td as fractions of Tu
+struct TuningRule {
+  const char* name;
+  float kpFactor;
+  float tiFactor;
+  float tdFactor;
+};
+
+static const TuningRule RULES[AUTOTUNE_RULE_COUNT] = {
+  { "ziegler_nichols", 0.60f, 0.5f, 0.125f },  // Quarter-decay, aggressive
+  { "some_overshoot",  0.33f, 0.5f, 0.333f },
+  { "no_overshoot",    0.20f, 0.5f, 0.333f },
+};
+
+bool relayExperimentResult(const RelayExperiment* e, AutotuneResult* out) {
+  if (e->status != AutotuneStatus::DONE || e->measured == 0) {
+    return false;
+  }
+  const AutotuneConfig& c = e->cfg;
+  float a = e->amplitudeSum / e->measured;
+  float d = (c.relayHigh - c.relayLow) / 2.0f;
+  // An amplitude barely above the hysteresis would blow Ku up: floor the
+  // root at a tenth of the amplitude
+  float eps = c.hysteresisBar;
+  float root = sqrtf(fmaxf(a * a - eps * eps, 0.01f * a * a));
+
+  out->ultimateGain = 4.0f * d / ((float)M_PI * root);
+  out->ultimatePeriodS = e->periodSum / e->measured;
+  out->amplitudeBar = a;
+  out->deadTimeS = e->deadTimeSum / e->measured;
+  out->cycles = e->measured;
+  // Each half-cycle moves the pressure through the hysteresis band
+  float onS = e->onTimeSum / e->measured;
+  float offS = out->ultimatePeriodS - onS;
+  out->riseRateBarS = onS > 0.0f ? 2.0f * eps / onS : 0.0f;
+  out->fallRateBarS = offS > 0.0f ? 2.0f * eps / offS : 0.0f;
+  for (int i = 0; i < AUTOTUNE_RULE_COUNT; i++) {
+    float kp = RULES[i].kpFactor * out->ultimateGain;
+    float ti = RULES[i].tiFactor * out->ultimatePeriodS;
+    float td = RULES[i].tdFactor * out->ultimatePeriodS;
+    out->candidates[i] = { kp, kp / ti, kp * td };
+  }
+  return true;
+}
+
+const char* autotuneRuleName(int rule) {
+  return rule >= 0 && rule < AUTOTUNE_RULE_COUNT ? RULES[rule].name : "unknown";
+}
+
+int autotuneRuleFromName(const char* name) {
+  for (int i = 0; i < AUTOTUNE_RULE_COUNT; i++) {
+    if (strcmp(name, RULES[i].name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// ============================================================================
+// ON THE MACHINE
+// ============================================================================
+
+static RelayExperiment experiment = {};  // status IDLE
+static uint8_t pumpLevel = 255;
+static bool machineOn = false;
+
+// Last completed result (control task writes, web server reads)
+static portMUX_TYPE resultMux = portMUX_INITIALIZER_UNLOCKED;
+static AutotuneResult lastResult = {};
+static bool hasResult = false;
+
+// Same electrical pattern as the cleaning cycle (cleaning_cycle.cpp)
+static void setMachine(bool on) {
+  if (on == machineOn) {
+    return;
+  }
+  if (MOMENTARY) {
+    digitalWrite(PRESS_BUTTON_PIN, HIGH);
+    delay(1000);
+    digitalWrite(PRESS_BUTTON_PIN, LOW);
+  } else {
+    digitalWrite(PRESS_BUTTON_PIN, on ? HIGH : LOW);
+    buttonLatched = on;
+  }
+  machineOn = on;
+}
+
+bool autotuneActive() {
+  return experiment.status == AutotuneStatus::PRESSURIZE
+      || experiment.status == AutotuneStatus::RELAY;
+}
+
+uint8_t autotunePumpLevel() {
+  return autotuneActive() ? pumpLevel : 255;
+}
+
+void autotuneAbortFromButton() {
+  if (!autotuneActive()) {
+    return;
+  }
+  DEBUG_SHOT_PRINT("Physical button press - autotune aborted, machine left as the user set it");
+  if (!MOMENTARY) {
+    buttonLatched = false;
+    digitalWrite(PRESS_BUTTON_PIN, LOW);
+  }
+  machineOn = false;
+  fail(&experiment, "aborted by the brew button");
+}
+
+void autotuneUpdate(float pressureBar) {
+  if (autotuneStopRequest) {
+    autotuneStopRequest = false;
+    if (autotuneActive()) {
+      DEBUG_SHOT_PRINT("Autotune stopped via web");
+      setMachine(false);
+      fail(&experiment, "stopped via web");
+    }
+  }
+  if (autotuneStartRequest) {
+    autotuneStartRequest = false;
+    if (!autotuneActive() && !shot.brewing && !cleaningActive()) {
+      DEBUG_SHOT_PRINT("Autotune started: relay %d/%d around %.1f +/- %.2f bar, %d cycles",
+                       autotuneConfig.relayLow, autotuneConfig.relayHigh,
+                       autotuneConfig.setpointBar, autotuneConfig.hysteresisBar,
+                       autotuneConfig.cycles);
+      relayExperimentStart(&experiment, autotuneConfig, secondsSinceBoot());
+      setMachine(true);
+    }
+  }
+
+  if (!autotuneActive()) {
+    return;
+  }
+
+  pumpLevel = relayExperimentStep(&experiment, pressureBar, secondsSinceBoot());
+  if (autotuneActive()) {
+    return;
+  }
+
+  setMachine(false);
+  AutotuneResult r;
+  if (relayExperimentResult(&experiment, &r)) {
+    portENTER_CRITICAL(&resultMux);
+    lastResult = r;
+    hasResult = true;
+    portEXIT_CRITICAL(&resultMux);
+    DEBUG_SHOT_PRINT("Autotune done: Ku %.1f, Tu %.2f s, amplitude %.2f bar, dead time %.2f s",
+                     r.ultimateGain, r.ultimatePeriodS, r.amplitudeBar, r.deadTimeS);
+  } else {
+    DEBUG_SHOT_PRINT("Autotune failed: %s", experiment.failReason);
+  }
+}
+
+const char* autotuneStatusName() {
+  switch (experiment.status) {
+    case AutotuneStatus::IDLE:       return "idle";
+    case AutotuneStatus::PRESSURIZE: return "pressurize";
+    case AutotuneStatus::RELAY:      return "relay";
+    case AutotuneStatus::DONE:       return "done";
+    case AutotuneStatus::FAILED:     return "failed";
+  }
+  return "unknown";
+}
+
+const char* autotuneFailReason() {
+  return experiment.status == AutotuneStatus::FAILED ? experiment.failReason : nullptr;
+}
+
+int autotuneCyclesMeasured() {
+  return experiment.measured;
+}
+
+bool autotuneLastResult(AutotuneResult* out) {
+  portENTER_CRITICAL(&resultMux);
+  bool ok = hasResult;
+  *out = lastResult;
+  portEXIT_CRITICAL(&resultMux);
+  return ok;
+}
+
+// ============================================================================
+// OFFLINE
+// ============================================================================
+
+AutotuneStatus autotuneSimulate(const AutotuneConfig& cfg, AutotuneResult* out,
+                                const char** failReason) {
+  RelayExperiment e;
+  relayExperimentStart(&e, cfg, 0.0f);
+  SimulatedGroup group;
+  simGroupInit(&group, SIM_BLIND_BASKET_CONDUCTANCE);
+
+  float t = 0.0f;
+  while (e.status == AutotuneStatus::PRESSURIZE || e.status == AutotuneStatus::RELAY) {
+    uint8_t level = relayExperimentStep(&e, group.sensed, t);
+    simGroupStep(&group, level / 255.0f, SIM_DT_S);
+    t += SIM_DT_S;
+  }
+  *failReason = e.failReason;
+  relayExperimentResult(&e, out);
+  return e.status;
+}
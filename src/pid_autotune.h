@@ -0,0 +1,128 @@
+#ifndef PID_AUTOTUNE_H
+#define PID_AUTOTUNE_H
+
+// ============================================================================
+// PID AUTOTUNE - RELAY FEEDBACK EXPERIMENT (ASTROM-HAGGLUND)
+// ============================================================================
+// Replaces hand-tuning through /set_pid after a gasket, pump or basket
+// change. With a blind basket in the portafilter the pump is switched
+// between two levels around a setpoint (a relay with hysteresis), which
+// drives the group into a limit cycle. Its period is the ultimate period Tu
+// and its amplitude a gives the ultimate gain by the describing function:
+//
+//   Ku = 4 d / (pi * sqrt(a^2 - eps^2))
+//
+// with d the relay half-swing in PWM counts (the PID's output unit) and eps
+// the hysteresis. The lag from each switch-on to the pressure's turning
+// point is reported as the apparent dead time, the mean slopes through the
+// hysteresis band with the relay on and off as the group's rise and fall
+// rates (the blind basket makes it close to an integrator). Candidate gains follow the
+// classic Ku/Tu tables; none is applied until /apply_autotune picks one.
+//
+//   PRESSURIZE  machine button ON, pump at relayHigh until the setpoint
+//   RELAY       limit cycle; the first AUTOTUNE_SETTLE_CYCLES are discarded
+//   DONE/FAILED machine button OFF (failsafe: maxPressureBar, timeoutS)
+//
+// The same experiment (RelayExperiment) runs offline against the simulated
+// group (pressure_control.h) for testing without a machine: GET
+// /autotune_simulation, run by the simulation worker (sim_worker.h). On
+// the machine it runs inside the control task like
+// the cleaning cycle; HTTP handlers only set the request flags.
+
+#include <Arduino.h>
+
+#include "pid_controller.h"  // PidGains
+
+// Limit cycles discarded while the oscillation settles
+#define AUTOTUNE_SETTLE_CYCLES 1
+
+#define AUTOTUNE_RULE_COUNT 3
+
+struct AutotuneConfig {
+  float setpointBar;    // Pressure the relay oscillates around
+  float hysteresisBar;  // Relay switches at setpoint +/- this
+  uint8_t relayHigh;    // Pump level with the relay on (0-255)
+  uint8_t relayLow;     // Pump level with the relay off
+  int cycles;           // Limit cycles measured after settling
+  float timeoutS;       // Give up if the cycles haven't completed
+  float maxPressureBar; // Abort immediately above this
+};
+
+extern AutotuneConfig autotuneConfig;
+
+enum class AutotuneStatus : uint8_t { IDLE, PRESSURIZE, RELAY, DONE, FAILED };
+
+struct AutotuneResult {
+  float ultimateGain;     // Ku, PWM counts per bar
+  float ultimatePeriodS;  // Tu
+  float amplitudeBar;     // Half peak-to-peak of the limit cycle
+  float deadTimeS;        // Switch-on to pressure turning point
+  float riseRateBarS;     // Pressure slope with the relay on
+  float fallRateBarS;     // ... and off (leak through pump and valve)
+  int cycles;             // Cycles averaged
+  PidGains candidates[AUTOTUNE_RULE_COUNT];  // Indexed like autotuneRuleName()
+};
+
+// One relay experiment: feed it the pressure every control iteration and
+// apply the pump level it returns
+struct RelayExperiment {
+  AutotuneConfig cfg;
+  AutotuneStatus status;
+  const char* failReason;
+  bool relayOn;
+  float startS;
+  float lastOnS;          // Last switch-on (-1 = none yet)
+  float lastOffS;
+  float cycleMax, cycleMin;
+  float cycleMinS;        // When this cycle's minimum occurred
+  int cyclesSeen;         // Complete cycles, settling ones included
+  float periodSum, onTimeSum, amplitudeSum, deadTimeSum;
+  int measured;
+};
+
+void relayExperimentStart(RelayExperiment* e, const AutotuneConfig& cfg, float nowS);
+uint8_t relayExperimentStep(RelayExperiment* e, float pressureBar, float nowS);
+
+// Identified plant and candidate gains; false until status is DONE
+bool relayExperimentResult(const RelayExperiment* e, AutotuneResult* out);
+
+// "ziegler_nichols", "some_overshoot", "no_overshoot"
+const char* autotuneRuleName(int rule);
+int autotuneRuleFromName(const char* name);  // -1 if unknown
+
+// ----------------------------------------------------------------------------
+// On the machine (control task)
+// ----------------------------------------------------------------------------
+
+// Set by HTTP handlers, consumed by autotuneUpdate()
+extern volatile bool autotuneStartRequest;
+extern volatile bool autotuneStopRequest;
+
+// True while the experiment owns the machine; blocks shot and cleaning starts
+bool autotuneActive();
+
+// One iteration of the experiment (control task)
+void autotuneUpdate(float pressureBar);
+
+// Pump level the experiment wants right now (255 when inactive)
+uint8_t autotunePumpLevel();
+
+// Physical brew button pressed: abort without pulsing the button again
+void autotuneAbortFromButton();
+
+// Status for /state
+const char* autotuneStatusName();
+const char* autotuneFailReason();   // nullptr unless FAILED
+int autotuneCyclesMeasured();
+bool autotuneLastResult(AutotuneResult* out);  // False until one completed
+
+// ----------------------------------------------------------------------------
+// Offline (simulation worker, sim_worker.h)
+// ----------------------------------------------------------------------------
+
+// The same experiment against the simulated blind basket. Returns the final
+// status (DONE or FAILED) and fills out on DONE.
+AutotuneStatus autotuneSimulate(const AutotuneConfig& cfg, AutotuneResult* out,
+                                const char** failReason);
+
+#endif // PID_AUTOTUNE_H
@@ -2,6 +2,18 @@
 
 #include "debug.h"
 
+// Guards the gains of every controller (web server writes, control task
+// reads them each step)
+static portMUX_TYPE gainsMux = portMUX_INITIALIZER_UNLOCKED;
+
+const char* pidGainsValidate(const PidGains& gains) {
+  if (!isfinite(gains.kp) || !isfinite(gains.ki) || !isfinite(gains.kd)
+      || gains.kp < 0.0f || gains.ki < 0.0f || gains.kd < 0.0f) {
+    return "pid gains must be finite and >= 0";
+  }
+  return nullptr;
+}
+
 PIDController::PIDController(float kp, float ki, float kd)
   : kp(kp), ki(ki), kd(kd),
     outputMin(0),   // 30% floor: min power to prevent backflow/pump shutoff
@@ -18,6 +30,21 @@ PIDController::PIDController(float kp, float ki, float kd)
     lastDTerm(0.0f),
     lastOutput(255) {}
 
+void PIDController::setGains(const PidGains& gains) {
+  portENTER_CRITICAL(&gainsMux);
+  kp = gains.kp;
+  ki = gains.ki;
+  kd = gains.kd;
+  portEXIT_CRITICAL(&gainsMux);
+}
+
+PidGains PIDController::getGains() const {
+  portENTER_CRITICAL(&gainsMux);
+  PidGains gains = { kp, ki, kd };
+  portEXIT_CRITICAL(&gainsMux);
+  return gains;
+}
+
 void PIDController::reset() {
   integral = 0.0f;
   derivativeFiltered = 0.0f;
@@ -38,28 +65,34 @@ int PIDController::calculate(float setpoint, float measurement) {
     lastTimeMs = now;
     return outputMax;  // Default to full power on first call
   }
+  lastTimeMs = now;
+
+  return calculate(setpoint, measurement, dt);
+}
+
+int PIDController::calculate(float setpoint, float measurement, float dt) {
+  PidGains g = getGains();
 
   // Calculate error (positive = need more pressure)
   float error = setpoint - measurement;
 
   // Proportional term
-  float pTerm = kp * error;
+  float pTerm = g.kp * error;
 
   // Integral term with anti-windup clamping
   integral += error * dt;
   integral = constrain(integral, -integralMax, integralMax);
-  float iTerm = ki * integral;
+  float iTerm = g.ki * integral;
 
   // Derivative on measurement (sign-flipped), so setpoint steps from the
   // pressure profile don't kick the output; low-pass filtered against noise
   float derivative = firstSample ? 0.0f : -(measurement - previousMeasurement) / dt;
   firstSample = false;
   derivativeFiltered += PID_DERIVATIVE_FILTER_ALPHA * (derivative - derivativeFiltered);
-  float dTerm = kd * derivativeFiltered;
+  float dTerm = g.kd * derivativeFiltered;
 
   // Save state for next iteration
   previousMeasurement = measurement;
-  lastTimeMs = now;
 
   // Calculate output: center at 128, add PID correction
   float output = 128.0f + pTerm + iTerm + dTerm;
@@ -20,9 +20,21 @@
 // Low-pass factor for the derivative term (EMA per iteration at ~20 Hz)
 #define PID_DERIVATIVE_FILTER_ALPHA 0.3f
 
+// One consistent set of gains
+struct PidGains {
+  float kp;
+  float ki;
+  float kd;
+};
+
+// Null if the gains are usable (finite, >= 0), otherwise what is wrong
+const char* pidGainsValidate(const PidGains& gains);
+
 class PIDController {
 public:
-  // PID gains (public so the web dashboard can tune them live)
+  // PID gains. The web server tunes them live while the control task runs
+  // the controller: once the tasks are up, go through setGains()/getGains()
+  // so neither side sees half an update.
   float kp;  // Proportional gain
   float ki;  // Integral gain
   float kd;  // Derivative gain
@@ -40,6 +52,10 @@ public:
 
   PIDController(float kp = 15.0f, float ki = 1.0f, float kd = 5.0f);
 
+  // All three gains at once, spinlock-guarded (any task)
+  void setGains(const PidGains& gains);
+  PidGains getGains() const;
+
   // Reset PID state (call when starting a new shot)
   void reset();
 
@@ -51,6 +67,10 @@ public:
    */
   int calculate(float setpoint, float measurement);
 
+  // Same step with an explicit dt (s) instead of the millis() clock - the
+  // offline controller benchmark runs it in simulated time
+  int calculate(float setpoint, float measurement, float dt);
+
   // Last computed terms and output (for web dashboard / tuning)
   float getPTerm() const { return lastPTerm; }
   float getITerm() const { return lastITerm; }
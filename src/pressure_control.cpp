@@ -0,0 +1,261 @@
+#include "pressure_control.h"
+
+#include "pressure_mpc.h"
+#include "pump_model.h"
+
+// Simulated group: the identifier starts from MPC_DEFAULT_* and has to find
+// these; the pump delivers 90 % of its model curve (a worn pump)
+static const float PLANT_COMPLIANCE_ML_PER_BAR = 3.5f;
+static const float PLANT_CONDUCTANCE_START = 0.15f;  // ml/s per bar, fresh puck
+static const float PLANT_CONDUCTANCE_END = 0.35f;    // eroded by the end
+static const float PLANT_PUMP_GAIN = 0.9f;
+static const float SENSOR_TIME_CONSTANT_S = 0.1f;    // PRESSURE_FILTER_ALPHA at 10 ms
+static const float PUMP_TIME_CONSTANT_S = 0.1f;      // PSM spreads a level change
+                                                     //  over several mains cycles
+
+// Control task timing
+static const float CONTROL_DT_S = 0.01f;
+static const float DERIVED_DT_S = 0.1f;
+
+static const float STEP_GOALS_BAR[BENCHMARK_STEP_COUNT] = { 9.0f, 6.0f };
+static const float STEP_DURATION_S = 10.0f;
+
+// ============================================================================
+// LAWS
+// ============================================================================
+
+volatile int pressureControlSelected = PRESSURE_CONTROL_GAGGIUINO;
+
+// Flow cap as a fraction of the maximum click rate (1 = none)
+static float maxPctForFlow(const ControlInput& in) {
+  return in.maxFlow > 0.0f
+      ? getClicksPerSecondForFlow(in.maxFlow, in.pressure) / getMaxPumpClicksPerSecond()
+      : 1.0f;
+}
+
+static void pidShotStart(ControllerState* c) {
+  c->pid->reset();
+}
+
+static float pidPumpPct(ControllerState* c, const ControlInput& in) {
+  int pwm = c->pid->calculate(in.goalBar, in.pressure, in.dtS);
+  return fminf(pwm / 255.0f, maxPctForFlow(in));
+}
+
+static void pidTrack(ControllerState* c, float pct) {
+  c->pid->reset();
+}
+
+static void gaggiuinoShotStart(ControllerState* c) {}
+
+static float gaggiuinoPumpPct(ControllerState* c, const ControlInput& in) {
+  return getPumpPct(in.goalBar, in.maxFlow, in.pressure, in.pumpFlow, in.pressureChangeSpeed);
+}
+
+static void gaggiuinoTrack(ControllerState* c, float pct) {}
+
+static void mpcLawShotStart(ControllerState* c) {
+  mpcShotStart(c->mpc);
+  c->heldPct = 1.0f;
+  c->lastSolveS = -1.0f;
+}
+
+// Re-solve every MPC_PERIOD_MS over the previewed profile, hold between
+static float mpcLawPumpPct(ControllerState* c, const ControlInput& in) {
+  if (c->lastSolveS < 0.0f || (in.nowS - c->lastSolveS) * 1000.0f >= MPC_PERIOD_MS - 1) {
+    c->lastSolveS = in.nowS;
+    float goals[MPC_HORIZON_STEPS];
+    for (int k = 0; k < MPC_HORIZON_STEPS; k++) {
+      goals[k] = in.goalAt(in.shotTimeS + (k + 1) * MPC_STEP_S);
+    }
+    c->heldPct = mpcPumpPct(c->mpc, in.pressure, goals, maxPctForFlow(in));
+  }
+  return c->heldPct;
+}
+
+static void mpcLawTrack(ControllerState* c, float pct) {
+  c->mpc->lastPct = pct;
+  c->heldPct = pct;
+}
+
+// Indexed by PRESSURE_CONTROL_*
+static const PressureControlLaw LAWS[PRESSURE_CONTROL_LAW_COUNT] = {
+  { "pid",       pidShotStart,       pidPumpPct,       pidTrack },
+  { "gaggiuino", gaggiuinoShotStart, gaggiuinoPumpPct, gaggiuinoTrack },
+  { "mpc",       mpcLawShotStart,    mpcLawPumpPct,    mpcLawTrack },
+};
+
+const PressureControlLaw* pressureControlLaw(int law) {
+  return law >= 0 && law < PRESSURE_CONTROL_LAW_COUNT ? &LAWS[law] : nullptr;
+}
+
+const char* pressureControlLawName(int law) {
+  const PressureControlLaw* l = pressureControlLaw(law);
+  return l ? l->name : "unknown";
+}
+
+int pressureControlLawFromName(const char* name) {
+  for (int i = 0; i < PRESSURE_CONTROL_LAW_COUNT; i++) {
+    if (strcmp(name, LAWS[i].name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// ============================================================================
+// SCORING
+// ============================================================================
+
+void controlScoreStart(ControlScorer* s) {
+  memset(s, 0, sizeof(*s));
+  s->lastPct = -1.0f;
+}
+
+void controlScoreUpdate(ControlScorer* s, float nowS, float dtS, float goalBar,
+                        float endBar, float pressure, float pct) {
+  if (!s->inStep || fabsf(endBar - s->stepGoal) > CONTROL_STEP_BAR) {
+    s->inStep = true;
+    s->stepGoal = endBar;
+    s->stepStartS = nowS;
+    s->rising = pressure < endBar;
+    s->reached = false;
+  }
+
+  ControlScore& r = s->score;
+  float err = pressure - goalBar;
+  r.iaeBarS += fabsf(err) * dtS;
+  r.scoredS += dtS;
+  if (!s->reached && (s->rising ? err >= 0.0f : err <= 0.0f)) {
+    s->reached = true;
+  }
+  if (s->reached) {
+    r.overshootBar = fmaxf(r.overshootBar, s->rising ? err : -err);
+  }
+  if (fabsf(err) > CONTROL_SETTLE_BAND_BAR) {
+    r.settlingS = fmaxf(r.settlingS, nowS + dtS - s->stepStartS);
+  }
+  if (s->lastPct >= 0.0f) {
+    r.pumpTravel += fabsf(pct - s->lastPct);
+  }
+  s->lastPct = pct;
+}
+
+void controlScoreBreak(ControlScorer* s) {
+  s->inStep = false;
+  s->lastPct = -1.0f;
+}
+
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+static ControlLawStats lawStats[PRESSURE_CONTROL_LAW_COUNT] = {};
+
+void pressureControlRecordShot(int law, const ControlScore& score) {
+  if (!pressureControlLaw(law) || score.scoredS <= 0.0f) {
+    return;
+  }
+  portENTER_CRITICAL(&statsMux);
+  ControlLawStats& st = lawStats[law];
+  st.shots++;
+  st.sum.iaeBarS += score.iaeBarS;
+  st.sum.overshootBar += score.overshootBar;
+  st.sum.settlingS += score.settlingS;
+  st.sum.pumpTravel += score.pumpTravel;
+  st.sum.scoredS += score.scoredS;
+  portEXIT_CRITICAL(&statsMux);
+}
+
+void pressureControlStats(int law, ControlLawStats* out) {
+  *out = {};
+  if (!pressureControlLaw(law)) {
+    return;
+  }
+  portENTER_CRITICAL(&statsMux);
+  *out = lawStats[law];
+  portEXIT_CRITICAL(&statsMux);
+}
+
+// ============================================================================
+// SIMULATED GROUP + BENCHMARK
+// ============================================================================
+
+void simGroupInit(SimulatedGroup* g, float conductance) {
+  g->pressure = 0.0f;
+  g->sensed = 0.0f;
+  g->pumpFlow = 0.0f;
+  g->pumpPct = 0.0f;
+  g->conductance = conductance;
+}
+
+void simGroupStep(SimulatedGroup* g, float pct, float dtS) {
+  g->pumpPct += dtS / PUMP_TIME_CONSTANT_S * (pct - g->pumpPct);
+  float clicksPerSecond = g->pumpPct * getMaxPumpClicksPerSecond();
+  float trueFlow = clicksPerSecond * PLANT_PUMP_GAIN
+      * fmaxf(getPumpFlowPerClickModel(g->pressure), 0.0f);
+  g->pressure += dtS * (trueFlow - g->conductance * g->pressure) / PLANT_COMPLIANCE_ML_PER_BAR;
+  g->pressure = fmaxf(g->pressure, 0.0f);
+  g->sensed += dtS / SENSOR_TIME_CONSTANT_S * (g->pressure - g->sensed);
+  // The firmware's flow "measurement" is clicks times the model curve
+  g->pumpFlow = getPumpFlow(clicksPerSecond, g->sensed);
+}
+
+static float benchmarkGoal(float t) {
+  int step = min((int)(t / STEP_DURATION_S), BENCHMARK_STEP_COUNT - 1);
+  return STEP_GOALS_BAR[step];
+}
+
+void pressureControlBenchmark(int law, const PidGains& gains, BenchmarkResult* out) {
+  const PressureControlLaw* l = pressureControlLaw(law);
+  PIDController pid(gains.kp, gains.ki, gains.kd);
+  MpcState mpc;
+  mpcInit(&mpc);
+  ControllerState c = { &pid, &mpc, 1.0f, -1.0f };
+  l->shotStart(&c);
+
+  const int stepIterations = (int)(STEP_DURATION_S / CONTROL_DT_S);
+  const int derivedEvery = (int)(DERIVED_DT_S / CONTROL_DT_S);
+
+  SimulatedGroup group;
+  simGroupInit(&group, PLANT_CONDUCTANCE_START);
+  float lastDerivedPressure = 0.0f;
+  float pressureChangeSpeed = 0.0f;
+  out->pumpTravel = 0.0f;
+
+  for (int s = 0; s < BENCHMARK_STEP_COUNT; s++) {
+    ControlScorer scorer;
+    controlScoreStart(&scorer);
+
+    for (int i = 0; i < stepIterations; i++) {
+      int iteration = s * stepIterations + i;
+      float t = iteration * CONTROL_DT_S;
+
+      if (iteration % derivedEvery == 0) {
+        pressureChangeSpeed = (group.sensed - lastDerivedPressure) / DERIVED_DT_S;
+        lastDerivedPressure = group.sensed;
+        mpcIdentify(&mpc, group.pumpFlow, group.sensed, pressureChangeSpeed);
+      }
+
+      ControlInput in = {
+        t, CONTROL_DT_S, t, STEP_GOALS_BAR[s], 0.0f,
+        group.sensed, group.pumpFlow, pressureChangeSpeed, benchmarkGoal
+      };
+      float pct = l->pumpPct(&c, in);
+
+      // The puck opens up linearly through the shot
+      group.conductance = PLANT_CONDUCTANCE_START
+          + (PLANT_CONDUCTANCE_END - PLANT_CONDUCTANCE_START)
+            * t / (STEP_DURATION_S * BENCHMARK_STEP_COUNT);
+      simGroupStep(&group, pct, CONTROL_DT_S);
+
+      // Score on the true pressure
+      controlScoreUpdate(&scorer, t, CONTROL_DT_S, STEP_GOALS_BAR[s], STEP_GOALS_BAR[s],
+                         group.pressure, pct);
+    }
+
+    BenchmarkStepResult& r = out->steps[s];
+    r.goalBar = STEP_GOALS_BAR[s];
+    r.overshootBar = scorer.score.overshootBar;
+    r.settlingS = scorer.score.settlingS;
+    r.iaeBarS = scorer.score.iaeBarS;
+    out->pumpTravel += scorer.score.pumpTravel;
+  }
+}
@@ -0,0 +1,174 @@
+#ifndef PRESSURE_CONTROL_H
+#define PRESSURE_CONTROL_H
+
+// ============================================================================
+// PRESSURE CONTROL LAWS + SCORING + OFFLINE BENCHMARK
+// ============================================================================
+// The laws the control task can run during a shot, registered behind one
+// interface (PressureControlLaw) and selectable at runtime:
+//
+//   PID        Classic PID on the pressure error (pid_controller.cpp)
+//   GAGGIUINO  Pump-model feedforward plus proportional trim (pump_model.cpp)
+//   MPC        Model-predictive, horizon search over the identified
+//              group model (pressure_mpc.cpp)
+//
+// GET /set_controller picks the law for the following shots (persisted);
+// each shot latches its law at the start, so a change never lands mid-shot.
+// Every shot is scored while it runs (ControlScorer: integrated absolute
+// error, overshoot, settling time, pump travel), tagged with its law in the
+// shot history, and folded into per-law totals since boot - A/B testing on
+// real shots via GET /controllers.
+//
+// pressureControlBenchmark() runs one law closed-loop against a simulated
+// group (pump curve from pump_model.h, a compliance, and a puck that erodes
+// through the shot) on a fixed two-step profile, scored the same way per
+// step (GET /controller_benchmark runs all of them).
+//
+// Adding a law: a PRESSURE_CONTROL_* id, its functions and an entry in the
+// table in pressure_control.cpp.
+
+#include <Arduino.h>
+
+#include "pid_controller.h"
+#include "pressure_mpc.h"
+
+#define PRESSURE_CONTROL_PID 0
+#define PRESSURE_CONTROL_GAGGIUINO 1
+#define PRESSURE_CONTROL_MPC 2
+
+#define PRESSURE_CONTROL_LAW_COUNT 3
+
+// Everything a law sees in one control iteration
+struct ControlInput {
+  float nowS;                 // Monotonic time (laws that solve slower than the loop)
+  float dtS;                  // Since the previous iteration
+  float shotTimeS;            // Seconds since shot start
+  float goalBar;              // Pressure goal now
+  float maxFlow;              // Flow cap (ml/s), 0 = none
+  float pressure;             // Filtered pressure (bar)
+  float pumpFlow;             // Measured pump flow (ml/s)
+  float pressureChangeSpeed;  // dP/dt (bar/s)
+  float (*goalAt)(float shotTimeS);  // Profile preview (MPC horizon)
+};
+
+// Working state of the laws: the machine owns one set, every benchmark run
+// its own copy
+struct ControllerState {
+  PIDController* pid;
+  MpcState* mpc;
+  float heldPct;     // Output held between slower solves (MPC)
+  float lastSolveS;  // When it was solved, < 0 = never
+};
+
+struct PressureControlLaw {
+  const char* name;
+  // Shot start: forget per-shot state
+  void (*shotStart)(ControllerState* c);
+  // Click-rate fraction (0..1) to apply this iteration
+  float (*pumpPct)(ControllerState* c, const ControlInput& in);
+  // Something else drives the pump this iteration (a flow goal): follow its
+  // output so handing back to the law is bumpless
+  void (*track)(ControllerState* c, float pct);
+};
+
+// Registered law by id; nullptr if out of range
+const PressureControlLaw* pressureControlLaw(int law);
+const char* pressureControlLawName(int law);
+int pressureControlLawFromName(const char* name);  // -1 if unknown
+
+// Law for the following shots: set by /set_controller (and settingsLoad),
+// latched by the control task at each shot start
+extern volatile int pressureControlSelected;
+
+// ----------------------------------------------------------------------------
+// Scoring
+// ----------------------------------------------------------------------------
+
+// Settled = within this band of the goal for the rest of the step
+#define CONTROL_SETTLE_BAND_BAR 0.3f
+
+// A goal's end pressure moving by more than the band starts a new step; a
+// ramp towards one end pressure stays a single step
+#define CONTROL_STEP_BAR CONTROL_SETTLE_BAND_BAR
+
+struct ControlScore {
+  float iaeBarS;       // Integrated absolute error over the pressure goals
+  float overshootBar;  // Worst excursion past a goal once it was reached
+  float settlingS;     // Longest time from a goal step until it stayed in the band
+  float pumpTravel;    // Sum of |output change| (0..1 units): pump effort
+  float scoredS;       // Time under pressure goals (flow goals aren't scored)
+};
+
+struct ControlScorer {
+  ControlScore score;
+  bool inStep;       // False before the first sample and after a break
+  bool rising;       // The step's goal was above the pressure at its start
+  bool reached;      // The pressure has crossed the goal this step
+  float stepGoal;    // End pressure of the goal that opened the step
+  float stepStartS;
+  float lastPct;     // < 0 = none yet
+};
+
+void controlScoreStart(ControlScorer* s);
+
+// One iteration under a pressure goal: goalBar is the goal now (ramped),
+// endBar where that goal ends up (ProfileGoal::endPressure)
+void controlScoreUpdate(ControlScorer* s, float nowS, float dtS, float goalBar,
+                        float endBar, float pressure, float pct);
+
+// One iteration not under the law (flow goal): not scored, and the next
+// pressure goal opens a new step
+void controlScoreBreak(ControlScorer* s);
+
+// Per-law totals over the shots since boot (control task adds, web reads)
+struct ControlLawStats {
+  uint32_t shots;
+  ControlScore sum;  // Sums of the per-shot scores
+};
+
+void pressureControlRecordShot(int law, const ControlScore& score);
+void pressureControlStats(int law, ControlLawStats* out);
+
+// ----------------------------------------------------------------------------
+// Offline benchmark
+// ----------------------------------------------------------------------------
+
+// Benchmark profile: rise to the first goal, then step down to the second
+#define BENCHMARK_STEP_COUNT 2
+
+struct BenchmarkStepResult {
+  float goalBar;
+  float overshootBar;  // Worst excursion past the goal once reached
+  float settlingS;     // From the step until it stays within the band
+  float iaeBarS;       // Integrated absolute error over the step
+};
+
+struct BenchmarkResult {
+  BenchmarkStepResult steps[BENCHMARK_STEP_COUNT];
+  float pumpTravel;  // Sum of |output change| (0..1 units): how busy the pump was
+};
+
+// Simulate one law; PID runs with gains and the default limits. Takes a
+// few hundred ms for MPC - call from the simulation worker (sim_worker.h),
+// not the control task or a web handler.
+void pressureControlBenchmark(int law, const PidGains& gains, BenchmarkResult* out);
+
+// The simulated group itself, shared with the PID autotuner's offline run
+// (pid_autotune.h): pressure from C dP/dt = pump - G P, a worn pump that
+// follows its level with a lag, sensor lag, and the pump flow as the
+// firmware measures it (clicks times the model curve)
+struct SimulatedGroup {
+  float pressure;     // True group pressure (bar)
+  float sensed;       // What the transducer + filter report (bar)
+  float pumpFlow;     // Measured pump flow (ml/s)
+  float conductance;  // Puck (or leak) conductance, ml/s per bar
+  float pumpPct;      // Effective click-rate fraction (lags the command)
+};
+
+// Blind basket: only the leak past the pump and valve drains the group
+#define SIM_BLIND_BASKET_CONDUCTANCE 0.02f
+
+void simGroupInit(SimulatedGroup* g, float conductance);
+void simGroupStep(SimulatedGroup* g, float pct, float dtS);
+
+#endif // PRESSURE_CONTROL_H
@@ -0,0 +1,124 @@
+#include "pressure_mpc.h"
+
+#include "pump_model.h"
+
+// RLS forgetting per identification sample: ~2 s memory at 10 Hz, fast
+// enough to follow puck erosion through a shot
+static const float FORGETTING = 0.95f;
+
+// Prior variances: compliance is fairly uncertain on a new machine, the
+// puck entirely (it differs every shot)
+static const float PRIOR_COMPLIANCE_VAR = 4.0f;
+static const float PRIOR_CONDUCTANCE_VAR = 0.1f;
+
+// Below this the puck isn't loaded and the linear puck model says nothing
+static const float MIN_IDENTIFY_PRESSURE_BAR = 1.0f;
+
+// Pump click volume sampled every FPC_TABLE_STEP_BAR for the simulation
+static const float FPC_TABLE_STEP_BAR = 0.5f;
+static const int FPC_TABLE_SIZE = 27;  // 0-13 bar
+
+void mpcInit(MpcState* s) {
+  s->compliance = MPC_DEFAULT_COMPLIANCE_ML_PER_BAR;
+  s->conductance = MPC_DEFAULT_CONDUCTANCE;
+  s->cov[0] = PRIOR_COMPLIANCE_VAR;
+  s->cov[1] = 0.0f;
+  s->cov[2] = PRIOR_CONDUCTANCE_VAR;
+  s->lastPct = 1.0f;
+}
+
+void mpcShotStart(MpcState* s) {
+  s->conductance = MPC_DEFAULT_CONDUCTANCE;
+  s->cov[1] = 0.0f;
+  s->cov[2] = PRIOR_CONDUCTANCE_VAR;
+  s->lastPct = 1.0f;  // The pump idles at full power before the shot
+}
+
+void mpcIdentify(MpcState* s, float pumpFlow, float pressure, float pressureChangeSpeed) {
+  if (pressure < MIN_IDENTIFY_PRESSURE_BAR) {
+    return;
+  }
+  // pumpFlow = C * dP/dt + G * P: regressors x = [dP/dt, P]
+  float x0 = pressureChangeSpeed;
+  float x1 = pressure;
+  float p00 = s->cov[0], p01 = s->cov[1], p11 = s->cov[2];
+  float px0 = p00 * x0 + p01 * x1;
+  float px1 = p01 * x0 + p11 * x1;
+  float denom = FORGETTING + x0 * px0 + x1 * px1;
+  float residual = pumpFlow - (s->compliance * x0 + s->conductance * x1);
+
+  s->compliance += px0 / denom * residual;
+  s->conductance += px1 / denom * residual;
+  s->compliance = constrain(s->compliance, MPC_MIN_COMPLIANCE, MPC_MAX_COMPLIANCE);
+  s->conductance = constrain(s->conductance, 0.0f, MPC_MAX_CONDUCTANCE);
+
+  // Forgetting inflates P along dP/dt while the pressure sits still; cap
+  // at the priors so the next pressure change isn't met with a huge gain
+  s->cov[0] = fminf((p00 - px0 * px0 / denom) / FORGETTING, PRIOR_COMPLIANCE_VAR);
+  s->cov[1] = (p01 - px0 * px1 / denom) / FORGETTING;
+  s->cov[2] = fminf((p11 - px1 * px1 / denom) / FORGETTING, PRIOR_CONDUCTANCE_VAR);
+  float maxCross = sqrtf(s->cov[0] * s->cov[2]);
+  s->cov[1] = constrain(s->cov[1], -maxCross, maxCross);
+}
+
+// Pump flow (ml/s) at full click rate as a function of pressure, linear
+// interpolation in the table
+static float tableLookup(const float* table, float pressure) {
+  float idx = pressure / FPC_TABLE_STEP_BAR;
+  if (idx <= 0.0f) {
+    return table[0];
+  }
+  int i = (int)idx;
+  if (i >= FPC_TABLE_SIZE - 1) {
+    return table[FPC_TABLE_SIZE - 1];
+  }
+  float f = idx - i;
+  return table[i] + f * (table[i + 1] - table[i]);
+}
+
+float mpcPumpPct(MpcState* s, float pressure, const float* goals, float maxPct) {
+  // The pump curve is evaluated 3500 times per solve: tabulate it once
+  float fullFlow[FPC_TABLE_SIZE];
+  float maxClicks = (float)getMaxPumpClicksPerSecond();
+  for (int i = 0; i < FPC_TABLE_SIZE; i++) {
+    fullFlow[i] = maxClicks * fmaxf(getPumpFlowPerClick(i * FPC_TABLE_STEP_BAR), 0.0f);
+  }
+
+  const float dtOverC = MPC_STEP_S / s->compliance;
+  const float conductance = s->conductance;
+  maxPct = constrain(maxPct, 0.0f, 1.0f);
+
+  float bestCost = INFINITY;
+  float bestPct = s->lastPct;
+  for (int a = 0; a < MPC_LEVELS; a++) {
+    float u1 = fminf((float)a / (MPC_LEVELS - 1), maxPct);
+    float firstMove = u1 - s->lastPct;
+    float baseCost = MPC_MOVE_WEIGHT * firstMove * firstMove;
+    if (baseCost >= bestCost) {
+      continue;
+    }
+    for (int b = 0; b < MPC_LEVELS; b++) {
+      float u2 = fminf((float)b / (MPC_LEVELS - 1), maxPct);
+      float secondMove = u2 - u1;
+      float cost = baseCost + MPC_MOVE_WEIGHT * secondMove * secondMove;
+
+      float p = pressure;
+      for (int k = 0; k < MPC_HORIZON_STEPS && cost < bestCost; k++) {
+        float u = k < MPC_BLOCK_STEPS ? u1 : u2;
+        p += dtOverC * (u * tableLookup(fullFlow, p) - conductance * p);
+        if (p < 0.0f) {
+          p = 0.0f;
+        }
+        float err = p - goals[k];
+        cost += err > 0.0f ? MPC_OVERSHOOT_WEIGHT * err * err : err * err;
+      }
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestPct = u1;
+      }
+    }
+  }
+
+  s->lastPct = bestPct;
+  return bestPct;
+}
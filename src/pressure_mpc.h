@@ -0,0 +1,81 @@
+#ifndef PRESSURE_MPC_H
+#define PRESSURE_MPC_H
+
+// ============================================================================
+// MODEL-PREDICTIVE PRESSURE CONTROL
+// ============================================================================
+// Third pressure control law next to the PID (pid_controller.cpp) and the
+// gaggiuino feedforward (pump_model.cpp). Every MPC_PERIOD_MS it simulates
+// the group over the next MPC_HORIZON_STEPS * MPC_STEP_S seconds for a grid
+// of candidate click-rate schedules and applies the first move of the
+// cheapest one. The model:
+//
+//   C * dP/dt = pct * maxClicks/s * fpc(P)  -  G * P
+//               (pump, pump_model.cpp)        (puck, Darcy: linear in P)
+//
+// C is the hydraulic compliance of the pressurized volume (ml/bar: trapped
+// air, hoses, boiler) and G the puck conductance (ml/s per bar). Both are
+// identified online by recursive least squares from the measured pump flow,
+// pressure and dP/dt: C is a property of the machine and carries over from
+// shot to shot, G is reset at each shot start and tracks the puck as it
+// erodes - which is also what removes steady-state offset.
+//
+// Candidates: two moves (move blocking), the first held for
+// MPC_BLOCK_STEPS steps and the second for the rest, each from
+// MPC_LEVELS click-rate levels: 17 x 17 = 289 schedules per solve. The
+// horizon previews the pressure profile, so goal changes are anticipated.
+// Cost: squared pressure error (overshoot weighted MPC_OVERSHOOT_WEIGHT
+// times, since a vibratory pump cannot pull pressure down) plus a penalty
+// on each move.
+//
+// The state lives in an MpcState so the live controller and the offline
+// benchmark (pressureControlBenchmark in pressure_control.h) don't share
+// anything.
+
+#include <Arduino.h>
+
+// Model step and horizon: 1.2 s of look-ahead, longer than the pressure
+// rise's dominant time constant on a typical puck
+#define MPC_STEP_S 0.1f
+#define MPC_HORIZON_STEPS 12
+
+// Re-solve cadence; the control task holds the last output in between
+#define MPC_PERIOD_MS 50
+
+#define MPC_LEVELS 17
+#define MPC_BLOCK_STEPS 3
+
+#define MPC_OVERSHOOT_WEIGHT 4.0f
+#define MPC_MOVE_WEIGHT 4.0f  // bar^2 per unit^2 of click-rate fraction change
+
+// Identification priors and plausibility bounds
+#define MPC_DEFAULT_COMPLIANCE_ML_PER_BAR 3.0f
+#define MPC_DEFAULT_CONDUCTANCE 0.2f   // ml/s per bar (2 ml/s at 10 bar)
+#define MPC_MIN_COMPLIANCE 0.5f
+#define MPC_MAX_COMPLIANCE 20.0f
+#define MPC_MAX_CONDUCTANCE 5.0f
+
+struct MpcState {
+  float compliance;   // C, ml/bar
+  float conductance;  // G, ml/s per bar
+  float cov[3];       // RLS P matrix [C, G], upper triangle: pCC, pCG, pGG
+  float lastPct;      // Output applied last (move penalty reference)
+};
+
+// Fresh state with the default model (at boot)
+void mpcInit(MpcState* s);
+
+// Shot start: forget the puck (conductance and its uncertainty), keep the
+// machine's identified compliance
+void mpcShotStart(MpcState* s);
+
+// One identification sample (10 Hz is plenty): measured pump flow (ml/s),
+// pressure (bar) and its rate of change (bar/s)
+void mpcIdentify(MpcState* s, float pumpFlow, float pressure, float pressureChangeSpeed);
+
+// Solve for the click-rate fraction (0..1) to apply now. goals holds the
+// target pressure at each of the next MPC_HORIZON_STEPS steps (profile
+// preview). maxPct caps the output (flow-restricted profiles; 1 = none).
+float mpcPumpPct(MpcState* s, float pressure, const float* goals, float maxPct);
+
+#endif // PRESSURE_MPC_H
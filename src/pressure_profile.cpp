@@ -0,0 +1,581 @@
+#include "pressure_profile.h"
+
+// Guards the goal arrays in shot: held while the web server swaps a profile
+// in and while the control task evaluates it (a few hundred instructions at
+// most)
+static portMUX_TYPE profileMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Indexed by GoalCurve
+#define GOAL_CURVE_COUNT 3
+static const char* const CURVE_NAMES[GOAL_CURVE_COUNT] = { "hold", "linear", "ease" };
+
+// Error messages stay static strings, built from the limits they quote
+#define STRINGIFY_VALUE(x) STRINGIFY(x)
+#define STRINGIFY(x) #x
+
+// ============================================================================
+// TOKENIZING (in place, no allocation)
+// ============================================================================
+
+static const char* skipSpaces(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+    p++;
+  }
+  return p;
+}
+
+// Parse one number at *p (surrounding blanks allowed) and advance past it.
+// strtof accepts inf/nan spellings; those are rejected as non-finite.
+static bool parseNumber(const char** p, float* out) {
+  const char* start = skipSpaces(*p);
+  char* end;
+  float v = strtof(start, &end);
+  if (end == start || !isfinite(v)) {
+    return false;
+  }
+  *out = v;
+  *p = skipSpaces(end);
+  return true;
+}
+
+// Comma-separated numbers, e.g. "0, 5,20,-5"
+static const char* parseCsvList(const char* s, float* vals, int* count) {
+  *count = 0;
+  const char* p = s;
+  for (;;) {
+    if (*count >= PROFILE_MAX_ENTRIES) {
+      return "too many goals";
+    }
+    if (!parseNumber(&p, &vals[*count])) {
+      return "invalid number";
+    }
+    (*count)++;
+    if (*p == '\0') {
+      return nullptr;
+    }
+    if (*p++ != ',') {
+      return "invalid number";
+    }
+  }
+}
+
+// JSON array of numbers at *p, e.g. [0, 5, 20, -5]
+static const char* parseJsonArray(const char** p, float* vals, int* count) {
+  *count = 0;
+  const char* q = skipSpaces(*p);
+  if (*q++ != '[') {
+    return "expected array";
+  }
+  q = skipSpaces(q);
+  if (*q == ']') {
+    *p = q + 1;
+    return nullptr;
+  }
+  for (;;) {
+    if (*count >= PROFILE_MAX_ENTRIES) {
+      return "too many goals";
+    }
+    if (!parseNumber(&q, &vals[*count])) {
+      return "invalid number";
+    }
+    (*count)++;
+    if (*q == ']') {
+      *p = q + 1;
+      return nullptr;
+    }
+    if (*q++ != ',') {
+      return "expected , or ]";
+    }
+  }
+}
+
+// Curve name of len chars at name
+static bool parseCurveName(const char* name, size_t len, uint8_t* out) {
+  for (int c = 0; c < GOAL_CURVE_COUNT; c++) {
+    if (strlen(CURVE_NAMES[c]) == len && strncmp(name, CURVE_NAMES[c], len) == 0) {
+      *out = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Comma-separated curve names, e.g. "hold, ease,linear"
+static const char* parseCsvCurves(const char* s, uint8_t* vals, int* count) {
+  *count = 0;
+  const char* p = s;
+  for (;;) {
+    if (*count >= PROFILE_MAX_ENTRIES) {
+      return "too many goals";
+    }
+    p = skipSpaces(p);
+    const char* name = p;
+    while (*p && *p != ',' && *p != ' ') {
+      p++;
+    }
+    if (!parseCurveName(name, p - name, &vals[*count])) {
+      return "curve must be hold, linear or ease";
+    }
+    (*count)++;
+    p = skipSpaces(p);
+    if (*p == '\0') {
+      return nullptr;
+    }
+    if (*p++ != ',') {
+      return "curve must be hold, linear or ease";
+    }
+  }
+}
+
+// JSON array of curve names at *p, e.g. ["hold", "ease"]
+static const char* parseJsonCurves(const char** p, uint8_t* vals, int* count) {
+  *count = 0;
+  const char* q = skipSpaces(*p);
+  if (*q++ != '[') {
+    return "expected array";
+  }
+  q = skipSpaces(q);
+  if (*q == ']') {
+    *p = q + 1;
+    return nullptr;
+  }
+  for (;;) {
+    if (*count >= PROFILE_MAX_ENTRIES) {
+      return "too many goals";
+    }
+    if (*q++ != '"') {
+      return "expected string";
+    }
+    const char* name = q;
+    while (*q && *q != '"') {
+      q++;
+    }
+    if (*q != '"' || !parseCurveName(name, q - name, &vals[*count])) {
+      return "curve must be hold, linear or ease";
+    }
+    (*count)++;
+    q = skipSpaces(q + 1);
+    if (*q == ']') {
+      *p = q + 1;
+      return nullptr;
+    }
+    if (*q++ != ',') {
+      return "expected , or ]";
+    }
+    q = skipSpaces(q);
+  }
+}
+
+// ============================================================================
+// BUILD + VALIDATE
+// ============================================================================
+
+// Split a signed-time list into by-time / by-time-left goals and validate.
+// flows/maxFlows/ramps/curves may be nullptr (all zero / hold). Curves are
+// raw GoalCurve values, checked by profileValidate().
+static const char* buildProfile(const float* times, const float* pressures,
+                                const float* flows, const float* maxFlows,
+                                const float* ramps, const uint8_t* curves, int n,
+                                PressureProfile* out) {
+  out->numByTime = 0;
+  out->numByTimeLeft = 0;
+  memset(out->flowByTime, 0, sizeof(out->flowByTime));
+  memset(out->flowByTimeLeft, 0, sizeof(out->flowByTimeLeft));
+  memset(out->transitionByTime, 0, sizeof(out->transitionByTime));
+  memset(out->transitionByTimeLeft, 0, sizeof(out->transitionByTimeLeft));
+  for (int i = 0; i < n; i++) {
+    GoalFlow flow = { flows ? flows[i] : 0.0f, maxFlows ? maxFlows[i] : 0.0f };
+    GoalTransition transition = {
+      ramps ? ramps[i] : 0.0f, curves ? (GoalCurve)curves[i] : GoalCurve::HOLD
+    };
+    if (times[i] < 0) {
+      if (out->numByTimeLeft >= MAX_PRESSURE_GOALS) {
+        return "too many by-time-left goals";
+      }
+      out->flowByTimeLeft[out->numByTimeLeft] = flow;
+      out->transitionByTimeLeft[out->numByTimeLeft] = transition;
+      out->byTimeLeft[out->numByTimeLeft++] = { -times[i], pressures[i] };
+    } else {
+      if (out->numByTime >= MAX_PRESSURE_GOALS) {
+        return "too many by-time goals";
+      }
+      out->flowByTime[out->numByTime] = flow;
+      out->transitionByTime[out->numByTime] = transition;
+      out->byTime[out->numByTime++] = { times[i], pressures[i] };
+    }
+  }
+  return profileValidate(*out);
+}
+
+static bool validPressure(float p) {
+  return isfinite(p) && p >= 0.0f && p <= PROFILE_MAX_PRESSURE_BAR;
+}
+
+static const char* validateFlow(const GoalFlow& f) {
+  if (!isfinite(f.targetFlow) || f.targetFlow < 0.0f || f.targetFlow > PROFILE_MAX_FLOW_ML_S
+      || !isfinite(f.maxFlow) || f.maxFlow < 0.0f || f.maxFlow > PROFILE_MAX_FLOW_ML_S) {
+    return "goal flow out of range";
+  }
+  if (f.targetFlow > 0.0f && f.maxFlow > 0.0f) {
+    return "a goal has either a flow target or a flow cap";
+  }
+  return nullptr;
+}
+
+static const char* validateTransition(const GoalTransition& t) {
+  if ((uint8_t)t.curve >= GOAL_CURVE_COUNT) {
+    return "curve must be hold, linear or ease";
+  }
+  if (!isfinite(t.rampS) || t.rampS < 0.0f || t.rampS > MAX_SHOT_DURATION_S) {
+    return "ramp out of range";
+  }
+  if (t.curve == GoalCurve::HOLD && t.rampS > 0.0f) {
+    return "a hold goal takes no ramp";
+  }
+  return nullptr;
+}
+
+const char* profileValidate(const PressureProfile& p) {
+  if (p.numByTime < 1 || p.numByTime > MAX_PRESSURE_GOALS) {
+    return "need 1 to " STRINGIFY_VALUE(MAX_PRESSURE_GOALS) " by-time goals";
+  }
+  if (p.numByTimeLeft < 0 || p.numByTimeLeft > MAX_PRESSURE_GOALS) {
+    return "too many by-time-left goals";
+  }
+  for (int i = 0; i < p.numByTime; i++) {
+    const PressureGoalByTime& g = p.byTime[i];
+    if (!isfinite(g.timeS) || g.timeS < 0 || g.timeS > MAX_SHOT_DURATION_S) {
+      return "goal time out of range";
+    }
+    if (i > 0 && g.timeS <= p.byTime[i - 1].timeS) {
+      return "goal times must be strictly increasing";
+    }
+    if (!validPressure(g.pressure)) {
+      return "goal pressure out of range";
+    }
+    const char* err = validateFlow(p.flowByTime[i]);
+    if (!err) {
+      err = validateTransition(p.transitionByTime[i]);
+    }
+    if (err) {
+      return err;
+    }
+  }
+  for (int i = 0; i < p.numByTimeLeft; i++) {
+    const PressureGoalByTimeLeft& g = p.byTimeLeft[i];
+    if (!isfinite(g.timeLeftS) || g.timeLeftS <= 0 || g.timeLeftS > MAX_SHOT_DURATION_S) {
+      return "time-left out of range";
+    }
+    if (i > 0 && g.timeLeftS >= p.byTimeLeft[i - 1].timeLeftS) {
+      return "negative times must be strictly increasing";
+    }
+    if (!validPressure(g.pressure)) {
+      return "goal pressure out of range";
+    }
+    const char* err = validateFlow(p.flowByTimeLeft[i]);
+    if (!err) {
+      err = validateTransition(p.transitionByTimeLeft[i]);
+    }
+    if (err) {
+      return err;
+    }
+  }
+  return nullptr;
+}
+
+// ============================================================================
+// PARSERS
+// ============================================================================
+
+const char* profileParseCsv(const char* times, const char* pressures,
+                            const char* flows, const char* maxFlows,
+                            const char* ramps, const char* curves, PressureProfile* out) {
+  float t[PROFILE_MAX_ENTRIES];
+  float p[PROFILE_MAX_ENTRIES];
+  float f[PROFILE_MAX_ENTRIES];
+  float m[PROFILE_MAX_ENTRIES];
+  float r[PROFILE_MAX_ENTRIES];
+  uint8_t c[PROFILE_MAX_ENTRIES];
+  int nt, np, nf = -1, nm = -1, nr = -1, nc = -1;
+  const char* err = parseCsvList(times, t, &nt);
+  if (!err) {
+    err = parseCsvList(pressures, p, &np);
+  }
+  if (!err && flows) {
+    err = parseCsvList(flows, f, &nf);
+  }
+  if (!err && maxFlows) {
+    err = parseCsvList(maxFlows, m, &nm);
+  }
+  if (!err && ramps) {
+    err = parseCsvList(ramps, r, &nr);
+  }
+  if (!err && curves) {
+    err = parseCsvCurves(curves, c, &nc);
+  }
+  if (err) {
+    return err;
+  }
+  if (nt != np || (flows && nf != nt) || (maxFlows && nm != nt)
+      || (ramps && nr != nt) || (curves && nc != nt)) {
+    return "profile lists differ in length";
+  }
+  return buildProfile(t, p, flows ? f : nullptr, maxFlows ? m : nullptr,
+                      ramps ? r : nullptr, curves ? c : nullptr, nt, out);
+}
+
+// Strict fixed-schema reader: one object with the "times" and "pressures"
+// arrays and optionally "flows", "maxFlows", "ramps" and "curves"; no string
+// escapes, unknown keys rejected
+const char* profileParseJson(const char* json, PressureProfile* out) {
+  float t[PROFILE_MAX_ENTRIES];
+  float p[PROFILE_MAX_ENTRIES];
+  float f[PROFILE_MAX_ENTRIES];
+  float m[PROFILE_MAX_ENTRIES];
+  float r[PROFILE_MAX_ENTRIES];
+  uint8_t c[PROFILE_MAX_ENTRIES];
+  int nt = -1, np = -1, nf = -1, nm = -1, nr = -1, nc = -1;
+
+  const char* q = skipSpaces(json);
+  if (*q++ != '{') {
+    return "expected object";
+  }
+  for (;;) {
+    q = skipSpaces(q);
+    if (*q++ != '"') {
+      return "expected key";
+    }
+    const char* key = q;
+    while (*q && *q != '"') {
+      q++;
+    }
+    size_t keyLen = q - key;
+    if (*q++ != '"') {
+      return "unterminated key";
+    }
+    q = skipSpaces(q);
+    if (*q++ != ':') {
+      return "expected :";
+    }
+
+    const char* err;
+    if (keyLen == 5 && strncmp(key, "times", 5) == 0) {
+      err = parseJsonArray(&q, t, &nt);
+    } else if (keyLen == 9 && strncmp(key, "pressures", 9) == 0) {
+      err = parseJsonArray(&q, p, &np);
+    } else if (keyLen == 5 && strncmp(key, "flows", 5) == 0) {
+      err = parseJsonArray(&q, f, &nf);
+    } else if (keyLen == 8 && strncmp(key, "maxFlows", 8) == 0) {
+      err = parseJsonArray(&q, m, &nm);
+    } else if (keyLen == 5 && strncmp(key, "ramps", 5) == 0) {
+      err = parseJsonArray(&q, r, &nr);
+    } else if (keyLen == 6 && strncmp(key, "curves", 6) == 0) {
+      err = parseJsonCurves(&q, c, &nc);
+    } else {
+      err = "unknown key";
+    }
+    if (err) {
+      return err;
+    }
+
+    q = skipSpaces(q);
+    if (*q == ',') {
+      q++;
+      continue;
+    }
+    if (*q++ != '}') {
+      return "expected , or }";
+    }
+    break;
+  }
+  if (*skipSpaces(q) != '\0') {
+    return "trailing data";
+  }
+  if (nt < 0 || np < 0) {
+    return "need times and pressures";
+  }
+  if (nt != np || (nf >= 0 && nf != nt) || (nm >= 0 && nm != nt)
+      || (nr >= 0 && nr != nt) || (nc >= 0 && nc != nt)) {
+    return "profile lists differ in length";
+  }
+  return buildProfile(t, p, nf >= 0 ? f : nullptr, nm >= 0 ? m : nullptr,
+                      nr >= 0 ? r : nullptr, nc >= 0 ? c : nullptr, nt, out);
+}
+
+const char* profileParseBinary(const uint8_t* data, size_t len, PressureProfile* out) {
+  if (len < 3 || data[0] != PROFILE_BINARY_MAGIC) {
+    return "not a binary profile";
+  }
+  if (data[1] < PROFILE_BINARY_VERSION || data[1] > PROFILE_BINARY_VERSION_RAMP) {
+    return "unsupported binary profile version";
+  }
+  bool withFlow = data[1] >= PROFILE_BINARY_VERSION_FLOW;
+  bool withRamp = data[1] >= PROFILE_BINARY_VERSION_RAMP;
+  int n = data[2];
+  if (n > PROFILE_MAX_ENTRIES) {
+    return "too many goals";
+  }
+  size_t entrySize = withRamp ? 11 : withFlow ? 8 : 4;
+  if (len != 3 + entrySize * (size_t)n) {
+    return "binary profile length mismatch";
+  }
+
+  float t[PROFILE_MAX_ENTRIES];
+  float p[PROFILE_MAX_ENTRIES];
+  float f[PROFILE_MAX_ENTRIES];
+  float m[PROFILE_MAX_ENTRIES];
+  float r[PROFILE_MAX_ENTRIES];
+  uint8_t c[PROFILE_MAX_ENTRIES];
+  const uint8_t* e = data + 3;
+  for (int i = 0; i < n; i++, e += entrySize) {
+    int16_t timeDs = (int16_t)(e[0] | (e[1] << 8));
+    uint16_t pressureCbar = (uint16_t)(e[2] | (e[3] << 8));
+    t[i] = timeDs / 10.0f;
+    p[i] = pressureCbar / 100.0f;
+    if (withFlow) {
+      f[i] = (uint16_t)(e[4] | (e[5] << 8)) / 100.0f;
+      m[i] = (uint16_t)(e[6] | (e[7] << 8)) / 100.0f;
+    }
+    if (withRamp) {
+      r[i] = (uint16_t)(e[8] | (e[9] << 8)) / 100.0f;
+      c[i] = e[10];
+    }
+  }
+  return buildProfile(t, p, withFlow ? f : nullptr, withFlow ? m : nullptr,
+                      withRamp ? r : nullptr, withRamp ? c : nullptr, n, out);
+}
+
+static uint8_t* putUint16(uint8_t* e, uint16_t v) {
+  e[0] = v & 0xFF;
+  e[1] = v >> 8;
+  return e + 2;
+}
+
+static uint8_t* encodeEntry(uint8_t* e, float timeS, float pressure,
+                            const GoalFlow& flow, const GoalTransition& transition) {
+  e = putUint16(e, (uint16_t)(int16_t)lroundf(timeS * 10.0f));
+  e = putUint16(e, (uint16_t)lroundf(pressure * 100.0f));
+  e = putUint16(e, (uint16_t)lroundf(flow.targetFlow * 100.0f));
+  e = putUint16(e, (uint16_t)lroundf(flow.maxFlow * 100.0f));
+  e = putUint16(e, (uint16_t)lroundf(transition.rampS * 100.0f));
+  *e++ = (uint8_t)transition.curve;
+  return e;
+}
+
+size_t profileEncodeBinary(const PressureProfile& p, uint8_t* out) {
+  out[0] = PROFILE_BINARY_MAGIC;
+  out[1] = PROFILE_BINARY_VERSION_RAMP;
+  out[2] = p.numByTime + p.numByTimeLeft;
+  uint8_t* e = out + 3;
+  for (int i = 0; i < p.numByTime; i++) {
+    e = encodeEntry(e, p.byTime[i].timeS, p.byTime[i].pressure,
+                    p.flowByTime[i], p.transitionByTime[i]);
+  }
+  for (int i = 0; i < p.numByTimeLeft; i++) {
+    e = encodeEntry(e, -p.byTimeLeft[i].timeLeftS, p.byTimeLeft[i].pressure,
+                    p.flowByTimeLeft[i], p.transitionByTimeLeft[i]);
+  }
+  return e - out;
+}
+
+// ============================================================================
+// LIVE PROFILE
+// ============================================================================
+
+void profileApply(const PressureProfile& p) {
+  portENTER_CRITICAL(&profileMux);
+  memcpy(shot.pressureGoalByTime, p.byTime, sizeof(p.byTime));
+  memcpy(shot.pressureGoalByTimeLeft, p.byTimeLeft, sizeof(p.byTimeLeft));
+  memcpy(shot.flowGoalByTime, p.flowByTime, sizeof(p.flowByTime));
+  memcpy(shot.flowGoalByTimeLeft, p.flowByTimeLeft, sizeof(p.flowByTimeLeft));
+  memcpy(shot.transitionByTime, p.transitionByTime, sizeof(p.transitionByTime));
+  memcpy(shot.transitionByTimeLeft, p.transitionByTimeLeft, sizeof(p.transitionByTimeLeft));
+  shot.numPressureGoalsByTime = p.numByTime;
+  shot.numPressureGoalsByTimeLeft = p.numByTimeLeft;
+  portEXIT_CRITICAL(&profileMux);
+}
+
+void profileSnapshot(PressureProfile* out) {
+  portENTER_CRITICAL(&profileMux);
+  memcpy(out->byTime, shot.pressureGoalByTime, sizeof(out->byTime));
+  memcpy(out->byTimeLeft, shot.pressureGoalByTimeLeft, sizeof(out->byTimeLeft));
+  memcpy(out->flowByTime, shot.flowGoalByTime, sizeof(out->flowByTime));
+  memcpy(out->flowByTimeLeft, shot.flowGoalByTimeLeft, sizeof(out->flowByTimeLeft));
+  memcpy(out->transitionByTime, shot.transitionByTime, sizeof(out->transitionByTime));
+  memcpy(out->transitionByTimeLeft, shot.transitionByTimeLeft, sizeof(out->transitionByTimeLeft));
+  out->numByTime = shot.numPressureGoalsByTime;
+  out->numByTimeLeft = shot.numPressureGoalsByTimeLeft;
+  portEXIT_CRITICAL(&profileMux);
+}
+
+// Fraction of a goal's transition done elapsedS after its time
+static float transitionFraction(const GoalTransition& t, float elapsedS) {
+  if (t.curve == GoalCurve::HOLD || t.rampS <= 0.0f || elapsedS >= t.rampS) {
+    return 1.0f;
+  }
+  float x = fmaxf(elapsedS, 0.0f) / t.rampS;
+  return t.curve == GoalCurve::EASE ? x * x * (3.0f - 2.0f * x) : x;
+}
+
+// Move v from the value in force before a goal towards the goal by fraction
+// x. Only a like-for-like quantity ramps (pressure between pressure goals,
+// flow target between flow goals); a change of kind steps.
+static void blendGoal(ProfileGoal* v, float pressure, const GoalFlow& flow, float x) {
+  v->endPressure = pressure;
+  bool isFlow = flow.targetFlow > 0.0f;
+  if (isFlow != (v->targetFlow > 0.0f)) {
+    x = 1.0f;
+  }
+  if (isFlow) {
+    v->targetFlow += x * (flow.targetFlow - v->targetFlow);
+    v->pressure = pressure;
+  } else {
+    v->pressure += x * (pressure - v->pressure);
+    v->targetFlow = 0.0f;
+  }
+  v->maxFlow = flow.maxFlow;
+}
+
+// By-time chain at t: each goal reached ramps from where the one before had
+// got to when it took over (0 bar before the first)
+static void byTimeGoal(const Shot* s, float t, ProfileGoal* v) {
+  *v = {};
+  int n = s->numPressureGoalsByTime;
+  for (int i = 0; i < n && t >= s->pressureGoalByTime[i].timeS; i++) {
+    bool superseded = i + 1 < n && t >= s->pressureGoalByTime[i + 1].timeS;
+    float until = superseded ? s->pressureGoalByTime[i + 1].timeS : t;
+    blendGoal(v, s->pressureGoalByTime[i].pressure, s->flowGoalByTime[i],
+              transitionFraction(s->transitionByTime[i], until - s->pressureGoalByTime[i].timeS));
+  }
+}
+
+void profileGoal(const Shot* s, float shotTimer, float timeLeft, ProfileGoal* out) {
+  portENTER_CRITICAL(&profileMux);
+  // By-time-left goals apply from the front of the list (time left strictly
+  // decreasing); the first takes over from the by-time chain as it stood
+  // then, each later one from its predecessor
+  int n = s->numPressureGoalsByTimeLeft;
+  if (n == 0 || timeLeft > s->pressureGoalByTimeLeft[0].timeLeftS) {
+    byTimeGoal(s, shotTimer, out);
+  } else {
+    const PressureGoalByTimeLeft* g = s->pressureGoalByTimeLeft;
+    byTimeGoal(s, shotTimer - (g[0].timeLeftS - timeLeft), out);
+    for (int i = 0; i < n && timeLeft <= g[i].timeLeftS; i++) {
+      bool superseded = i + 1 < n && timeLeft <= g[i + 1].timeLeftS;
+      float elapsed = g[i].timeLeftS - (superseded ? g[i + 1].timeLeftS : timeLeft);
+      blendGoal(out, g[i].pressure, s->flowGoalByTimeLeft[i],
+                transitionFraction(s->transitionByTimeLeft[i], elapsed));
+    }
+  }
+  portEXIT_CRITICAL(&profileMux);
+}
+
+float profileGoalPressure(const Shot* s, float shotTimer, float timeLeft) {
+  ProfileGoal goal;
+  profileGoal(s, shotTimer, timeLeft, &goal);
+  return goal.pressure;
+}
+
+const char* goalCurveName(GoalCurve curve) {
+  return (uint8_t)curve < GOAL_CURVE_COUNT ? CURVE_NAMES[(uint8_t)curve] : "unknown";
+}
@@ -0,0 +1,119 @@
+#ifndef PRESSURE_PROFILE_H
+#define PRESSURE_PROFILE_H
+
+// ============================================================================
+// PRESSURE PROFILE - PARSING, VALIDATION AND ATOMIC SWAP
+// ============================================================================
+// The live profile is the pair of goal arrays in Shot (shot_stopper.h). Web
+// input is parsed into a PressureProfile on the stack - no String splitting,
+// no heap - validated as a whole and only then swapped into Shot under a
+// spinlock, so the control task never evaluates a half-written profile.
+//
+// Input forms, all sharing the /state convention (positive time = seconds
+// from shot start, negative time = seconds left until the expected end):
+//   - CSV:    times=0,5,20,-5 & pressures=2,9,6,4 (GET /set_pressure_profile)
+//   - JSON:   {"times":[0,5,20,-5],"pressures":[2,9,6,4]}
+//   - Binary: 'P', version 1, entry count, then per entry int16 LE time in
+//             0.1 s and uint16 LE pressure in 0.01 bar (4 bytes each)
+//
+// Flow (GoalFlow in shot_stopper.h) rides along as two optional lists of the
+// same length: "flows" (flow target in ml/s, 0 = pressure goal) and
+// "maxFlows" (flow cap for pressure goals, 0 = none) - extra CSV parameters
+// or JSON keys. Binary version 2 appends uint16 LE flow and max flow in
+// 0.01 ml/s to every entry (8 bytes each).
+//
+// Transitions (GoalTransition in shot_stopper.h) likewise: "curves" (hold,
+// linear or ease; CSV names or JSON strings) and "ramps" (seconds, 0 for
+// hold). Binary version 3 appends uint16 LE ramp in 0.01 s and a uint8
+// curve (0 hold, 1 linear, 2 ease) to the version 2 entry (11 bytes each).
+// Without them every goal is a hold, i.e. a step as in older firmware.
+//
+// Validation: every number finite, pressures within 0..PROFILE_MAX_PRESSURE_BAR,
+// flows within 0..PROFILE_MAX_FLOW_ML_S and never both set on one goal,
+// ramps within 0..MAX_SHOT_DURATION_S and only on linear/eased goals,
+// at most MAX_PRESSURE_GOALS goals of each kind, at least one by-time goal,
+// by-time goals strictly increasing and within MAX_SHOT_DURATION_S,
+// by-time-left goals strictly increasing in the signed notation (i.e. the
+// time left strictly decreasing, so a later override wins).
+
+#include <Arduino.h>
+
+#include "shot_stopper.h"
+
+// Upper bound for any profile goal (the OPV limits the machine to ~12 bar)
+#define PROFILE_MAX_PRESSURE_BAR 12.0f
+
+// Upper bound for flow goals: about what the pump moves at full rate
+// against a low pressure
+#define PROFILE_MAX_FLOW_ML_S 10.0f
+
+// Largest accepted POST body (JSON with 16 goals, both flow lists, curves
+// and ramps fits comfortably)
+#define PROFILE_BODY_MAX 1536
+
+#define PROFILE_BINARY_MAGIC 'P'
+#define PROFILE_BINARY_VERSION 1            // Pressure only
+#define PROFILE_BINARY_VERSION_FLOW 2       // With flow and max flow
+#define PROFILE_BINARY_VERSION_RAMP 3       // ... and ramp and curve
+
+// Goals of both kinds, as they arrive in one input list
+#define PROFILE_MAX_ENTRIES (2 * MAX_PRESSURE_GOALS)
+
+// Largest binary profile: header plus version 3 entries
+#define PROFILE_BINARY_MAX_LEN (3 + 11 * PROFILE_MAX_ENTRIES)
+
+struct PressureProfile {
+  PressureGoalByTime byTime[MAX_PRESSURE_GOALS];
+  int numByTime;
+  PressureGoalByTimeLeft byTimeLeft[MAX_PRESSURE_GOALS];
+  int numByTimeLeft;
+  GoalFlow flowByTime[MAX_PRESSURE_GOALS];
+  GoalFlow flowByTimeLeft[MAX_PRESSURE_GOALS];
+  GoalTransition transitionByTime[MAX_PRESSURE_GOALS];
+  GoalTransition transitionByTimeLeft[MAX_PRESSURE_GOALS];
+};
+
+// The goal in force at one instant
+struct ProfileGoal {
+  float pressure;     // Target, or the limit for a flow goal (0 = none)
+  float targetFlow;   // ml/s, > 0 for a flow goal
+  float maxFlow;      // ml/s cap for a pressure goal, 0 = none
+  float endPressure;  // Pressure once the goal's ramp is done
+};
+
+// Parsers: return nullptr on success, else a static error message (for the
+// HTTP 400 body). out is only meaningful on success; inputs are NUL-terminated
+// except for the binary form. The optional CSV lists may be nullptr (all
+// zero / hold).
+const char* profileParseCsv(const char* times, const char* pressures,
+                            const char* flows, const char* maxFlows,
+                            const char* ramps, const char* curves, PressureProfile* out);
+const char* profileParseJson(const char* json, PressureProfile* out);
+const char* profileParseBinary(const uint8_t* data, size_t len, PressureProfile* out);
+
+// Encode a profile in binary version 3 into out (PROFILE_BINARY_MAX_LEN
+// bytes); returns the length. Fixed-point: times round to 0.1 s, pressures,
+// flows and ramps to 0.01 - decode it again to get what would run.
+size_t profileEncodeBinary(const PressureProfile& p, uint8_t* out);
+
+// Check an already-built profile (e.g. one loaded from EEPROM)
+const char* profileValidate(const PressureProfile& p);
+
+// Swap a validated profile into the live shot / copy the live one out,
+// both atomic with respect to profileGoal()
+void profileApply(const PressureProfile& p);
+void profileSnapshot(PressureProfile* out);
+
+// Goal at shotTimer: latest by-time goal reached, overridden by any
+// by-time-left goal that applies to timeLeft, each partway along its
+// transition from the value before it. Called by the control task every
+// iteration, so the setpoint moves smoothly at the control rate.
+void profileGoal(const Shot* s, float shotTimer, float timeLeft, ProfileGoal* out);
+
+// Just the pressure side of profileGoal() (MPC horizon preview)
+float profileGoalPressure(const Shot* s, float shotTimer, float timeLeft);
+
+// "hold", "linear", "ease"
+const char* goalCurveName(GoalCurve curve);
+
+#endif // PRESSURE_PROFILE_H
@@ -0,0 +1,240 @@
+#include "profile_library.h"
+
+#include "debug.h"
+
+// Guards everything below (web server mutates, control task and
+// settingsSave read). Taken before profileMux when a profile is applied,
+// never the other way round.
+static portMUX_TYPE libraryMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Decoded profiles, ready to be copied into the live shot
+static PressureProfile profiles[PROFILE_LIBRARY_SLOTS];
+static char names[PROFILE_LIBRARY_SLOTS][PROFILE_NAME_MAX];
+static int count = 0;
+
+static int activeSlot = -1;            // Profile in force, -1 = custom
+static volatile int pendingSlot = -1;  // Selected, not yet applied
+
+// ============================================================================
+// HELPERS (callers hold libraryMux where noted)
+// ============================================================================
+
+static bool validName(const char* name) {
+  size_t len = strlen(name);
+  if (len == 0 || len >= PROFILE_NAME_MAX) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = name[i];
+    if (!isalnum((unsigned char)c) && c != ' ' && c != '_' && c != '.' && c != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// libraryMux held
+static int findSlot(const char* name) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Encode, decode again and validate: the profile exactly as the table
+// stores it, or an error if p does not survive the fixed-point round trip
+static const char* compileProfile(const PressureProfile& p, PressureProfile* out) {
+  uint8_t table[PROFILE_BINARY_MAX_LEN];
+  size_t len = profileEncodeBinary(p, table);
+  const char* err = profileParseBinary(table, len, out);
+  if (err) {
+    return err;
+  }
+  // A by-time-left goal within 0.05 s of the end rounds to time 0, i.e.
+  // into a by-time goal
+  if (out->numByTime != p.numByTime || out->numByTimeLeft != p.numByTimeLeft) {
+    return "goal times too close to 0 for the 0.1 s table resolution";
+  }
+  return nullptr;
+}
+
+// ============================================================================
+// PERSISTENCE
+// ============================================================================
+
+void profileLibraryInit(const ProfileLibraryStore* stored, const char* activeName) {
+  count = 0;
+  activeSlot = -1;
+  pendingSlot = -1;
+  int storedCount = stored ? min((int)stored->count, PROFILE_LIBRARY_SLOTS) : 0;
+  for (int i = 0; i < storedCount; i++) {
+    const StoredProfile& sp = stored->profiles[i];
+    char name[PROFILE_NAME_MAX];
+    strlcpy(name, sp.name, sizeof(name));
+    const char* err = !validName(name) ? "invalid name"
+        : sp.tableLen > PROFILE_BINARY_MAX_LEN ? "table too long"
+        : profileParseBinary(sp.table, sp.tableLen, &profiles[count]);
+    if (err) {
+      DEBUG_STARTUP_PRINT("Stored profile %d dropped (%s)", i, err);
+      continue;
+    }
+    strlcpy(names[count], name, PROFILE_NAME_MAX);
+    count++;
+  }
+
+  // Tasks aren't running yet: apply the active profile directly, so the
+  // live shot runs exactly the decoded table
+  int slot = activeName ? findSlot(activeName) : -1;
+  if (slot >= 0) {
+    profileApply(profiles[slot]);
+    activeSlot = slot;
+  }
+  DEBUG_STARTUP_PRINT("Profile library: %d profiles, active '%s'",
+                      count, slot >= 0 ? names[slot] : "(custom)");
+}
+
+void profileLibrarySnapshot(ProfileLibraryStore* out, char* activeName) {
+  memset(out, 0, sizeof(*out));
+  portENTER_CRITICAL(&libraryMux);
+  out->count = count;
+  for (int i = 0; i < count; i++) {
+    StoredProfile& sp = out->profiles[i];
+    strlcpy(sp.name, names[i], PROFILE_NAME_MAX);
+    sp.tableLen = profileEncodeBinary(profiles[i], sp.table);
+  }
+  int selected = pendingSlot >= 0 ? pendingSlot : activeSlot;
+  strlcpy(activeName, selected >= 0 ? names[selected] : "", PROFILE_NAME_MAX);
+  portEXIT_CRITICAL(&libraryMux);
+}
+
+// ============================================================================
+// EDITING AND SELECTION (web server)
+// ============================================================================
+
+const char* profileLibrarySave(const char* name, const PressureProfile& p) {
+  if (!validName(name)) {
+    return "name must be 1-23 letters, digits, spaces or _ . -";
+  }
+  PressureProfile compiled;
+  const char* err = compileProfile(p, &compiled);
+  if (err) {
+    return err;
+  }
+
+  portENTER_CRITICAL(&libraryMux);
+  int slot = findSlot(name);
+  if (slot < 0 && count < PROFILE_LIBRARY_SLOTS) {
+    slot = count++;
+    strlcpy(names[slot], name, PROFILE_NAME_MAX);
+  }
+  if (slot >= 0) {
+    profiles[slot] = compiled;
+    pendingSlot = slot;
+  }
+  portEXIT_CRITICAL(&libraryMux);
+
+  if (slot < 0) {
+    return "profile library full - delete one first";
+  }
+  DEBUG_SHOT_PRINT("Profile '%s' saved to the library (%d by-time, %d by-time-left goals)",
+                   name, compiled.numByTime, compiled.numByTimeLeft);
+  return nullptr;
+}
+
+bool profileLibraryDelete(const char* name) {
+  portENTER_CRITICAL(&libraryMux);
+  int slot = findSlot(name);
+  if (slot >= 0) {
+    // Close the gap; slot references past it move down with their profiles
+    for (int i = slot; i + 1 < count; i++) {
+      profiles[i] = profiles[i + 1];
+      memcpy(names[i], names[i + 1], PROFILE_NAME_MAX);
+    }
+    count--;
+    if (activeSlot == slot) {
+      activeSlot = -1;
+    } else if (activeSlot > slot) {
+      activeSlot--;
+    }
+    if (pendingSlot == slot) {
+      pendingSlot = -1;
+    } else if (pendingSlot > slot) {
+      pendingSlot--;
+    }
+  }
+  portEXIT_CRITICAL(&libraryMux);
+  return slot >= 0;
+}
+
+bool profileLibrarySelect(const char* name) {
+  portENTER_CRITICAL(&libraryMux);
+  int slot = findSlot(name);
+  if (slot >= 0) {
+    pendingSlot = slot;
+  }
+  portEXIT_CRITICAL(&libraryMux);
+  return slot >= 0;
+}
+
+void profileLibraryApplyCustom(const PressureProfile& p) {
+  portENTER_CRITICAL(&libraryMux);
+  profileApply(p);
+  activeSlot = -1;
+  pendingSlot = -1;
+  portEXIT_CRITICAL(&libraryMux);
+}
+
+// ============================================================================
+// SWITCHING (control task)
+// ============================================================================
+
+bool profileLibraryUpdate() {
+  if (pendingSlot < 0) {
+    return false;  // Nothing selected: no lock taken on the common path
+  }
+  portENTER_CRITICAL(&libraryMux);
+  int slot = pendingSlot;
+  if (slot >= 0) {
+    profileApply(profiles[slot]);
+    activeSlot = slot;
+    pendingSlot = -1;
+  }
+  portEXIT_CRITICAL(&libraryMux);
+  if (slot >= 0) {
+    DEBUG_SHOT_PRINT("Switched to library profile %d", slot);
+  }
+  return slot >= 0;
+}
+
+// ============================================================================
+// LISTING
+// ============================================================================
+
+int profileLibraryCount() {
+  return count;
+}
+
+bool profileLibraryName(int slot, char* out) {
+  portENTER_CRITICAL(&libraryMux);
+  bool ok = slot >= 0 && slot < count;
+  if (ok) {
+    strlcpy(out, names[slot], PROFILE_NAME_MAX);
+  }
+  portEXIT_CRITICAL(&libraryMux);
+  return ok;
+}
+
+void profileLibraryActiveName(char* out) {
+  portENTER_CRITICAL(&libraryMux);
+  strlcpy(out, activeSlot >= 0 ? names[activeSlot] : "", PROFILE_NAME_MAX);
+  portEXIT_CRITICAL(&libraryMux);
+}
+
+void profileLibrarySelectedName(char* out) {
+  portENTER_CRITICAL(&libraryMux);
+  int selected = pendingSlot >= 0 ? pendingSlot : activeSlot;
+  strlcpy(out, selected >= 0 ? names[selected] : "", PROFILE_NAME_MAX);
+  portEXIT_CRITICAL(&libraryMux);
+}
@@ -0,0 +1,83 @@
+#ifndef PROFILE_LIBRARY_H
+#define PROFILE_LIBRARY_H
+
+// ============================================================================
+// PROFILE LIBRARY - NAMED PROFILES, COMPILED ON SAVE
+// ============================================================================
+// Up to PROFILE_LIBRARY_SLOTS named profiles persisted in the settings blob.
+// Saving one compiles it once into the binary version 3 table
+// (pressure_profile.h: 11 bytes per goal, fixed point), decodes that table
+// again and validates the result - so what is stored, listed and run is
+// exactly what the quantized table says, and a profile that does not
+// survive the round trip is refused at save time rather than at boot.
+// The decoded profiles stay in RAM: switching is a copy, never a parse.
+//
+// Selecting a profile (dashboard, /select_profile, the Gaggiuino-dialect
+// /api/profile-select/{id}) only marks it pending; the control task swaps it
+// into the live shot with profileLibraryUpdate() while idle or at the very
+// start of a shot, so a selection never lands mid-shot. Editing the live
+// profile directly (/set_pressure_profile, POST /api/pressure_profile
+// without a name) leaves it unnamed ("custom") until saved under a name.
+//
+// The library is mutated by the web server and read by the control task and
+// settingsSave(); all of it is spinlock-protected.
+
+#include <Arduino.h>
+
+#include "pressure_profile.h"
+
+#define PROFILE_LIBRARY_SLOTS 8
+
+// Name length including the NUL; names are 1..23 of [A-Za-z0-9 _.-] (they
+// go into JSON, URLs and the dashboard's HTML unescaped)
+#define PROFILE_NAME_MAX 24
+
+// One compiled profile as persisted (embedded in PersistentSettings)
+struct StoredProfile {
+  char name[PROFILE_NAME_MAX];
+  uint8_t tableLen;                        // Bytes used in table
+  uint8_t table[PROFILE_BINARY_MAX_LEN];  // Binary version 3 profile
+};
+
+struct ProfileLibraryStore {
+  uint8_t count;
+  StoredProfile profiles[PROFILE_LIBRARY_SLOTS];
+};
+
+// Load the stored library (nullptr = start empty), dropping entries that no
+// longer decode or validate, and select activeName if it is one of them.
+// Call once at boot (settingsLoad does), before the control task starts.
+void profileLibraryInit(const ProfileLibraryStore* stored, const char* activeName);
+
+// Re-encode the library and the name to persist as active (the pending
+// selection if any, "" = custom) for settingsSave
+void profileLibrarySnapshot(ProfileLibraryStore* out, char* activeName);
+
+// Compile and store p under name (replacing a profile of the same name) and
+// select it. Returns nullptr on success, else a static error message.
+const char* profileLibrarySave(const char* name, const PressureProfile& p);
+
+// False if there is no profile of that name. Deleting the active profile
+// leaves it running, unnamed.
+bool profileLibraryDelete(const char* name);
+
+// Mark a stored profile for the control task to switch to; false if unknown
+bool profileLibrarySelect(const char* name);
+
+// Apply a profile that is not from the library (direct web edits): swaps it
+// in at once and drops any pending selection, so the edit is what runs
+void profileLibraryApplyCustom(const PressureProfile& p);
+
+// Control task only, while idle or at shot start: swap a pending selection
+// into the live shot. True if one was applied.
+bool profileLibraryUpdate();
+
+// Listing for the web server: slot count, name of one slot (false if out of
+// range), the profile in force ("" = custom) and the one selected for the
+// next shot (pending if any, else the active one)
+int profileLibraryCount();
+bool profileLibraryName(int slot, char* out);
+void profileLibraryActiveName(char* out);
+void profileLibrarySelectedName(char* out);
+
+#endif // PROFILE_LIBRARY_H
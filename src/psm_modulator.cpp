@@ -0,0 +1,50 @@
+#include "psm_modulator.h"
+
+#include "pump_model.h"
+
+// Settling cycles before scoring, so start-up transients of the state
+// (empty accumulator, zero error history) don't count against a modulator
+static const int WARMUP_CYCLES = 100;
+
+const char* psmModulatorName(PsmModulator m) {
+  switch (m) {
+    case PsmModulator::SECOND_ORDER: return "second_order";
+    case PsmModulator::DITHERED:     return "dithered";
+    default:                         return "first_order";
+  }
+}
+
+bool psmModulatorFromName(const char* name, PsmModulator* out) {
+  for (int i = 0; i < PSM_MODULATOR_COUNT; i++) {
+    PsmModulator m = (PsmModulator)i;
+    if (strcmp(name, psmModulatorName(m)) == 0) {
+      *out = m;
+      return true;
+    }
+  }
+  return false;
+}
+
+float psmLowFrequencyError(PsmModulator m, uint8_t level, int cycles) {
+  PsmModulatorState state;
+  psmModulatorReset(&state);
+
+  // Two cascaded one-pole low-passes at PSM_LF_CUTOFF_HZ, sampled once per
+  // mains cycle (one decision per cycle: the maximum click rate)
+  const float alpha = 1.0f - expf(-2.0f * (float)M_PI * PSM_LF_CUTOFF_HZ
+                                  / getMaxPumpClicksPerSecond());
+  const float target = level / (float)PSM_RANGE;
+  float lp1 = 0.0f;
+  float lp2 = 0.0f;
+  double sumSquares = 0.0;
+
+  for (int i = 0; i < WARMUP_CYCLES + cycles; i++) {
+    float error = (psmModulatorStep(m, &state, level) ? 1.0f : 0.0f) - target;
+    lp1 += alpha * (error - lp1);
+    lp2 += alpha * (lp1 - lp2);
+    if (i >= WARMUP_CYCLES) {
+      sumSquares += (double)lp2 * lp2;
+    }
+  }
+  return cycles > 0 ? 100.0f * sqrtf((float)(sumSquares / cycles)) : 0.0f;
+}
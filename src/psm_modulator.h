@@ -0,0 +1,127 @@
+#ifndef PSM_MODULATOR_H
+#define PSM_MODULATOR_H
+
+// ============================================================================
+// PSM MODULATORS - WHICH MAINS CYCLES TO CONDUCT
+// ============================================================================
+// Pulse-skip modulation turns a 0-255 pump level into a 1-bit stream, one
+// decision per mains cycle (fire = one pump stroke). The order of fired and
+// skipped cycles is free as long as the average matches the level, and it
+// matters: the pump/headspace system low-passes the click stream, so any
+// error energy at low frequencies shows up as pressure beating that the
+// controller has to fight. Three modulators, same 0-255 input:
+//
+//   FIRST_ORDER   Bresenham accumulator (first-order sigma-delta). Even
+//                 spacing, but at many levels a long periodic pattern whose
+//                 fundamental sits at a few Hz or below.
+//   SECOND_ORDER  Second-order sigma-delta (noise transfer (1 - z^-1)^2),
+//                 meant to push the quantization error towards 25 Hz.
+//   DITHERED      First-order with a pseudo-random threshold, breaking up
+//                 limit cycles into broadband noise at the same average.
+//
+// Measured (psmLowFrequencyError, levels 1-254): FIRST_ORDER is the
+// smoothest, SECOND_ORDER about 10 % worse on average, DITHERED worse
+// still. One decision per mains cycle against a 2 Hz band is an
+// oversampling ratio of ~12, too low for noise shaping to win over evenly
+// spaced clicks. FIRST_ORDER is the default and the recommended choice;
+// the others stay selectable for A/B on real shots.
+//
+// The step functions are inline, allocation-free and IRAM-placed (no
+// switch, so no jump table in flash) so the IRAM zero-cross ISR
+// (pump_dimmer.cpp) can call them while the flash cache is off.
+// psmLowFrequencyError() simulates a modulator offline and scores it
+// (GET /psm_analysis runs a level sweep for all three; the native test
+// suite test_psm_modulator checks the ranking above).
+
+#include <Arduino.h>
+
+enum class PsmModulator : uint8_t { FIRST_ORDER, SECOND_ORDER, DITHERED };
+
+#define PSM_MODULATOR_COUNT 3
+
+// Full-scale input: level 255 fires every cycle
+#define PSM_RANGE 255
+
+// Wind-up guard for the SECOND_ORDER integrators
+#define PSM_SECOND_ORDER_LIMIT (1L << 20)
+
+// Dither amplitude for DITHERED, peak-to-peak in level units
+#define PSM_DITHER_SPAN 128
+
+// Corner frequency of the scoring low-pass (two cascaded one-pole sections
+// at the mains-cycle decision rate): error energy below this is what the
+// pump and headspace turn into pressure ripple
+#define PSM_LF_CUTOFF_HZ 2.0f
+
+struct PsmModulatorState {
+  int32_t acc;      // FIRST_ORDER / DITHERED accumulator
+  int32_t int1;     // SECOND_ORDER: first error integrator, x2
+  int32_t int2;     // SECOND_ORDER: second error integrator, x4 (quantized)
+  int32_t lastOut;  // SECOND_ORDER: previous output, 0 or PSM_RANGE
+  uint32_t lfsr;    // DITHERED: xorshift32 state, never 0
+};
+
+static inline IRAM_ATTR void psmModulatorReset(PsmModulatorState* s) {
+  s->acc = 0;
+  s->int1 = 0;
+  s->int2 = 0;
+  s->lastOut = 0;
+  s->lfsr = 0x2545F491u;
+}
+
+// One mains-cycle decision: true = conduct this cycle (one pump stroke)
+static inline IRAM_ATTR bool psmModulatorStep(PsmModulator m, PsmModulatorState* s,
+                                              uint8_t level) {
+  // The extremes need no modulation and must not wind up any state
+  if (level == 0) {
+    return false;
+  }
+  if (level >= PSM_RANGE) {
+    return true;
+  }
+
+  if (m == PsmModulator::SECOND_ORDER) {
+    // Two cascaded integrators of the error (CIFB loop), quantized on the
+    // second: y = u + (1 - z^-1)^2 e. Both integrator gains are 1/2 so the
+    // 1-bit quantizer isn't overloaded at the extremes; kept exact in
+    // integers by scaling the states by 2 and 4 instead. The clamp only
+    // guards against wind-up.
+    s->int1 += level - s->lastOut;
+    s->int2 += s->int1 - 2 * s->lastOut;
+    s->int2 = constrain(s->int2, -PSM_SECOND_ORDER_LIMIT, PSM_SECOND_ORDER_LIMIT);
+    s->lastOut = s->int2 >= 2 * PSM_RANGE ? PSM_RANGE : 0;
+    return s->lastOut != 0;
+  }
+
+  int32_t dither = 0;
+  if (m == PsmModulator::DITHERED) {
+    // xorshift32: cheap, ISR-safe pseudo-random threshold offset
+    uint32_t x = s->lfsr;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s->lfsr = x;
+    dither = (int32_t)(x % PSM_DITHER_SPAN) - PSM_DITHER_SPAN / 2;
+  }
+
+  // FIRST_ORDER (dither 0) and DITHERED
+  s->acc += level;
+  if (s->acc + dither >= PSM_RANGE) {
+    s->acc -= PSM_RANGE;
+    return true;
+  }
+  return false;
+}
+
+// Lowercase name ("first_order", ...) for the web API, and the reverse;
+// psmModulatorFromName returns false for unknown names
+const char* psmModulatorName(PsmModulator m);
+bool psmModulatorFromName(const char* name, PsmModulator* out);
+
+// Simulate `cycles` decisions at a constant level and return the RMS of the
+// low-passed click error (fired fraction minus level/255), in percent of the
+// full click rate. Lower = less low-frequency beating. Pure computation,
+// no hardware access.
+float psmLowFrequencyError(PsmModulator m, uint8_t level, int cycles);
+
+#endif // PSM_MODULATOR_H
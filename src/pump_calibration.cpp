@@ -0,0 +1,316 @@
+#include "pump_calibration.h"
+
+#include "debug.h"
+#include "pump_model.h"
+
+// Prior: one-sigma uncertainty of each gaggiuino-fitted coefficient
+// (~0.1 ml/click) and the expected per-window weight noise (~0.2 g: scale
+// resolution plus drips). P0 = prior variance / noise variance.
+static const float PRIOR_COEFF_VAR = 0.01f;
+static const float PRIOR_NOISE_VAR = 0.04f;
+
+// Residual variance EMA factor per window
+static const float RESIDUAL_ALPHA = 0.1f;
+
+// Pressure where the confidence is judged: the usual extraction plateau
+static const float CONFIDENCE_PRESSURE_BAR = 9.0f;
+
+// Regressor scaling: q = p / PRESSURE_SCALE_BAR
+static const float PRESSURE_SCALE_BAR = 10.0f;
+
+// Guards cal (control task writes; web server and settingsSave read)
+static portMUX_TYPE calMux = portMUX_INITIALIZER_UNLOCKED;
+static PumpCalibration cal = {};
+static volatile bool calActive = false;  // Confident enough to replace the model
+
+// Current window (control task only)
+static bool windowOpen = false;     // A shot is running
+static bool windowStarted = false;  // Start weight/time captured
+static float windowStartWeight = 0.0f;
+static float windowStartS = 0.0f;
+static float windowMaxDpdt = 0.0f;
+static float windowX[PUMP_CAL_COEFFS] = {};  // clicks, sum q, sum q^2
+static int shotUpdates = 0;
+
+// ============================================================================
+// MATRIX HELPERS (3x3 symmetric, stored full in RAM)
+// ============================================================================
+
+static void unpackCov(const float* packed, float P[3][3]) {
+  P[0][0] = packed[0]; P[0][1] = packed[1]; P[0][2] = packed[2];
+  P[1][1] = packed[3]; P[1][2] = packed[4]; P[2][2] = packed[5];
+  P[1][0] = P[0][1];   P[2][0] = P[0][2];   P[2][1] = P[1][2];
+}
+
+static void packCov(const float P[3][3], float* packed) {
+  packed[0] = P[0][0]; packed[1] = P[0][1]; packed[2] = P[0][2];
+  packed[3] = P[1][1]; packed[4] = P[1][2]; packed[5] = P[2][2];
+}
+
+// x' P x for a single-click regressor at pressure p
+static float quadraticForm(const float* packed, float p) {
+  float P[3][3];
+  unpackCov(packed, P);
+  float q = p / PRESSURE_SCALE_BAR;
+  float x[3] = { 1.0f, q, q * q };
+  float sum = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      sum += x[i] * P[i][j] * x[j];
+    }
+  }
+  return sum;
+}
+
+static float evalCurve(const float* coeff, float p) {
+  float q = p / PRESSURE_SCALE_BAR;
+  return coeff[0] + (coeff[1] + coeff[2] * q) * q;
+}
+
+// ============================================================================
+// PRIOR
+// ============================================================================
+
+// Least-squares quadratic through the gaggiuino curve over 0-12 bar
+static void setPrior(PumpCalibration* c) {
+  double A[3][3] = {};
+  double b[3] = {};
+  for (int i = 0; i <= 24; i++) {
+    float p = i * 0.5f;
+    float q = p / PRESSURE_SCALE_BAR;
+    double x[3] = { 1.0, q, (double)q * q };
+    double y = getPumpFlowPerClickModel(p);
+    for (int r = 0; r < 3; r++) {
+      b[r] += x[r] * y;
+      for (int k = 0; k < 3; k++) {
+        A[r][k] += x[r] * x[k];
+      }
+    }
+  }
+  // Cramer's rule; A is a well-conditioned Gram matrix of 25 points
+  double det = A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1])
+             - A[0][1] * (A[1][0] * A[2][2] - A[1][2] * A[2][0])
+             + A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]);
+  for (int col = 0; col < 3; col++) {
+    double M[3][3];
+    memcpy(M, A, sizeof(M));
+    for (int r = 0; r < 3; r++) {
+      M[r][col] = b[r];
+    }
+    double d = M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+             - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+             + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+    c->coeff[col] = (float)(d / det);
+  }
+
+  float P[3][3] = {};
+  for (int i = 0; i < 3; i++) {
+    P[i][i] = PRIOR_COEFF_VAR / PRIOR_NOISE_VAR;
+  }
+  packCov(P, c->cov);
+  c->residualVar = PRIOR_NOISE_VAR;
+  c->samples = 0;
+}
+
+static bool validState(const PumpCalibration& c) {
+  for (int i = 0; i < PUMP_CAL_COEFFS; i++) {
+    if (!isfinite(c.coeff[i])) {
+      return false;
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    if (!isfinite(c.cov[i])) {
+      return false;
+    }
+  }
+  return c.cov[0] > 0 && c.cov[3] > 0 && c.cov[5] > 0
+      && isfinite(c.residualVar) && c.residualVar > 0;
+}
+
+static float relStd(const PumpCalibration& c) {
+  float fpc = evalCurve(c.coeff, CONFIDENCE_PRESSURE_BAR);
+  if (fpc <= 0.0f) {
+    return INFINITY;
+  }
+  return sqrtf(quadraticForm(c.cov, CONFIDENCE_PRESSURE_BAR) * c.residualVar) / fpc;
+}
+
+// Publish a new state and re-judge whether it is good enough to use
+static void storeState(const PumpCalibration& c) {
+  bool active = c.samples >= PUMP_CAL_MIN_SAMPLES && relStd(c) < PUMP_CAL_MAX_REL_STD;
+  portENTER_CRITICAL(&calMux);
+  cal = c;
+  calActive = active;
+  portEXIT_CRITICAL(&calMux);
+}
+
+// ============================================================================
+// RLS UPDATE
+// ============================================================================
+
+// One window: regressors x (clicks, sum q, sum q^2), observed gain y (g)
+static void rlsUpdate(const float* x, float y) {
+  PumpCalibration c;
+  pumpCalibrationSnapshot(&c);
+
+  float P[3][3];
+  unpackCov(c.cov, P);
+  float Px[3];
+  for (int i = 0; i < 3; i++) {
+    Px[i] = P[i][0] * x[0] + P[i][1] * x[1] + P[i][2] * x[2];
+  }
+  float denom = PUMP_CAL_FORGETTING + x[0] * Px[0] + x[1] * Px[1] + x[2] * Px[2];
+  float predicted = c.coeff[0] * x[0] + c.coeff[1] * x[1] + c.coeff[2] * x[2];
+  float residual = y - predicted;
+
+  for (int i = 0; i < 3; i++) {
+    c.coeff[i] += Px[i] / denom * residual;
+  }
+  float trace = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      P[i][j] = (P[i][j] - Px[i] * Px[j] / denom) / PUMP_CAL_FORGETTING;
+    }
+    trace += P[i][i];
+  }
+  // Forgetting inflates P in directions the data never excite (e.g. every
+  // window at 9 bar pins c0 + 0.9 c1 + 0.81 c2 but not the three apart);
+  // cap it at the prior so a long plateau can't wind it up without bound
+  float maxTrace = 3.0f * PRIOR_COEFF_VAR / PRIOR_NOISE_VAR;
+  if (trace > maxTrace) {
+    float scale = maxTrace / trace;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        P[i][j] *= scale;
+      }
+    }
+  }
+  packCov(P, c.cov);
+
+  // Window noise is mostly scale resolution and drips, not per click, so
+  // track it per window; the a-posteriori residual excludes the part of
+  // the error the update just explained
+  float posterior = residual * PUMP_CAL_FORGETTING / denom;
+  c.residualVar += RESIDUAL_ALPHA * (posterior * posterior - c.residualVar);
+  if (c.samples < UINT16_MAX) {
+    c.samples++;
+  }
+
+  if (!validState(c)) {
+    return;  // Numerical trouble: keep the previous state
+  }
+  storeState(c);
+  shotUpdates++;
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void pumpCalibrationInit(const PumpCalibration* stored) {
+  PumpCalibration c;
+  if (stored && validState(*stored)) {
+    c = *stored;
+  } else {
+    setPrior(&c);
+  }
+  storeState(c);
+}
+
+void pumpCalibrationReset() {
+  pumpCalibrationInit(nullptr);
+  DEBUG_PUMP_PRINT("Pump calibration reset to the model curve");
+}
+
+void pumpCalibrationSnapshot(PumpCalibration* out) {
+  portENTER_CRITICAL(&calMux);
+  *out = cal;
+  portEXIT_CRITICAL(&calMux);
+}
+
+void pumpCalibrationShotStart() {
+  windowOpen = true;
+  windowStarted = false;
+  shotUpdates = 0;
+}
+
+bool pumpCalibrationShotEnd() {
+  windowOpen = false;
+  windowStarted = false;
+  if (shotUpdates > 0) {
+    DEBUG_PUMP_PRINT("Pump calibration: %d windows this shot, fpc(9 bar) %.3f ml, rel. std %.1f %%",
+                     shotUpdates, evalCurve(cal.coeff, CONFIDENCE_PRESSURE_BAR),
+                     pumpCalibrationRelStd() * 100.0f);
+  }
+  return shotUpdates > 0;
+}
+
+void pumpCalibrationAddClick(float pressureBar) {
+  if (!windowStarted) {
+    return;
+  }
+  float q = pressureBar / PRESSURE_SCALE_BAR;
+  windowX[0] += 1.0f;
+  windowX[1] += q;
+  windowX[2] += q * q;
+}
+
+void pumpCalibrationAddWeight(float weightG, float pressureChangeSpeed, float nowS) {
+  if (!windowOpen) {
+    return;
+  }
+  if (windowStarted) {
+    windowMaxDpdt = fmaxf(windowMaxDpdt, fabsf(pressureChangeSpeed));
+    if (nowS - windowStartS < PUMP_CAL_WINDOW_S) {
+      return;
+    }
+    float gain = weightG - windowStartWeight;
+    if (windowMaxDpdt <= PUMP_CAL_MAX_DPDT
+        && windowX[0] >= PUMP_CAL_MIN_CLICKS
+        && gain > 0.0f) {
+      rlsUpdate(windowX, gain);
+    }
+  }
+
+  // Start the next window here (or keep waiting for the cup to fill)
+  windowStarted = weightG >= PUMP_CAL_MIN_CUP_G;
+  windowStartWeight = weightG;
+  windowStartS = nowS;
+  windowMaxDpdt = fabsf(pressureChangeSpeed);
+  windowX[0] = windowX[1] = windowX[2] = 0.0f;
+}
+
+float pumpCalibrationRelStd() {
+  PumpCalibration c;
+  pumpCalibrationSnapshot(&c);
+  return relStd(c);
+}
+
+float pumpCalibrationConfidence() {
+  PumpCalibration c;
+  pumpCalibrationSnapshot(&c);
+  if (c.samples < PUMP_CAL_MIN_SAMPLES) {
+    return 0.0f;
+  }
+  return constrain(1.0f - relStd(c) / PUMP_CAL_MAX_REL_STD, 0.0f, 1.0f);
+}
+
+int pumpCalibrationSamples() {
+  PumpCalibration c;
+  pumpCalibrationSnapshot(&c);
+  return c.samples;
+}
+
+bool pumpCalibrationFlowPerClick(float pressureBar, float* out) {
+  if (!calActive) {
+    return false;
+  }
+  PumpCalibration c;
+  pumpCalibrationSnapshot(&c);
+  float fpc = evalCurve(c.coeff, pressureBar);
+  if (fpc <= 0.0f) {
+    return false;
+  }
+  *out = fpc;
+  return true;
+}
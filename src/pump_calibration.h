@@ -0,0 +1,88 @@
+#ifndef PUMP_CALIBRATION_H
+#define PUMP_CALIBRATION_H
+
+// ============================================================================
+// ONLINE PUMP CALIBRATION - LEARNED FLOW-PER-CLICK CURVE
+// ============================================================================
+// The fixed gaggiuino curve in pump_model.cpp was fitted to someone else's
+// pump. This module fits our own one during real shots: once the cup is
+// filling and the pressure is steady, water pushed by the pump ends up in
+// the cup, so over a window of about a second
+//
+//   cup weight gain (g ~ ml) = sum over strokes of fpc(p at that stroke)
+//
+// With a quadratic fpc(p) = c0 + c1 q + c2 q^2 (q = p / 10 bar, keeps the
+// regressors well scaled) that is linear in the coefficients with
+// regressors [clicks, sum q, sum q^2], and recursive least squares with
+// exponential forgetting tracks it shot by shot (pump wear, scale change).
+// The prior is the gaggiuino curve itself, so the estimate starts there and
+// only moves as far as the data justify.
+//
+// getPumpFlowPerClick() switches to the learned curve once it is confident:
+// enough windows and a predicted one-sigma error at 9 bar below
+// PUMP_CAL_MAX_REL_STD. The state persists in the settings blob.
+//
+// All updates run in the control task; the learned curve and its
+// confidence are also read by the web server (spinlock-protected).
+
+#include <Arduino.h>
+
+// Forgetting factor per window (~1 s): an effective memory of ~50 windows,
+// i.e. the last two or three shots dominate
+#define PUMP_CAL_FORGETTING 0.98f
+
+// Window length and admission rules: the cup must already be filling (the
+// puck is saturated) and the pressure steady (no water going into headspace
+// compression or coming out of it)
+#define PUMP_CAL_WINDOW_S 1.0f
+#define PUMP_CAL_MIN_CUP_G 3.0f
+#define PUMP_CAL_MAX_DPDT 0.5f     // bar/s, largest |dP/dt| within a window
+#define PUMP_CAL_MIN_CLICKS 10     // per window, so the pump was really pumping
+
+// Use the learned curve after this many windows, and only while its
+// predicted relative error at 9 bar stays below PUMP_CAL_MAX_REL_STD
+#define PUMP_CAL_MIN_SAMPLES 20
+#define PUMP_CAL_MAX_REL_STD 0.1f
+
+#define PUMP_CAL_COEFFS 3
+
+// Persisted RLS state (embedded in PersistentSettings)
+struct PumpCalibration {
+  float coeff[PUMP_CAL_COEFFS];  // c0, c1, c2 in ml/click, q = p / 10 bar
+  float cov[6];                  // RLS P matrix, upper triangle row-major
+  float residualVar;             // EMA of the squared window residual (g^2)
+  uint16_t samples;              // Windows fitted (saturates)
+};
+
+// Load a stored state, or start from the gaggiuino prior if stored is null
+// or fails validation. Call once at boot (settingsLoad does).
+void pumpCalibrationInit(const PumpCalibration* stored);
+
+// Forget everything learned and restart from the prior
+void pumpCalibrationReset();
+
+// Copy the current state (for settingsSave)
+void pumpCalibrationSnapshot(PumpCalibration* out);
+
+// Shot hooks, control task only. pumpCalibrationShotEnd returns true when
+// the shot taught the model something worth persisting.
+void pumpCalibrationShotStart();
+bool pumpCalibrationShotEnd();
+
+// Feed one pump stroke at its pressure, and every scale weight packet
+// (weight in g, current dP/dt in bar/s, packet time in s)
+void pumpCalibrationAddClick(float pressureBar);
+void pumpCalibrationAddWeight(float weightG, float pressureChangeSpeed, float nowS);
+
+// Learned volume per click at the given pressure; false (out untouched)
+// while the fit is not confident or predicts a non-positive volume
+bool pumpCalibrationFlowPerClick(float pressureBar, float* out);
+
+// Confidence summary: relative one-sigma error of the learned fpc at 9 bar
+// and a 0..1 score (1 = error negligible, 0 = at or beyond the threshold or
+// not enough windows yet)
+float pumpCalibrationRelStd();
+float pumpCalibrationConfidence();
+int pumpCalibrationSamples();
+
+#endif // PUMP_CALIBRATION_H
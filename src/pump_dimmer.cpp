@@ -1,23 +1,53 @@
 #include "pump_dimmer.h"
 
+#include <driver/gpio.h>
+#include <driver/timer.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
 #include "debug.h"
 
 // ============================================================================
-// TIMING CONSTANTS (50 Hz mains)
+// TIMING CONSTANTS
 // ============================================================================
 
-// One half-cycle, zero cross to zero cross: 10 ms at 50 Hz
-static const uint32_t HALF_CYCLE_US = 10000;
+// Half-cycle assumed until the PLL has locked: 10 ms, 50 Hz mains
+static const uint32_t DEFAULT_HALF_CYCLE_US = 1000000 / (2 * PUMP_DEFAULT_MAINS_HZ);
+
+// Plausible half-cycles while acquiring: 60 Hz is 8333 us, 50 Hz 10000 us.
+// Measured intervals outside this range restart acquisition.
+static const uint32_t PLL_MIN_HALF_CYCLE_US = 7500;
+static const uint32_t PLL_MAX_HALF_CYCLE_US = 11000;
+
+// Half-cycles shorter than this are 60 Hz grids, longer ones 50 Hz
+static const uint32_t PLL_60HZ_BELOW_US = 9167;
+
+// Lock after this many consecutive intervals within 1/PLL_ACQUIRE_TOLERANCE
+// (~3 %) of their running mean
+static const uint8_t PLL_ACQUIRE_EDGES = 16;
+static const uint32_t PLL_ACQUIRE_TOLERANCE = 32;
 
-// Zero-cross detectors ring/bounce around the crossing; edges arriving
-// sooner than this after an accepted crossing are glitches, not crossings
+// While locked, only edges within this distance of the predicted crossing
+// count; detector ringing right after a crossing lands a whole half-cycle
+// early and is rejected. PLL_MAX_MISSES rejected edges in a row drop lock.
+static const int32_t PLL_CAPTURE_US = 1000;
+static const uint8_t PLL_MAX_MISSES = 8;
+
+// Loop gains as divisors of the phase error per crossing: the phase moves
+// 1/4 of the error, the period 1/64 of it (type-II loop, settles within a
+// few dozen crossings and averages ISR timestamp jitter)
+static const int32_t PLL_PHASE_GAIN_DIV = 4;
+static const int32_t PLL_PERIOD_GAIN_DIV = 64;
+
+// While acquiring, edges sooner than this after an accepted crossing are
+// detector ringing, not crossings (below both grids' half-cycle)
 static const uint32_t ZC_GLITCH_US = 4000;
 
 // Never fire the gate closer than this to a zero crossing. Too early and the
 // detector's pulse width blurs which half-cycle we are in; too late and the
 // triac has no time to latch before the current stops again.
 static const uint32_t MIN_FIRE_DELAY_US = 200;
-static const uint32_t MAX_FIRE_DELAY_US = HALF_CYCLE_US - 500;
+static const uint32_t FIRE_END_MARGIN_US = 500;
 
 // Levels at the extremes skip the timer entirely: >= FULL_ON_LEVEL holds the
 // gate high through the whole cycle, <= FULL_OFF_LEVEL never fires it
@@ -25,15 +55,38 @@ static const uint8_t FULL_ON_LEVEL = 250;
 static const uint8_t FULL_OFF_LEVEL = 2;
 
 // No crossing for this long means the sync signal is gone (10 missed
-// half-cycles) - fall back to plain on/off control
+// half-cycles at 50 Hz): PSM runs on synthetic crossings, phase-angle falls
+// back to plain on/off control
 static const uint32_t ZC_TIMEOUT_US = 100000;
 
+// Firing timer: group 0 / timer 0 at 80 MHz APB / 80 = 1 tick per microsecond
+#define FIRE_TIMER_GROUP TIMER_GROUP_0
+#define FIRE_TIMER_IDX TIMER_0
+static const uint32_t FIRE_TIMER_DIVIDER = 80;
+
+// Synthetic mains generator (PSM only): group 0 / timer 1, 1 us ticks. It
+// takes over once SYNTH_HOLDOFF_HALF_CYCLES pass without a detector edge,
+// i.e. after two missed crossings (single misses are the PLL's business).
+#define SYNTH_TIMER_GROUP TIMER_GROUP_0
+#define SYNTH_TIMER_IDX TIMER_1
+static const uint32_t SYNTH_HOLDOFF_HALF_CYCLES = 3;
+
+// Between firings the alarm is parked this far ahead (~71 min): the driver
+// re-enables the alarm after every callback, and an alarm value already in
+// the past would retrigger immediately
+static const uint64_t FIRE_TIMER_PARK_TICKS = 1ULL << 32;
+
 // ============================================================================
 // STATE
 // ============================================================================
 
 static int gatePin = -1;
-static hw_timer_t* fireTimer = nullptr;
+
+// Gate pin as a bit in the GPIO set/clear registers (pins 32+ live in the
+// OUT1 bank), precomputed so the ISRs write the gate with one store
+static volatile uint32_t gateSetReg = GPIO_OUT_W1TS_REG;
+static volatile uint32_t gateClearReg = GPIO_OUT_W1TC_REG;
+static uint32_t gateMask = 0;
 
 // Written by the control task, read by the zero-cross ISR (single byte, atomic)
 static volatile uint8_t powerLevel = 255;
@@ -41,36 +94,196 @@ static volatile uint8_t powerLevel = 255;
 // Timestamp of the last accepted zero crossing (glitch filter + health check)
 static volatile uint32_t lastZcUs = 0;
 
+// Zero-cross PLL (zero-cross ISR only, except the volatile reads). The
+// half-cycle period is Q8 fixed point (1/256 us) so the period loop can
+// integrate sub-microsecond errors; pllEdgeUs is the filtered instant of
+// the last crossing as the detector reports it.
+static volatile uint32_t pllPeriodQ8 = DEFAULT_HALF_CYCLE_US << 8;
+static uint32_t pllEdgeUs = 0;
+static volatile bool pllLocked = false;
+static volatile uint8_t pllMainsHz = PUMP_DEFAULT_MAINS_HZ;
+static uint32_t pllAcquirePeriodQ8 = 0;
+static uint8_t pllAcquireCount = 0;
+static uint8_t pllMissCount = 0;
+static volatile uint32_t pllPhaseErrorMaxUs = 0;  // Since the last read
+
+// Phase-angle: instant the armed firing timer should raise the gate (micros)
+// and whether it is armed at all (a parked alarm must not fire the triac)
+static volatile uint32_t fireTargetUs = 0;
+static volatile bool fireArmed = false;
+
+// Accepted crossings and edges rejected by the glitch filter (/metrics)
+static volatile uint32_t zcCount = 0;
+static volatile uint32_t zcGlitchCount = 0;
+
 #if PUMP_PSM_MODE
-// Bresenham accumulator: fire a cycle whenever it wraps past the full range,
-// so any level 0-255 spreads its fired cycles as evenly as possible
-static const uint16_t PSM_RANGE = 255;
-static volatile uint16_t psmAccumulator = 0;
+// Modulator selection (written by any task, read by the ISR) and its state
+// (ISR only). The ISR resets the state whenever the selection changes.
+static volatile PsmModulator psmModulator = PUMP_PSM_MODULATOR;
+static PsmModulator psmActiveModulator = PUMP_PSM_MODULATOR;
+static PsmModulatorState psmState = {};
 static volatile bool psmSecondHalf = false;   // Which half of the mains cycle
 static volatile uint32_t psmClickCount = 0;   // Conducted cycles = pump strokes
+
+// Stroke timestamps, indexed by click count. Single writer (the ISR): the
+// slot is stored before the count is published, and volatile accesses are
+// serialized (memw) on Xtensa, so a reader on the other core never sees a
+// published count ahead of its timestamp.
+static volatile uint32_t clickRing[PUMP_CLICK_RING_SIZE];
+
+// Synthetic generator: next alarm (timer ticks) and the crossing instant it
+// stands for (micros). Written by both ISRs, which share core 1 and
+// interrupt level 1, so they never preempt each other.
+static uint64_t synthAlarmTicks = 0;
+static uint32_t synthEdgeUs = 0;
+static bool synthFired = false;  // Since the last detector edge
+static volatile uint32_t zcSyntheticCount = 0;
+#endif
+
+#if PUMP_LATENCY_INSTRUMENTATION
+// Edge-to-gate latency histogram. Written by the ISRs (core 1), read and
+// max-reset by /metrics (core 0); the spinlock keeps the 64-bit sum whole.
+static DRAM_ATTR const uint32_t LATENCY_BUCKET_US[PUMP_LATENCY_BUCKETS - 1] = {
+  5, 10, 20, 50, 100, 200, 500, 1000, 2000
+};
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+static PumpLatencyStats latencyStats = {};
 #endif
 
 // ============================================================================
 // INTERRUPT HANDLERS
 // ============================================================================
+// Everything the ISRs touch is IRAM/DRAM-resident: the handlers themselves,
+// the GPIO and timer drivers' *_in_isr calls, micros(), the modulator step
+// and the data above. Both are registered with ESP_INTR_FLAG_IRAM, so they
+// keep running on time while flash is busy (EEPROM.commit, OTA) instead of
+// being deferred until the write finishes.
+
+static inline IRAM_ATTR void gateHigh() {
+  REG_WRITE(gateSetReg, gateMask);
+}
+
+static inline IRAM_ATTR void gateLow() {
+  REG_WRITE(gateClearReg, gateMask);
+}
+
+// Account one gate write that should have happened at targetUs
+static inline IRAM_ATTR void recordGateLatency(uint32_t targetUs) {
+#if PUMP_LATENCY_INSTRUMENTATION
+  int32_t late = (int32_t)(micros() - targetUs);
+  uint32_t latencyUs = late > 0 ? late : 0;
+  int bucket = 0;
+  while (bucket < PUMP_LATENCY_BUCKETS - 1 && latencyUs > LATENCY_BUCKET_US[bucket]) {
+    bucket++;
+  }
+  portENTER_CRITICAL_ISR(&latencyMux);
+  latencyStats.count++;
+  latencyStats.sumUs += latencyUs;
+  if (latencyUs > latencyStats.maxUs) {
+    latencyStats.maxUs = latencyUs;
+  }
+  latencyStats.buckets[bucket]++;
+  portEXIT_CRITICAL_ISR(&latencyMux);
+#else
+  (void)targetUs;
+#endif
+}
+
+// Start over: measure intervals until they agree, then lock
+static inline IRAM_ATTR void pllUnlock() {
+  pllLocked = false;
+  pllAcquireCount = 0;
+}
+
+// Acquisition: fixed glitch window, running mean of consistent intervals
+static inline IRAM_ATTR bool pllAcquire(uint32_t now) {
+  uint32_t intervalUs = now - lastZcUs;
+  if (intervalUs < ZC_GLITCH_US) {
+    return false;
+  }
+  pllEdgeUs = now;
+  if (intervalUs < PLL_MIN_HALF_CYCLE_US || intervalUs > PLL_MAX_HALF_CYCLE_US) {
+    pllAcquireCount = 0;  // First edge after a gap, or not mains at all
+    return true;
+  }
+
+  uint32_t intervalQ8 = intervalUs << 8;
+  int32_t deviation = (int32_t)(intervalQ8 - pllAcquirePeriodQ8);
+  if (pllAcquireCount > 0
+      && (uint32_t)abs(deviation) < pllAcquirePeriodQ8 / PLL_ACQUIRE_TOLERANCE) {
+    pllAcquireCount++;
+    pllAcquirePeriodQ8 += deviation / pllAcquireCount;
+  } else {
+    pllAcquireCount = 1;
+    pllAcquirePeriodQ8 = intervalQ8;
+  }
+
+  if (pllAcquireCount >= PLL_ACQUIRE_EDGES) {
+    pllPeriodQ8 = pllAcquirePeriodQ8;
+    pllMainsHz = (pllAcquirePeriodQ8 >> 8) < PLL_60HZ_BELOW_US ? 60 : 50;
+    pllMissCount = 0;
+    pllLocked = true;
+  }
+  return true;
+}
+
+// Feed one detector edge at `now` into the PLL. Returns false for edges
+// that are not crossings (glitches, ringing); on true, pllEdgeUs holds the
+// filtered instant of this crossing.
+static inline IRAM_ATTR bool pllTrack(uint32_t now) {
+  if (!pllLocked) {
+    return pllAcquire(now);
+  }
+  if (now - lastZcUs > ZC_TIMEOUT_US) {
+    pllUnlock();  // Sync was gone; the old phase means nothing now
+    return pllAcquire(now);
+  }
+
+  int32_t halfCycleUs = pllPeriodQ8 >> 8;
+  uint32_t predicted = pllEdgeUs + halfCycleUs;
+  int32_t error = (int32_t)(now - predicted);
+  while (error > halfCycleUs / 2) {
+    predicted += halfCycleUs;  // Skip crossings the detector missed
+    error -= halfCycleUs;
+  }
+  if (error < -PLL_CAPTURE_US || error > PLL_CAPTURE_US) {
+    if (++pllMissCount >= PLL_MAX_MISSES) {
+      pllUnlock();  // Lost the grid's phase (or it jumped): re-acquire
+    }
+    return false;
+  }
+  pllMissCount = 0;
+
+  pllEdgeUs = predicted + error / PLL_PHASE_GAIN_DIV;
+  uint32_t periodQ8 = pllPeriodQ8 + error * 256 / PLL_PERIOD_GAIN_DIV;
+  pllPeriodQ8 = constrain(periodQ8, PLL_MIN_HALF_CYCLE_US << 8, PLL_MAX_HALF_CYCLE_US << 8);
+
+  uint32_t absError = abs(error);
+  if (absError > pllPhaseErrorMaxUs) {
+    pllPhaseErrorMaxUs = absError;
+  }
+  return true;
+}
 
 // Firing-delay timer expired: turn the triac on. The gate stays high until
 // the next zero cross, so the triac keeps conducting even when the inductive
 // pump load makes the current lag the voltage.
-static void IRAM_ATTR onFireTimer() {
-  digitalWrite(gatePin, HIGH);
-}
-
-// Mains zero crossing: drop the gate and arm the one-shot firing timer.
-// Registered without the IRAM flag, so it is simply deferred during flash
-// writes (EEPROM.commit) instead of crashing on the flash-resident timer HAL.
-static void onZeroCross() {
-  uint32_t now = micros();
-  if (now - lastZcUs < ZC_GLITCH_US) {
-    return;  // Ringing on the detector edge, not a real crossing
+static bool IRAM_ATTR onFireTimer(void*) {
+  uint64_t ticks = timer_group_get_counter_value_in_isr(FIRE_TIMER_GROUP, FIRE_TIMER_IDX);
+  timer_group_set_alarm_value_in_isr(FIRE_TIMER_GROUP, FIRE_TIMER_IDX,
+                                     ticks + FIRE_TIMER_PARK_TICKS);
+  if (!fireArmed) {
+    return false;
   }
-  lastZcUs = now;
+  fireArmed = false;
+  gateHigh();
+  recordGateLatency(fireTargetUs);
+  return false;  // No task woken
+}
 
+// One mains crossing at edgeUs, measured or synthetic: the PSM decision,
+// or drop the gate and arm the phase-angle firing timer
+static inline IRAM_ATTR void onCrossing(uint32_t edgeUs, uint32_t halfCycleUs) {
 #if PUMP_PSM_MODE
   // The pump strokes once per full mains cycle (internal half-wave
   // rectification), so decide once per cycle and hold the gate through both
@@ -80,35 +293,111 @@ static void onZeroCross() {
     return;
   }
 
-  psmAccumulator += powerLevel;
-  if (psmAccumulator >= PSM_RANGE) {
-    psmAccumulator -= PSM_RANGE;
-    digitalWrite(gatePin, HIGH);  // Conduct this cycle: one pump stroke
-    psmClickCount++;
+  PsmModulator m = psmModulator;
+  if (m != psmActiveModulator) {
+    psmActiveModulator = m;
+    psmModulatorReset(&psmState);
+  }
+  if (psmModulatorStep(m, &psmState, powerLevel)) {
+    gateHigh();  // Conduct this cycle: one pump stroke
+    uint32_t clicks = psmClickCount;
+    clickRing[clicks & (PUMP_CLICK_RING_SIZE - 1)] = edgeUs;
+    psmClickCount = clicks + 1;
   } else {
-    digitalWrite(gatePin, LOW);   // Skip this cycle
+    gateLow();   // Skip this cycle
   }
+  recordGateLatency(edgeUs);
   return;
 #endif
 
   uint8_t level = powerLevel;
+  fireArmed = false;
   if (level >= FULL_ON_LEVEL) {
     // Full power: hold the gate high, triac conducts the entire half-cycle
-    digitalWrite(gatePin, HIGH);
+    gateHigh();
+    recordGateLatency(edgeUs);
     return;
   }
 
-  digitalWrite(gatePin, LOW);  // Triac commutates off at the zero crossing
+  gateLow();  // Triac commutates off at the zero crossing
   if (level <= FULL_OFF_LEVEL) {
     return;  // Pump off: never fire this half-cycle
   }
 
-  uint32_t delayUs = ((uint32_t)(255 - level) * HALF_CYCLE_US) / 255;
-  delayUs = constrain(delayUs, MIN_FIRE_DELAY_US, MAX_FIRE_DELAY_US);
+  uint32_t delayUs = ((uint32_t)(255 - level) * halfCycleUs) / 255;
+  delayUs = constrain(delayUs, MIN_FIRE_DELAY_US, halfCycleUs - FIRE_END_MARGIN_US);
+
+  // Schedule against the PLL's crossing, so neither ISR entry delay nor
+  // detector jitter shifts the firing angle; if that instant has already
+  // passed, fire right away
+  uint32_t targetUs = edgeUs + delayUs;
+  int32_t remainingUs = (int32_t)(targetUs - micros());
+  if (remainingUs < 1) {
+    remainingUs = 1;
+  }
+  fireTargetUs = targetUs;
+  fireArmed = true;
+  uint64_t ticks = timer_group_get_counter_value_in_isr(FIRE_TIMER_GROUP, FIRE_TIMER_IDX);
+  timer_group_set_alarm_value_in_isr(FIRE_TIMER_GROUP, FIRE_TIMER_IDX, ticks + remainingUs);
+  timer_group_enable_alarm_in_isr(FIRE_TIMER_GROUP, FIRE_TIMER_IDX);
+}
+
+#if PUMP_PSM_MODE
+// Hand the grid over to the synthetic generator: its next crossing follows
+// SYNTH_HOLDOFF_HALF_CYCLES after the detector edge at edgeUs (the real
+// ISR pushes it out again on every crossing, so it only ever fires once
+// the detector has gone quiet)
+static inline IRAM_ATTR void synthRearm(uint32_t edgeUs, uint32_t halfCycleUs) {
+  uint32_t firstUs = edgeUs + SYNTH_HOLDOFF_HALF_CYCLES * halfCycleUs;
+  int32_t remainingUs = (int32_t)(firstUs - micros());
+  if (remainingUs < 1) {
+    remainingUs = 1;
+  }
+  synthEdgeUs = firstUs - halfCycleUs;
+  synthAlarmTicks = timer_group_get_counter_value_in_isr(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX)
+                    + remainingUs;
+  timer_group_set_alarm_value_in_isr(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, synthAlarmTicks);
+  timer_group_enable_alarm_in_isr(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX);
+}
+
+// Synthetic crossing: continue the last measured grid, one half-cycle at a
+// time. Alarms advance from the previous alarm, not from ISR entry, so the
+// emulated mains doesn't drift by the interrupt latency.
+static bool IRAM_ATTR onSyntheticCrossing(void*) {
+  uint32_t halfCycleUs = pllPeriodQ8 >> 8;
+  synthAlarmTicks += halfCycleUs;
+  timer_group_set_alarm_value_in_isr(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, synthAlarmTicks);
+  synthEdgeUs += halfCycleUs;
+  synthFired = true;
+  zcSyntheticCount++;
+  onCrossing(synthEdgeUs, halfCycleUs);
+  return false;  // No task woken
+}
+#endif
 
-  timerRestart(fireTimer);
-  timerAlarmWrite(fireTimer, delayUs, false);  // One-shot
-  timerAlarmEnable(fireTimer);
+// Detector edge: feed the PLL, then act on accepted crossings
+static void IRAM_ATTR onZeroCross(void*) {
+  uint32_t now = micros();
+  if (!pllTrack(now)) {
+    zcGlitchCount++;
+    return;  // Ringing on the detector edge, not a real crossing
+  }
+  lastZcUs = now;
+  zcCount++;
+  uint32_t halfCycleUs = pllPeriodQ8 >> 8;
+#if PUMP_PSM_MODE
+  // The detector is back right on a crossing the generator already
+  // emulated: hand back the grid but don't decide that cycle twice
+  bool emulated = synthFired
+      && (uint32_t)abs((int32_t)(pllEdgeUs - synthEdgeUs)) < halfCycleUs / 2;
+  synthFired = false;
+  synthRearm(pllEdgeUs, halfCycleUs);
+  if (emulated) {
+    return;
+  }
+#endif
+  // The true mains crossing: the detector's edge minus its fixed offset
+  onCrossing(pllEdgeUs - ZERO_CROSS_OFFSET_US, halfCycleUs);
 }
 
 // ============================================================================
@@ -117,27 +406,120 @@ static void onZeroCross() {
 
 void initPumpDimmer(int pin) {
   gatePin = pin;
+#if PUMP_PSM_MODE
+  psmModulatorReset(&psmState);
+#endif
   pinMode(gatePin, OUTPUT);
-  digitalWrite(gatePin, LOW);
+  if (gatePin >= 32) {
+    gateSetReg = GPIO_OUT1_W1TS_REG;
+    gateClearReg = GPIO_OUT1_W1TC_REG;
+    gateMask = 1UL << (gatePin - 32);
+  } else {
+    gateMask = 1UL << gatePin;
+  }
+  gateLow();
 
   // Pull-up covers open-collector detector outputs; harmless for push-pull
   pinMode(ZERO_CROSS_PIN, INPUT_PULLUP);
 
-  // Timer 0, 80 MHz / 80 = 1 tick per microsecond
-  fireTimer = timerBegin(0, 80, true);
-  timerAttachInterrupt(fireTimer, &onFireTimer, true);
+  // Free-running microsecond counter; the zero-cross ISR sets one-shot
+  // alarms on it (no auto-reload)
+  timer_config_t timerConfig = {};
+  timerConfig.divider = FIRE_TIMER_DIVIDER;
+  timerConfig.counter_dir = TIMER_COUNT_UP;
+  timerConfig.counter_en = TIMER_PAUSE;
+  timerConfig.alarm_en = TIMER_ALARM_DIS;
+  timerConfig.auto_reload = TIMER_AUTORELOAD_DIS;
+  timer_init(FIRE_TIMER_GROUP, FIRE_TIMER_IDX, &timerConfig);
+  timer_set_counter_value(FIRE_TIMER_GROUP, FIRE_TIMER_IDX, 0);
+  timer_isr_callback_add(FIRE_TIMER_GROUP, FIRE_TIMER_IDX, onFireTimer, nullptr,
+                         ESP_INTR_FLAG_IRAM);
+  timer_start(FIRE_TIMER_GROUP, FIRE_TIMER_IDX);
 
-  attachInterrupt(digitalPinToInterrupt(ZERO_CROSS_PIN), onZeroCross, RISING);
+#if PUMP_PSM_MODE
+  // Synthetic mains generator, same clock. Armed from boot at the default
+  // grid, so PSM runs even if the detector never delivers a single edge;
+  // every real crossing pushes its alarm out again.
+  uint32_t defaultHalfCycleUs = DEFAULT_HALF_CYCLE_US;
+  synthAlarmTicks = SYNTH_HOLDOFF_HALF_CYCLES * defaultHalfCycleUs;
+  synthEdgeUs = micros() + (SYNTH_HOLDOFF_HALF_CYCLES - 1) * defaultHalfCycleUs;
+  timerConfig.alarm_en = TIMER_ALARM_EN;
+  timer_init(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, &timerConfig);
+  timer_set_counter_value(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, 0);
+  timer_set_alarm_value(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, synthAlarmTicks);
+  timer_isr_callback_add(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX, onSyntheticCrossing, nullptr,
+                         ESP_INTR_FLAG_IRAM);
+  timer_start(SYNTH_TIMER_GROUP, SYNTH_TIMER_IDX);
+#endif
+
+  // IRAM-flagged GPIO ISR service instead of attachInterrupt(), whose
+  // dispatcher is not guaranteed to run while the flash cache is disabled.
+  // ESP_ERR_INVALID_STATE just means another module installed it first.
+  esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    DEBUG_PUMP_PRINT("GPIO ISR service install failed (%d)", err);
+  }
+  gpio_set_intr_type((gpio_num_t)ZERO_CROSS_PIN, GPIO_INTR_POSEDGE);
+  gpio_isr_handler_add((gpio_num_t)ZERO_CROSS_PIN, onZeroCross, nullptr);
 
   DEBUG_PUMP_PRINT("%s dimmer initialized (gate GPIO %d, zero cross GPIO %d)",
                    PUMP_PSM_MODE ? "Pulse-skip (PSM)" : "Phase-angle",
                    gatePin, ZERO_CROSS_PIN);
 }
 
+void pumpDimmerSetModulator(PsmModulator m) {
+#if PUMP_PSM_MODE
+  psmModulator = m;
+  DEBUG_PUMP_PRINT("PSM modulator set to %s", psmModulatorName(m));
+#endif
+}
+
+PsmModulator pumpDimmerModulator() {
+#if PUMP_PSM_MODE
+  return psmModulator;
+#else
+  return PUMP_PSM_MODULATOR;
+#endif
+}
+
+int pumpDimmerMainsHz() {
+  return pllMainsHz;
+}
+
+float pumpDimmerMainsFrequency() {
+  return 1e6f * 256.0f / (2.0f * pllPeriodQ8);
+}
+
+bool pumpDimmerPllLocked() {
+  return pllLocked && pumpDimmerZcHealthy();
+}
+
+uint32_t pumpDimmerPllPhaseErrorMaxUs() {
+  uint32_t maxUs = pllPhaseErrorMaxUs;
+  pllPhaseErrorMaxUs = 0;
+  return maxUs;
+}
+
 bool pumpDimmerZcHealthy() {
   return (micros() - lastZcUs) < ZC_TIMEOUT_US;
 }
 
+uint32_t pumpDimmerZcCount() {
+  return zcCount;
+}
+
+uint32_t pumpDimmerZcGlitchCount() {
+  return zcGlitchCount;
+}
+
+uint32_t pumpDimmerZcSyntheticCount() {
+#if PUMP_PSM_MODE
+  return zcSyntheticCount;
+#else
+  return 0;
+#endif
+}
+
 uint32_t pumpDimmerClickCount() {
 #if PUMP_PSM_MODE
   return psmClickCount;
@@ -146,6 +528,26 @@ uint32_t pumpDimmerClickCount() {
 #endif
 }
 
+int pumpDimmerReadClicks(uint32_t* cursor, uint32_t* outUs, int max) {
+#if PUMP_PSM_MODE
+  uint32_t head = psmClickCount;
+  if (head - *cursor > PUMP_CLICK_RING_SIZE) {
+    *cursor = head - PUMP_CLICK_RING_SIZE;  // Fell behind: oldest are gone
+  }
+  int n = 0;
+  while (*cursor != head && n < max) {
+    outUs[n++] = clickRing[*cursor & (PUMP_CLICK_RING_SIZE - 1)];
+    (*cursor)++;
+  }
+  return n;
+#else
+  (void)outUs;
+  (void)max;
+  *cursor = 0;
+  return 0;
+#endif
+}
+
 void pumpDimmerSetPower(uint8_t level) {
   powerLevel = level;
 
@@ -157,15 +559,48 @@ void pumpDimmerSetPower(uint8_t level) {
     if (healthy) {
       DEBUG_PUMP_PRINT("Zero-cross sync acquired - synced pump dimming active");
     } else {
-      DEBUG_PUMP_PRINT("No zero crossings on GPIO %d - falling back to on/off pump control",
-                       ZERO_CROSS_PIN);
+      DEBUG_PUMP_PRINT("No zero crossings on GPIO %d - falling back to %s",
+                       ZERO_CROSS_PIN,
+                       PUMP_PSM_MODE ? "synthetic crossings" : "on/off pump control");
     }
   }
 
-  // Fallback when no zero crossings arrive (detector unplugged, bench setup
-  // without mains): degrade to on/off so the pump never dies mid-shot. With a
-  // random-fire opto-triac a solid HIGH gate means full conduction.
+#if !PUMP_PSM_MODE
+  // Phase-angle fallback when no zero crossings arrive (detector unplugged,
+  // bench setup without mains): a firing angle against an emulated grid
+  // would land anywhere in the real half-cycle, so degrade to on/off
+  // instead; the pump never dies mid-shot. With a random-fire opto-triac a
+  // solid HIGH gate means full conduction. (PSM keeps modulating on the
+  // synthetic generator's crossings.)
   if (!healthy) {
-    digitalWrite(gatePin, level > FULL_OFF_LEVEL ? HIGH : LOW);
+    fireArmed = false;
+    if (level > FULL_OFF_LEVEL) {
+      gateHigh();
+    } else {
+      gateLow();
+    }
   }
+#endif
+}
+
+bool pumpDimmerLatencyStats(PumpLatencyStats* out) {
+#if PUMP_LATENCY_INSTRUMENTATION
+  portENTER_CRITICAL(&latencyMux);
+  *out = latencyStats;
+  latencyStats.maxUs = 0;
+  portEXIT_CRITICAL(&latencyMux);
+  return true;
+#else
+  *out = {};
+  return false;
+#endif
+}
+
+uint32_t pumpDimmerLatencyBucketUs(int bucket) {
+#if PUMP_LATENCY_INSTRUMENTATION
+  if (bucket >= 0 && bucket < PUMP_LATENCY_BUCKETS - 1) {
+    return LATENCY_BUCKET_US[bucket];
+  }
+#endif
+  return UINT32_MAX;
 }
@@ -5,18 +5,20 @@
 // PUMP DIMMER - ZERO-CROSS SYNCED TRIAC CONTROL (PSM or phase-angle)
 // ============================================================================
 // Two firing schemes, selected by PUMP_PSM_MODE, both synchronized to the
-// mains zero crossings on ZERO_CROSS_PIN (GPIO 4, 100/s at 50 Hz):
+// mains zero crossings on ZERO_CROSS_PIN (GPIO 4, 100/s at 50 Hz, 120/s at
+// 60 Hz):
 //
 // PSM (pulse-skip modulation, gaggiuino-style, default): the vibratory pump
 // rectifies half-wave internally and does exactly one piston stroke per
-// conducted mains cycle. A Bresenham accumulator decides once per full cycle
-// (every 2nd zero cross) whether to conduct it whole (gate HIGH, one pump
-// stroke, "click") or skip it (gate LOW). Power = fraction of cycles fired,
-// spread as evenly as possible; conducted strokes are counted so the pump
+// conducted mains cycle. A modulator (psm_modulator.h: first-order
+// Bresenham by default, second-order or dithered selectable at runtime)
+// decides once per full cycle (every 2nd zero cross) whether to conduct it
+// whole (gate HIGH, one pump stroke, "click") or skip it (gate LOW). Power =
+// fraction of cycles fired; conducted strokes are counted so the pump
 // doubles as a flow meter (pump_model.cpp).
 //
 // Phase-angle (leading edge): the zero cross drops the gate and arms a
-// one-shot hardware timer with delay = (255 - level) / 255 * 10 ms; the timer
+// one-shot hardware timer with delay = (255 - level) / 255 * half-cycle; the timer
 // raises the gate, held high until the next zero cross so the triac cannot
 // drop out on the inductive pump load.
 //
@@ -24,17 +26,53 @@
 // controllers and the web dashboard are unaffected.
 //
 // Graceful degradation: if no zero crossings arrive (sensor unplugged, bench
-// setup without mains), the module falls back to plain on/off - any nonzero
-// level drives the gate solid HIGH (full power), so a lost sync signal can
-// never kill the pump mid-shot.
+// setup without mains), PSM keeps running on a hardware-timer mains emulator
+// that continues the last measured grid (period and phase), so modulation
+// only drifts slightly out of alignment instead of collapsing to bang-bang
+// control. Phase-angle falls back to plain on/off - any nonzero level
+// drives the gate solid HIGH (full power). Either way a lost sync signal
+// can never kill the pump mid-shot.
+//
+// Mains sync: a software PLL locks onto the detector edges, measures the
+// half-cycle period (and from it 50 vs 60 Hz), rejects edges that don't fall
+// near the predicted crossing and subtracts the detector's fixed offset
+// (ZERO_CROSS_OFFSET_US). Firing delays scale with the measured period and
+// are scheduled from the PLL's filtered crossing, not from the raw edge.
+//
+// Timing: both interrupt handlers are IRAM-resident and registered with
+// ESP_INTR_FLAG_IRAM, write the gate through the GPIO set/clear registers
+// and program the firing timer with the IDF's ISR-safe calls, so firing
+// stays on time during flash writes (EEPROM.commit). With
+// PUMP_LATENCY_INSTRUMENTATION each gate write is timestamped against the
+// instant it should have happened and binned into a histogram (/metrics).
 
 #include <Arduino.h>
 
+#include "psm_modulator.h"
+
 // Pulse-skip modulation (whole-cycle firing + click counting) instead of
 // phase-angle. Right for vibratory pumps (ULKA/CEME style, as in the Dalla
 // Corte Mini); use phase-angle (false) for rotary pumps.
 #define PUMP_PSM_MODE true
 
+// PSM modulator used from boot; switchable via pumpDimmerSetModulator()
+#define PUMP_PSM_MODULATOR PsmModulator::FIRST_ORDER
+
+// Grid frequency assumed until the PLL has locked (50 or 60)
+#define PUMP_DEFAULT_MAINS_HZ 50
+
+// How long the detector's rising edge lags the true mains zero crossing, in
+// microseconds (negative if it leads). Fixed per detector circuit: compare
+// the mains waveform and the detector output on a scope. 0 = trust the edge.
+#define ZERO_CROSS_OFFSET_US 0
+
+// Record edge-to-gate latency per crossing (a few dozen cycles per ISR)
+#define PUMP_LATENCY_INSTRUMENTATION true
+
+// Latency histogram buckets, upper bounds 5/10/20/50/100/200/500/1000/2000 us
+// plus a final overflow bucket
+#define PUMP_LATENCY_BUCKETS 10
+
 #define ZERO_CROSS_PIN 4  // Zero-cross detector output (rising edge per crossing)
 
 // Configure pins, hardware timer and the zero-cross interrupt.
@@ -46,11 +84,66 @@ void initPumpDimmer(int gatePin);
 // call it periodically (the control task does, every ~50 ms).
 void pumpDimmerSetPower(uint8_t level);
 
+// Select the PSM modulator; takes effect (with fresh modulator state) at
+// the next mains cycle. No effect in phase-angle mode.
+void pumpDimmerSetModulator(PsmModulator m);
+PsmModulator pumpDimmerModulator();
+
 // True while mains zero crossings are arriving on ZERO_CROSS_PIN
 bool pumpDimmerZcHealthy();
 
+// Detected grid: 50 or 60 (PUMP_DEFAULT_MAINS_HZ until the first lock; the
+// last detection is kept while sync is lost). One PSM decision per cycle,
+// so this is also the maximum pump click rate.
+int pumpDimmerMainsHz();
+
+// Mains frequency (Hz) as measured by the PLL's period estimate
+float pumpDimmerMainsFrequency();
+
+// True while the PLL is locked onto arriving zero crossings
+bool pumpDimmerPllLocked();
+
+// Largest |measured - predicted| crossing time since the previous call (us)
+uint32_t pumpDimmerPllPhaseErrorMaxUs();
+
+// Cumulative counts of accepted zero crossings and of detector edges
+// rejected as glitches (for /metrics; never reset)
+uint32_t pumpDimmerZcCount();
+uint32_t pumpDimmerZcGlitchCount();
+
+// Cumulative count of crossings emulated while the detector was silent
+// (PSM only)
+uint32_t pumpDimmerZcSyntheticCount();
+
 // Cumulative count of conducted mains cycles (= pump strokes in PSM mode).
 // Callers keep their own last value and diff; the counter is never reset.
 uint32_t pumpDimmerClickCount();
 
+// Every conducted stroke's time (micros(), the PLL's crossing instant) goes
+// into a ring of this many entries (power of two; ~1.3 s at 50 clicks/s)
+#define PUMP_CLICK_RING_SIZE 64
+
+// Copy stroke timestamps recorded since *cursor (a pumpDimmerClickCount()
+// value) into outUs, oldest first, up to max, and advance *cursor past them.
+// Lock-free: the ISR is the only writer. A reader more than a ring behind
+// skips the overwritten strokes. Returns the number copied.
+int pumpDimmerReadClicks(uint32_t* cursor, uint32_t* outUs, int max);
+
+// Edge-to-gate latency: PSM decisions and full-on gates are measured from
+// the PLL's estimate of the true zero crossing, phase-angle firings from their scheduled
+// instant. buckets[] counts samples per bucket (not cumulative).
+struct PumpLatencyStats {
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;  // Since the previous read
+  uint32_t buckets[PUMP_LATENCY_BUCKETS];
+};
+
+// Copy the latency stats and reset the maximum. Returns false (stats
+// zeroed) when PUMP_LATENCY_INSTRUMENTATION is off.
+bool pumpDimmerLatencyStats(PumpLatencyStats* out);
+
+// Upper bound of a latency bucket in microseconds; UINT32_MAX for the last
+uint32_t pumpDimmerLatencyBucketUs(int bucket);
+
 #endif // PUMP_DIMMER_H
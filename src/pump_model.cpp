@@ -2,13 +2,17 @@
 
 #include <Arduino.h>
 
+#include "pump_calibration.h"
+
 // Flow of one click with no pressure in the system (ml). Gaggiuino default
 // for the ULKA EX5; tune against measured shot weights if needed.
 static const float FLOW_PER_CLICK_AT_ZERO_BAR = 0.27f;
 
-// Click volume in the model is per minute-normalized click; at 50 clicks/s
-// this rescales to the datasheet's ml/min curve (gaggiuino: 60 / maxCPS)
-static const float FPC_MULTIPLIER = 60.0f / MAX_PUMP_CLICKS_PER_SECOND;
+// Mains frequency = maximum click rate, and the click-volume rescale that
+// goes with it: the model's click volume is per minute-normalized click,
+// rescaled to the datasheet's ml/min curve (gaggiuino: 60 / maxCPS)
+static int maxClicksPerSecond = DEFAULT_PUMP_CLICKS_PER_SECOND;
+static float fpcMultiplier = 60.0f / DEFAULT_PUMP_CLICKS_PER_SECOND;
 
 // Pressure-inefficiency polynomial, gaggiuino's fitted curve (blue curve at
 // https://www.desmos.com/calculator/axyl70gjae)
@@ -20,14 +24,34 @@ static const float C4 = 0.000045f;
 static const float C5 = 0.009f;
 static const float C6 = -0.0018f;
 
+void setMaxPumpClicksPerSecond(int clicksPerSecond) {
+  if (clicksPerSecond <= 0 || clicksPerSecond == maxClicksPerSecond) {
+    return;
+  }
+  maxClicksPerSecond = clicksPerSecond;
+  fpcMultiplier = 60.0f / clicksPerSecond;
+}
+
+int getMaxPumpClicksPerSecond() {
+  return maxClicksPerSecond;
+}
+
 float getPumpFlowPerClick(float pressureBar) {
+  float learned;
+  if (pumpCalibrationFlowPerClick(pressureBar, &learned)) {
+    return learned;
+  }
+  return getPumpFlowPerClickModel(pressureBar);
+}
+
+float getPumpFlowPerClickModel(float pressureBar) {
   const float p = pressureBar;
   // Same polynomial as gaggiuino's, with their (C5/p + C6) * -p^2 term
   // expanded to -C5*p - C6*p^2 so p = 0 doesn't divide by zero
   float fpc = -C5 * p - C6 * p * p
               + (FLOW_PER_CLICK_AT_ZERO_BAR - C0)
               - (C1 + (C2 - (C3 - C4 * p) * p) * p) * p;
-  return fpc * FPC_MULTIPLIER;
+  return fpc * fpcMultiplier;
 }
 
 float getPumpFlow(float clicksPerSecond, float pressureBar) {
@@ -42,9 +66,56 @@ float getClicksPerSecondForFlow(float flowMlPerS, float pressureBar) {
   if (flowPerClick <= 0.001f) {
     // Beyond the pump's deadhead pressure no click moves water; asking for
     // flow here means full rate (the cap) rather than a negative rate
-    return (float)MAX_PUMP_CLICKS_PER_SECOND;
+    return (float)maxClicksPerSecond;
+  }
+  return fminf(flowMlPerS / flowPerClick, (float)maxClicksPerSecond);
+}
+
+// Last PUMP_FLOW_CLICKS + 1 strokes: times and volumes (ring, flowCount
+// strokes ending just before flowHead). Control task only.
+static uint32_t flowClickUs[PUMP_FLOW_CLICKS + 1];
+static float flowClickMl[PUMP_FLOW_CLICKS + 1];
+static int flowHead = 0;
+static int flowCount = 0;
+
+void pumpFlowAddClick(uint32_t timeUs, float pressureBar) {
+  flowClickUs[flowHead] = timeUs;
+  flowClickMl[flowHead] = fmaxf(getPumpFlowPerClick(pressureBar), 0.0f);
+  flowHead = (flowHead + 1) % (PUMP_FLOW_CLICKS + 1);
+  if (flowCount < PUMP_FLOW_CLICKS + 1) {
+    flowCount++;
   }
-  return fminf(flowMlPerS / flowPerClick, (float)MAX_PUMP_CLICKS_PER_SECOND);
+}
+
+float pumpFlowEstimate(uint32_t nowUs) {
+  if (flowCount < 2) {
+    return 0.0f;
+  }
+  int newest = (flowHead + PUMP_FLOW_CLICKS) % (PUMP_FLOW_CLICKS + 1);
+  // Counted back from the head: after a pause the ring restarts wherever
+  // the head was, not at slot 0
+  int oldest = (flowHead + PUMP_FLOW_CLICKS + 1 - flowCount) % (PUMP_FLOW_CLICKS + 1);
+  int intervals = flowCount - 1;
+  uint32_t sinceLastUs = nowUs - flowClickUs[newest];
+  if (sinceLastUs > PUMP_FLOW_TIMEOUT_US) {
+    flowCount = 0;  // Pump stopped: the next stroke starts a fresh estimate
+    return 0.0f;
+  }
+
+  // Volume pushed across the intervals: every stroke but the oldest, which
+  // only marks where the first interval starts
+  float volumeMl = 0.0f;
+  for (int i = 1; i <= intervals; i++) {
+    volumeMl += flowClickMl[(oldest + i) % (PUMP_FLOW_CLICKS + 1)];
+  }
+  uint32_t spanUs = flowClickUs[newest] - flowClickUs[oldest];
+  // No stroke for longer than the average spacing: the pump has slowed, so
+  // stretch the span by the excess instead of holding a stale rate
+  uint32_t meanIntervalUs = spanUs / intervals;
+  if (sinceLastUs > meanIntervalUs) {
+    spanUs += sinceLastUs - meanIntervalUs;
+  }
+  return spanUs > 0 ? volumeMl * 1e6f / spanUs : 0.0f;
 }
 
 float getPumpPct(float targetPressure, float flowRestriction,
@@ -58,12 +129,12 @@ float getPumpPct(float targetPressure, float flowRestriction,
   float maxPumpPct = flowRestriction <= 0.0f
       ? 1.0f
       : getClicksPerSecondForFlow(flowRestriction, smoothedPressure)
-          / (float)MAX_PUMP_CLICKS_PER_SECOND;
+          / (float)maxClicksPerSecond;
   // Feedforward baseline: the click rate that sustains the current measured
   // flow at the current pressure - tracks the puck's resistance by itself
   float pumpPctToMaintainFlow =
       getClicksPerSecondForFlow(smoothedPumpFlow, smoothedPressure)
-          / (float)MAX_PUMP_CLICKS_PER_SECOND;
+          / (float)maxClicksPerSecond;
 
   if (diff > 2.0f) {
     // Far below target: bounded approach ramp instead of a full-power slam
@@ -80,3 +151,15 @@ float getPumpPct(float targetPressure, float flowRestriction,
   // Above target and rising: pump off, let the puck bleed the pressure down
   return 0.0f;
 }
+
+float getPumpPctForFlow(float targetFlow, float pressureLimit,
+                        float smoothedPressure, float smoothedPumpFlow,
+                        float pressureChangeSpeed) {
+  // Same hand-over point as gaggiuino's setPumpFlow(): past half the limit
+  // the pressure law takes over so the limit is approached, not hit
+  if (pressureLimit > 0.0f && smoothedPressure > pressureLimit * 0.5f) {
+    return getPumpPct(pressureLimit, targetFlow, smoothedPressure,
+                      smoothedPumpFlow, pressureChangeSpeed);
+  }
+  return getClicksPerSecondForFlow(targetFlow, smoothedPressure) / (float)maxClicksPerSecond;
+}
@@ -17,30 +17,61 @@
 // proportional trim. Overpressure cuts the pump instead of waiting for an
 // integral to unwind; large errors approach on a bounded ramp.
 
-// One pump stroke per mains cycle at 50 Hz
-#define MAX_PUMP_CLICKS_PER_SECOND 50
+#include <Arduino.h>
 
-// EMA factor for the click-rate flow estimate, applied per 100 ms window
-// (DERIVED_STATE_PERIOD_MS): clicks arrive quantized (0-5 per window), so
-// smoothing is required; 0.25 at 10 Hz is a ~350 ms time constant
-#define PUMP_FLOW_FILTER_ALPHA 0.25f
+// One pump stroke per mains cycle: 50/s on 50 Hz grids, 60/s on 60 Hz. The
+// control task feeds in the grid the dimmer detected (pump_dimmer.h).
+#define DEFAULT_PUMP_CLICKS_PER_SECOND 50
 
-// Volume one pump stroke moves at the given pressure (ml/click)
+// Maximum click rate = mains frequency in Hz. Also rescales the click volume
+// (the model's curve is per minute-normalized click, gaggiuino-style).
+void setMaxPumpClicksPerSecond(int clicksPerSecond);
+int getMaxPumpClicksPerSecond();
+
+// Inter-click flow estimate: volume of the last PUMP_FLOW_CLICKS strokes over
+// the time they took (80 ms at full rate, one PSM pattern period at most
+// levels), each stroke's volume taken at the pressure of its own instant
+#define PUMP_FLOW_CLICKS 4
+
+// Volume one pump stroke moves at the given pressure (ml/click): the
+// curve learned on this machine (pump_calibration.h) once it is confident,
+// the fixed model curve until then
 float getPumpFlowPerClick(float pressureBar);
 
+// The fixed model curve alone (gaggiuino's fit, scaled to the mains rate)
+float getPumpFlowPerClickModel(float pressureBar);
+
 // Model-estimated pump flow (ml/s) from the measured click rate
 float getPumpFlow(float clicksPerSecond, float pressureBar);
 
+// Feed one pump stroke (its time in micros() and the pressure then) into
+// the inter-click flow estimator; strokes must arrive in time order
+void pumpFlowAddClick(uint32_t timeUs, float pressureBar);
+
+// Estimated pump flow (ml/s) at nowUs from the last PUMP_FLOW_CLICKS
+// strokes. Decays once the gap since the last stroke outgrows the recent
+// click spacing, and is 0 after PUMP_FLOW_TIMEOUT_US without strokes.
+float pumpFlowEstimate(uint32_t nowUs);
+
+#define PUMP_FLOW_TIMEOUT_US 500000
+
 // Click rate needed to push the given flow at the given pressure,
-// capped at MAX_PUMP_CLICKS_PER_SECOND
+// capped at the maximum click rate
 float getClicksPerSecondForFlow(float flowMlPerS, float pressureBar);
 
 // Fraction of the maximum click rate (0..1) to reach/hold targetPressure.
 // flowRestriction (ml/s) caps the output for flow-limited profiles; pass 0
 // for no cap. smoothedPumpFlow and pressureChangeSpeed come from the control
-// task (main.cpp), computed from the click counter and the filtered pressure.
+// task (main.cpp), from the click timestamps and the filtered pressure.
 float getPumpPct(float targetPressure, float flowRestriction,
                  float smoothedPressure, float smoothedPumpFlow,
                  float pressureChangeSpeed);
 
+// Fraction of the maximum click rate (0..1) to push targetFlow (ml/s):
+// open-loop through the pump curve, handing over to getPumpPct() with the
+// flow as its cap once the pressure closes in on pressureLimit (0 = none)
+float getPumpPctForFlow(float targetFlow, float pressureLimit,
+                        float smoothedPressure, float smoothedPumpFlow,
+                        float pressureChangeSpeed);
+
 #endif // PUMP_MODEL_H
@@ -0,0 +1,287 @@
+#include "scale.h"
+
+#include <AcaiaArduinoBLE.h>
+
+#include "debug.h"
+#include "settings.h"
+#include "shot_stopper.h"
+
+volatile int scaleDriverSelected = SCALE_DRIVER_ACAIA;
+
+// ============================================================================
+// ACAIA (BLE)
+// ============================================================================
+// Connecting: the last scale's address is kept in the settings. After a
+// drop the driver first listens for that address only, for a short window -
+// a scale that merely lost the link advertises again at once, so this
+// reconnects in well under a second. Only when that fails a few times (or
+// no address is known) does it run a full discovery scan, which can take
+// up to SCALE_DISCOVERY_TIMEOUT_MS, and remember what it found.
+
+// Directed fast path: listen window per attempt, attempts before falling
+// back to discovery
+#define SCALE_FAST_LISTEN_MS 1000
+#define SCALE_FAST_ATTEMPTS 3
+
+#define SCALE_DISCOVERY_TIMEOUT_MS 10000
+
+static AcaiaArduinoBLE acaia(DEBUGMODE_ACAIA);
+static int fastFailures = 0;
+static bool bleStarted = false;  // BLE only runs once the Acaia is used
+
+// Advertised names of the scales AcaiaArduinoBLE drives (first five
+// characters, upper case), for the discovery scan
+static const char* const SCALE_NAME_PREFIXES[] = {
+  "ACAIA", "LUNAR", "PEARL", "PYXIS", "PROCH", "CINCO", "BOOKO"
+};
+
+static bool isScaleName(String name) {
+  name.toUpperCase();
+  for (const char* prefix : SCALE_NAME_PREFIXES) {
+    if (name.startsWith(prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Fast path: connect only if the scale at address is advertising within the
+// listen window (init() then finds it again at once)
+static bool acaiaConnectDirected(const char* address) {
+  BLE.scanForAddress(address);
+  unsigned long start = millis();
+  bool seen = false;
+  while (!seen && millis() - start < SCALE_FAST_LISTEN_MS) {
+    BLEDevice dev = BLE.available();
+    seen = (bool)dev;
+    if (!seen) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+  BLE.stopScan();
+  return seen && acaia.init(address);
+}
+
+// Full scan for any supported scale; on success address holds its address
+static bool acaiaDiscover(char* address, size_t len) {
+  BLE.scan();
+  unsigned long start = millis();
+  while (millis() - start < SCALE_DISCOVERY_TIMEOUT_MS) {
+    BLEDevice dev = BLE.available();
+    if (dev && dev.hasLocalName() && isScaleName(dev.localName())) {
+      strlcpy(address, dev.address().c_str(), len);
+      BLE.stopScan();
+      return true;
+    }
+    if (!dev) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+  BLE.stopScan();
+  return false;
+}
+
+static bool acaiaConnect(bool* fast) {
+  if (!bleStarted) {
+    BLE.begin();
+    BLE.setLocalName("shotStopper");
+    bleStarted = true;
+    DEBUG_SCALE_PRINT("Bluetooth initialized for scale connection");
+  }
+  *fast = settings.scaleAddress[0] != '\0' && fastFailures < SCALE_FAST_ATTEMPTS;
+  bool connected;
+  if (*fast) {
+    connected = acaiaConnectDirected(settings.scaleAddress);
+    fastFailures = connected ? 0 : fastFailures + 1;
+  } else {
+    char address[sizeof(settings.scaleAddress)];
+    connected = acaiaDiscover(address, sizeof(address)) && acaia.init(address);
+    if (connected) {
+      settingsSetScaleAddress(address);
+    }
+    fastFailures = 0;  // Next round tries the (new) address first again
+  }
+  if (!connected) {
+    BLE.stopScan();  // init() leaves the scan running on timeout
+  }
+  return connected;
+}
+
+static void acaiaDisconnect() {
+  BLE.disconnect();
+}
+
+static bool acaiaIsConnected() {
+  return acaia.isConnected();
+}
+
+// Heartbeat every ~30 s keeps the BLE connection alive
+static void acaiaMaintain() {
+  if (acaia.heartbeatRequired()) {
+    acaia.heartbeat();
+  }
+}
+
+static bool acaiaReadWeight(float* weight) {
+  if (!acaia.newWeightAvailable()) {
+    return false;
+  }
+  *weight = acaia.getWeight();
+  return true;
+}
+
+static bool acaiaTare() {
+  return acaia.tare();
+}
+
+static bool acaiaStartTimer() {
+  return acaia.startTimer();
+}
+
+static bool acaiaStopTimer() {
+  return acaia.stopTimer();
+}
+
+static bool acaiaResetTimer() {
+  return acaia.resetTimer();
+}
+
+// ============================================================================
+// VIRTUAL (trace replay)
+// ============================================================================
+
+// A 1:2 shot as the Lunar reports it: ~6 s until the first drops, then a
+// steady ~1.3 g/s, 36 g at ~33 s
+static const float BUILTIN_TIME_S[] = { 0, 4, 6, 7, 8, 10, 15, 20, 25, 30, 35, 40, 45 };
+static const float BUILTIN_WEIGHT[] = { 0, 0, 0.2f, 0.8f, 1.8f, 4.0f, 10.5f, 17.0f, 23.5f, 30.0f,
+                                        36.5f, 43.0f, 49.5f };
+#define BUILTIN_LEN (int)(sizeof(BUILTIN_TIME_S) / sizeof(BUILTIN_TIME_S[0]))
+
+// Guards the replay state (scale task replays, web server reconfigures)
+static portMUX_TYPE virtualMux = portMUX_INITIALIZER_UNLOCKED;
+static VirtualScale virtualScale;
+static VirtualScaleConfig virtualConfig = VIRTUAL_SCALE_DEFAULTS;
+static float virtualTimeS[VIRTUAL_SCALE_MAX_POINTS];
+static float virtualWeight[VIRTUAL_SCALE_MAX_POINTS];
+static int virtualLen = 0;  // 0 = built-in trace
+static bool virtualConnected = false;
+
+// virtualMux held
+static void virtualRestart() {
+  if (virtualLen > 0) {
+    virtualScaleInit(&virtualScale, virtualConfig, virtualTimeS, virtualWeight, virtualLen, millis());
+  } else {
+    virtualScaleInit(&virtualScale, virtualConfig, BUILTIN_TIME_S, BUILTIN_WEIGHT, BUILTIN_LEN, millis());
+  }
+}
+
+static bool virtualConnect(bool* fast) {
+  *fast = true;
+  portENTER_CRITICAL(&virtualMux);
+  virtualRestart();
+  virtualConnected = true;
+  portEXIT_CRITICAL(&virtualMux);
+  return true;
+}
+
+static void virtualDisconnect() {
+  virtualConnected = false;
+}
+
+static bool virtualIsConnected() {
+  return virtualConnected;
+}
+
+static void virtualMaintain() {
+}
+
+static bool virtualReadWeight(float* weight) {
+  float nowS = secondsSinceBoot();
+  portENTER_CRITICAL(&virtualMux);
+  bool got = virtualScaleRead(&virtualScale, nowS, weight);
+  portEXIT_CRITICAL(&virtualMux);
+  return got;
+}
+
+static bool virtualTare() {
+  float nowS = secondsSinceBoot();
+  portENTER_CRITICAL(&virtualMux);
+  virtualScaleTare(&virtualScale, nowS);
+  portEXIT_CRITICAL(&virtualMux);
+  return true;
+}
+
+static bool virtualStartTimer() {
+  float nowS = secondsSinceBoot();
+  portENTER_CRITICAL(&virtualMux);
+  virtualScaleStartTimer(&virtualScale, nowS);
+  portEXIT_CRITICAL(&virtualMux);
+  return true;
+}
+
+static bool virtualStopTimer() {
+  float nowS = secondsSinceBoot();
+  portENTER_CRITICAL(&virtualMux);
+  virtualScaleStopTimer(&virtualScale, nowS);
+  portEXIT_CRITICAL(&virtualMux);
+  return true;
+}
+
+static bool virtualResetTimer() {
+  portENTER_CRITICAL(&virtualMux);
+  virtualScaleResetTimer(&virtualScale);
+  portEXIT_CRITICAL(&virtualMux);
+  return true;
+}
+
+void scaleVirtualConfigure(const VirtualScaleConfig& config,
+                           const float* timeS, const float* weight, int len) {
+  if (len > VIRTUAL_SCALE_MAX_POINTS) {
+    len = VIRTUAL_SCALE_MAX_POINTS;
+  }
+  portENTER_CRITICAL(&virtualMux);
+  virtualConfig = config;
+  if (len >= 2) {
+    memcpy(virtualTimeS, timeS, len * sizeof(float));
+    memcpy(virtualWeight, weight, len * sizeof(float));
+    virtualLen = len;
+  }
+  virtualRestart();
+  portEXIT_CRITICAL(&virtualMux);
+}
+
+void scaleVirtualConfig(VirtualScaleConfig* config, int* len) {
+  portENTER_CRITICAL(&virtualMux);
+  *config = virtualConfig;
+  *len = virtualLen;
+  portEXIT_CRITICAL(&virtualMux);
+}
+
+// ============================================================================
+// REGISTRY
+// ============================================================================
+
+static const ScaleDriver DRIVERS[SCALE_DRIVER_COUNT] = {
+  { "acaia", acaiaConnect, acaiaDisconnect, acaiaIsConnected, acaiaMaintain,
+    acaiaReadWeight, acaiaTare, acaiaStartTimer, acaiaStopTimer, acaiaResetTimer },
+  { "virtual", virtualConnect, virtualDisconnect, virtualIsConnected, virtualMaintain,
+    virtualReadWeight, virtualTare, virtualStartTimer, virtualStopTimer, virtualResetTimer },
+};
+
+const ScaleDriver* scaleDriver(int driver) {
+  return driver >= 0 && driver < SCALE_DRIVER_COUNT ? &DRIVERS[driver] : nullptr;
+}
+
+const char* scaleDriverName(int driver) {
+  const ScaleDriver* d = scaleDriver(driver);
+  return d ? d->name : "unknown";
+}
+
+int scaleDriverFromName(const char* name) {
+  for (int i = 0; i < SCALE_DRIVER_COUNT; i++) {
+    if (strcmp(DRIVERS[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,79 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+// ============================================================================
+// SCALE DRIVERS
+// ============================================================================
+// What the scale task (main.cpp) needs from a scale, behind one interface
+// (ScaleDriver) so the shot stopper runs against any of them:
+//
+//   ACAIA    The BLE scale via AcaiaArduinoBLE, with the cached-address fast
+//            reconnect and the discovery scan
+//   VIRTUAL  Replays a recorded weight trace (virtual_scale.h) with
+//            configurable speed, latency, jitter and dropouts - shots
+//            without a scale, on the machine, no BLE involved
+//
+// Only the scale task calls the drivers. GET /set_scale switches between
+// them (not persisted: a reboot always comes back on SCALE_DRIVER from
+// main.cpp); /set_virtual_scale loads a trace and the replay settings.
+//
+// Adding a driver: a SCALE_DRIVER_* id, its functions and an entry in the
+// table in scale.cpp.
+
+#include <Arduino.h>
+
+#include "virtual_scale.h"
+
+#define SCALE_DRIVER_ACAIA 0
+#define SCALE_DRIVER_VIRTUAL 1
+
+#define SCALE_DRIVER_COUNT 2
+
+// Scale task timing: pause after a failed fast-path attempt and after a
+// failed scan (BLE scanning and WiFi share the radio), and the poll period
+// while connected, which bounds how late a weight packet is stamped
+#define SCALE_FAST_RETRY_MS 250
+#define SCALE_RETRY_BACKOFF_MS 5000
+#define SCALE_POLL_MS 5
+
+struct ScaleDriver {
+  const char* name;
+  // Blocking connection attempt (may scan); *fast tells whether a failure
+  // is worth a quick retry and a success was a fast reconnect
+  bool (*connect)(bool* fast);
+  void (*disconnect)();
+  bool (*isConnected)();
+  // Called every poll while connected (heartbeats)
+  void (*maintain)();
+  // Next weight packet, if one arrived since the last call
+  bool (*readWeight)(float* weight);
+  // Commands (run through scale_commands.h): true once the scale accepted
+  // the write - for the Acaia the ATT write response, not yet its effect
+  bool (*tare)();
+  bool (*startTimer)();
+  bool (*stopTimer)();
+  bool (*resetTimer)();
+};
+
+// Registered driver by id; nullptr if out of range
+const ScaleDriver* scaleDriver(int driver);
+const char* scaleDriverName(int driver);
+int scaleDriverFromName(const char* name);  // -1 if unknown
+
+// Driver the scale task runs: set by /set_scale, picked up by the scale task
+// (which drops the old driver's connection)
+extern volatile int scaleDriverSelected;
+
+// Virtual scale trace capacity (a history shot fits)
+#define VIRTUAL_SCALE_MAX_POINTS 100
+
+// Load a trace (len 2..VIRTUAL_SCALE_MAX_POINTS, times increasing; copied)
+// and replay settings into the virtual driver; takes effect at once, the
+// timer reset. Any task.
+void scaleVirtualConfigure(const VirtualScaleConfig& config,
+                           const float* timeS, const float* weight, int len);
+
+// Current settings and trace length (0 = the built-in trace)
+void scaleVirtualConfig(VirtualScaleConfig* config, int* len);
+
+#endif // SCALE_H
@@ -0,0 +1,181 @@
+#include "scale_commands.h"
+
+#include <math.h>
+
+#include "debug.h"
+
+static const char* const COMMAND_NAMES[SCALE_CMD_COUNT] = {
+  "reset_timer", "start_timer", "stop_timer", "tare"
+};
+
+// Scale task state
+static ScaleCommand queue[SCALE_COMMAND_QUEUE];
+static int queueHead = 0;
+static int queueCount = 0;
+
+static bool inFlight = false;
+static ScaleCommand current;
+static int attempts = 0;
+static bool writeAccepted = false;
+static uint32_t firstSentMs = 0;
+static uint32_t sentMs = 0;
+
+static float lastWeight = 0.0f;
+static bool haveWeight = false;
+static float softTareG = 0.0f;
+static bool tared = false;
+
+// Written by the scale task, read by /metrics
+static portMUX_TYPE commandStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static ScaleCommandStats commandStats[SCALE_CMD_COUNT] = {};
+
+const char* scaleCommandName(int command) {
+  return command >= 0 && command < SCALE_CMD_COUNT ? COMMAND_NAMES[command] : "unknown";
+}
+
+bool scaleCommandEnqueue(ScaleCommand command) {
+  if (queueCount == SCALE_COMMAND_QUEUE) {
+    DEBUG_SCALE_PRINT("Scale command queue full - %s dropped", scaleCommandName(command));
+    return false;
+  }
+  queue[(queueHead + queueCount) % SCALE_COMMAND_QUEUE] = command;
+  queueCount++;
+  return true;
+}
+
+void scaleCommandsReset() {
+  queueCount = 0;
+  inFlight = false;
+  haveWeight = false;
+  softTareG = 0.0f;
+  tared = false;
+}
+
+bool scaleCommandsTarePending() {
+  if (inFlight && current == SCALE_CMD_TARE) {
+    return true;
+  }
+  for (int i = 0; i < queueCount; i++) {
+    if (queue[(queueHead + i) % SCALE_COMMAND_QUEUE] == SCALE_CMD_TARE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+float scaleCommandsSoftTareG() {
+  return softTareG;
+}
+
+bool scaleCommandsTakeTared() {
+  bool was = tared;
+  tared = false;
+  return was;
+}
+
+void scaleCommandStats(int command, ScaleCommandStats* out) {
+  portENTER_CRITICAL(&commandStatsMux);
+  *out = commandStats[command];
+  portEXIT_CRITICAL(&commandStatsMux);
+}
+
+// ============================================================================
+// EXECUTOR
+// ============================================================================
+
+static bool sendCommand(const ScaleDriver* driver, ScaleCommand command) {
+  switch (command) {
+    case SCALE_CMD_RESET_TIMER: return driver->resetTimer();
+    case SCALE_CMD_START_TIMER: return driver->startTimer();
+    case SCALE_CMD_STOP_TIMER:  return driver->stopTimer();
+    case SCALE_CMD_TARE:        return driver->tare();
+    default:                    return true;
+  }
+}
+
+static void transmit(const ScaleDriver* driver, uint32_t nowMs) {
+  attempts++;
+  sentMs = nowMs;
+  writeAccepted = sendCommand(driver, current);
+}
+
+static void finish(bool confirmed, uint32_t nowMs) {
+  uint32_t latencyMs = nowMs - firstSentMs;
+  portENTER_CRITICAL(&commandStatsMux);
+  ScaleCommandStats& st = commandStats[current];
+  st.retries += attempts - 1;
+  if (confirmed) {
+    st.confirmed++;
+    st.sumMs += latencyMs;
+    st.lastMs = latencyMs;
+  } else {
+    st.failed++;
+  }
+  portEXIT_CRITICAL(&commandStatsMux);
+
+  if (current == SCALE_CMD_TARE) {
+    if (confirmed) {
+      softTareG = 0.0f;
+    } else if (haveWeight) {
+      softTareG = lastWeight;
+    }
+    tared = true;
+  }
+  if (confirmed) {
+    DEBUG_SCALE_PRINT("Scale %s confirmed after %lu ms (%d attempt%s)", scaleCommandName(current),
+                      (unsigned long)latencyMs, attempts, attempts == 1 ? "" : "s");
+  } else if (current == SCALE_CMD_TARE) {
+    DEBUG_SCALE_PRINT("Scale tare unconfirmed after %d attempts - taring %.1f g in software",
+                      attempts, softTareG);
+  } else {
+    DEBUG_SCALE_PRINT("Scale %s unconfirmed after %d attempts", scaleCommandName(current), attempts);
+  }
+  inFlight = false;
+}
+
+void scaleCommandsUpdate(const ScaleDriver* driver, const float* weight, uint32_t nowMs) {
+  if (weight) {
+    lastWeight = *weight;
+    haveWeight = true;
+  }
+  // Only a packet received after the write can confirm a tare
+  bool packetAfterSend = weight != nullptr;
+
+  for (;;) {
+    bool sentNow = false;
+    if (!inFlight) {
+      if (queueCount == 0) {
+        return;
+      }
+      current = queue[queueHead];
+      queueHead = (queueHead + 1) % SCALE_COMMAND_QUEUE;
+      queueCount--;
+      inFlight = true;
+      attempts = 0;
+      firstSentMs = nowMs;
+      transmit(driver, nowMs);
+      packetAfterSend = false;
+      sentNow = true;
+    }
+
+    bool confirmed = writeAccepted &&
+        (current != SCALE_CMD_TARE ||
+         (packetAfterSend && fabsf(*weight) <= SCALE_TARE_CONFIRM_G));
+    if (confirmed) {
+      finish(true, nowMs);
+      continue;  // Next command right away
+    }
+
+    // A rejected write is retried on the next poll, an unconfirmed one
+    // after the timeout
+    if (!sentNow && (!writeAccepted || nowMs - sentMs >= SCALE_COMMAND_TIMEOUT_MS)) {
+      if (attempts >= SCALE_COMMAND_ATTEMPTS) {
+        finish(false, nowMs);
+        continue;
+      }
+      transmit(driver, nowMs);
+      packetAfterSend = false;
+    }
+    return;
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef SCALE_COMMANDS_H
+#define SCALE_COMMANDS_H
+
+// ============================================================================
+// SCALE COMMAND PIPELINE
+// ============================================================================
+// Commands to the scale (timer, tare) queue here and go out one at a time.
+// A command counts as done only once it is confirmed, and the next one is
+// sent right then, not after a fixed pause:
+//
+//   timer commands  the driver's write was accepted (for the Acaia, the ATT
+//                   write response). AcaiaArduinoBLE reports no timer state,
+//                   so that is the strongest evidence there is.
+//   tare            a weight packet received after the write reads within
+//                   SCALE_TARE_CONFIRM_G of zero
+//
+// A command without confirmation within SCALE_COMMAND_TIMEOUT_MS is sent
+// again, up to SCALE_COMMAND_ATTEMPTS times. If a tare still fails, the
+// weight at that moment is subtracted in software (scaleCommandsSoftTareG)
+// instead, so a shot never runs on untared weights. Weight packets that
+// arrive while a tare is queued or unconfirmed predate it; the scale task
+// keeps them out of the shot trajectory.
+//
+// Everything except scaleCommandStats() belongs to the scale task.
+
+#include <Arduino.h>
+
+#include "scale.h"
+
+enum ScaleCommand {
+  SCALE_CMD_RESET_TIMER,
+  SCALE_CMD_START_TIMER,
+  SCALE_CMD_STOP_TIMER,
+  SCALE_CMD_TARE,
+  SCALE_CMD_COUNT
+};
+
+#define SCALE_COMMAND_QUEUE 8
+#define SCALE_COMMAND_TIMEOUT_MS 500
+#define SCALE_COMMAND_ATTEMPTS 3
+#define SCALE_TARE_CONFIRM_G 0.3f
+
+const char* scaleCommandName(int command);
+
+// Queue a command; false (dropped) if the queue is full
+bool scaleCommandEnqueue(ScaleCommand command);
+
+// Drop queued and in-flight commands and the software tare: the link was
+// (re)established, the scale starts from its own state
+void scaleCommandsReset();
+
+// Run every poll: check the in-flight command against the weight packet
+// received in this poll (nullptr if none), retry or give up on timeout, and
+// send the next command once the previous one is done
+void scaleCommandsUpdate(const ScaleDriver* driver, const float* weight, uint32_t nowMs);
+
+// A tare is queued or awaiting confirmation
+bool scaleCommandsTarePending();
+
+// Weight to subtract from every packet after a failed tare, 0 otherwise
+float scaleCommandsSoftTareG();
+
+// True once per tare that took effect (confirmed or in software) since the
+// last call: the next packet pushed is the first one after it
+bool scaleCommandsTakeTared();
+
+struct ScaleCommandStats {
+  uint32_t confirmed;
+  uint32_t failed;      // Given up after SCALE_COMMAND_ATTEMPTS
+  uint32_t retries;     // Resends after a timeout or a rejected write
+  uint64_t sumMs;       // First send to confirmation, confirmed commands
+  uint32_t lastMs;
+};
+
+// Copy for /metrics (any task)
+void scaleCommandStats(int command, ScaleCommandStats* out);
+
+#endif // SCALE_COMMANDS_H
@@ -3,6 +3,9 @@
 #include <EEPROM.h>
 
 #include "debug.h"
+#include "pid_autotune.h"
+#include "pressure_control.h"
+#include "pressure_profile.h"
 
 // ============================================================================
 // EEPROM LAYOUT
@@ -14,20 +17,278 @@
 #define LEGACY_OFFSET_ADDR 1
 
 #define SETTINGS_ADDR 4  // Blob starts past the legacy bytes
-#define SETTINGS_EEPROM_SIZE 512
-#define SETTINGS_MAGIC 0x45535052u  // "ESPR"
-#define SETTINGS_VERSION 1
+#define SETTINGS_EEPROM_SIZE 4096  // Largest region the ESP32 EEPROM emulation takes
 
-static_assert(SETTINGS_ADDR + sizeof(PersistentSettings) <= SETTINGS_EEPROM_SIZE,
-              "PersistentSettings no longer fits the EEPROM region - grow SETTINGS_EEPROM_SIZE");
+// Since version 9 the blob is a header followed by one record per field:
+//
+//   header  magic "ESPT" (4), version (1), reserved (1), payload length (2)
+//   record  tag (1), value length (2), the field's bytes
+//
+// Integers little endian, values as they sit in PersistentSettings. Loading
+// looks every field up by its tag; a missing record, or one whose length no
+// longer matches the field, leaves the field to its migration (SCHEMA
+// below). Unknown tags are skipped, so a blob written by newer firmware
+// still loads. A new field is a new tag at the end of the payload - the
+// records before it keep their bytes.
+#define SETTINGS_MAGIC 0x45535054u  // "ESPT"
+#define SETTINGS_VERSION 9
+#define SETTINGS_HEADER_SIZE 8
+#define SETTINGS_RECORD_HEADER_SIZE 3
+
+// Versions 1-8 stored the struct raw with EEPROM.put, each version's layout
+// a prefix of the next. Frozen here as version 8 wrote it, so the live
+// struct is free to change. (Should one of the embedded types change shape,
+// freeze a copy of its old form here as well.)
+#define LEGACY_BLOB_MAGIC 0x45535052u  // "ESPR"
+#define LEGACY_BLOB_VERSION_MAX 8
+
+struct LegacySettingsV8 {
+  uint32_t magic;
+  uint8_t version;
+  float goalWeight;
+  float weightOffset;
+  uint8_t numGoalsByTime;
+  uint8_t numGoalsByTimeLeft;
+  PressureGoalByTime goalsByTime[MAX_PRESSURE_GOALS];
+  PressureGoalByTimeLeft goalsByTimeLeft[MAX_PRESSURE_GOALS];
+  CleaningConfig cleaning;
+  char wifiSsid[33];
+  char wifiPassword[65];
+  PumpCalibration pumpCal;                             // Version 2+
+  GoalFlow flowByTime[MAX_PRESSURE_GOALS];             // Version 3+
+  GoalFlow flowByTimeLeft[MAX_PRESSURE_GOALS];
+  uint8_t controlLaw;                                  // Version 4+
+  GoalTransition transitionByTime[MAX_PRESSURE_GOALS]; // Version 5+
+  GoalTransition transitionByTimeLeft[MAX_PRESSURE_GOALS];
+  ProfileLibraryStore library;                         // Version 6+
+  char activeProfile[PROFILE_NAME_MAX];
+  char scaleAddress[18];                               // Version 7+
+  WeightFilterConfig weightFilter;                     // Version 8+
+};
+
+static_assert(SETTINGS_ADDR + sizeof(LegacySettingsV8) <= SETTINGS_EEPROM_SIZE,
+              "Legacy blob must lie within the EEPROM region");
 
 PersistentSettings settings = {};
 
-// settingsSave() is called from both the control task (post-shot offset
-// learning) and the AsyncTCP task (the /set_* handlers); the EEPROM library
-// shares one RAM cache and dirty flag, so serialize the snapshot+commit.
+// The persistence task and settingsFlush() commit; the scale task and the
+// AsyncTCP task write the WiFi/scale address fields in place. The EEPROM
+// library shares one RAM cache and dirty flag, so serialize all of it.
 static SemaphoreHandle_t settingsLock = nullptr;
 
+// settingsSave() only marks the blob dirty and wakes the persistence task
+static SemaphoreHandle_t dirtySignal = nullptr;
+static portMUX_TYPE requestMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool dirty = false;
+static volatile uint32_t lastRequestMs = 0;
+
+// Save requests, commits and their duration, shot-deferred commits since
+// boot (/metrics)
+static uint32_t requestCount = 0;
+static uint32_t commitCount = 0;
+static uint64_t commitTotalUs = 0;
+static uint32_t commitLastUs = 0;
+static uint32_t deferredCount = 0;
+
+// ============================================================================
+// SCHEMA
+// ============================================================================
+// One entry per persisted field, in the order the fields were introduced.
+// A field the stored blob lacks gets its migration, and since the table runs
+// in order a version 1 blob goes through the version 2 migrations, then the
+// version 3 ones, and so on up to the current schema. Tags are never reused;
+// changing a field's type or meaning takes a new tag (the old record is then
+// skipped and the new field migrates). Fields added from version 9 on have
+// no raw layout: legacySize 0.
+
+enum SettingsTag : uint8_t {
+  TAG_GOAL_WEIGHT = 1,
+  TAG_WEIGHT_OFFSET,
+  TAG_NUM_GOALS_BY_TIME,
+  TAG_NUM_GOALS_BY_TIME_LEFT,
+  TAG_GOALS_BY_TIME,
+  TAG_GOALS_BY_TIME_LEFT,
+  TAG_CLEANING,
+  TAG_WIFI_SSID,
+  TAG_WIFI_PASSWORD,
+  TAG_PUMP_CAL,
+  TAG_FLOW_BY_TIME,
+  TAG_FLOW_BY_TIME_LEFT,
+  TAG_CONTROL_LAW,
+  TAG_TRANSITION_BY_TIME,
+  TAG_TRANSITION_BY_TIME_LEFT,
+  TAG_LIBRARY,
+  TAG_ACTIVE_PROFILE,
+  TAG_SCALE_ADDRESS,
+  TAG_WEIGHT_FILTER,
+  TAG_COUNT
+};
+
+// What the migrations derive their values from: the compiled-in defaults,
+// captured before anything overwrites the live state, and which fields the
+// blob did hold
+struct Migration {
+  const CleaningConfig& cleaning;
+  const PressureProfile& profile;
+  int controlLaw;
+  const bool* stored;  // By tag
+};
+
+struct SettingsField {
+  uint8_t tag;
+  uint8_t since;  // Schema version that added it
+  const char* name;
+  uint16_t offset;  // In PersistentSettings
+  uint16_t size;
+  uint16_t legacyOffset;  // In LegacySettingsV8
+  uint16_t legacySize;
+  void (*migrate)(const Migration& m);  // Sets it when the blob lacks it
+};
+
+#define FIELD(tag, since, member, migrate) \
+  { tag, since, #member, offsetof(PersistentSettings, member), sizeof(PersistentSettings::member), \
+    offsetof(LegacySettingsV8, member), sizeof(LegacySettingsV8::member), migrate }
+
+// First blob: the legacy two-byte slots (out-of-range/erased-flash values
+// are caught by validateSettings)
+static void migrateGoalWeight(const Migration& m) {
+  settings.goalWeight = EEPROM.read(LEGACY_WEIGHT_ADDR);
+}
+
+static void migrateWeightOffset(const Migration& m) {
+  settings.weightOffset = EEPROM.read(LEGACY_OFFSET_ADDR) / 10.0f;
+}
+
+static void migrateNumGoalsByTime(const Migration& m) {
+  settings.numGoalsByTime = m.profile.numByTime;
+}
+
+static void migrateNumGoalsByTimeLeft(const Migration& m) {
+  settings.numGoalsByTimeLeft = m.profile.numByTimeLeft;
+}
+
+static void migrateGoalsByTime(const Migration& m) {
+  memcpy(settings.goalsByTime, m.profile.byTime, sizeof(settings.goalsByTime));
+}
+
+static void migrateGoalsByTimeLeft(const Migration& m) {
+  memcpy(settings.goalsByTimeLeft, m.profile.byTimeLeft, sizeof(settings.goalsByTimeLeft));
+}
+
+static void migrateCleaning(const Migration& m) {
+  settings.cleaning = m.cleaning;
+}
+
+// Empty = the compile-time credentials
+static void migrateWifiSsid(const Migration& m) {
+  settings.wifiSsid[0] = '\0';
+}
+
+static void migrateWifiPassword(const Migration& m) {
+  settings.wifiPassword[0] = '\0';
+}
+
+// Version 2: settingsLoad() starts the calibration from the model prior
+static void migratePumpCal(const Migration& m) {
+  memset(&settings.pumpCal, 0, sizeof(settings.pumpCal));
+}
+
+// Version 3: a stored profile stays pressure-only, as the old firmware ran it
+static void migrateFlowByTime(const Migration& m) {
+  if (m.stored[TAG_GOALS_BY_TIME]) {
+    memset(settings.flowByTime, 0, sizeof(settings.flowByTime));
+  } else {
+    memcpy(settings.flowByTime, m.profile.flowByTime, sizeof(settings.flowByTime));
+  }
+}
+
+static void migrateFlowByTimeLeft(const Migration& m) {
+  if (m.stored[TAG_GOALS_BY_TIME_LEFT]) {
+    memset(settings.flowByTimeLeft, 0, sizeof(settings.flowByTimeLeft));
+  } else {
+    memcpy(settings.flowByTimeLeft, m.profile.flowByTimeLeft, sizeof(settings.flowByTimeLeft));
+  }
+}
+
+// Version 4
+static void migrateControlLaw(const Migration& m) {
+  settings.controlLaw = m.controlLaw;
+}
+
+// Version 5: every goal of a stored profile a hold, so it keeps stepping as
+// it always did
+static void migrateTransitionByTime(const Migration& m) {
+  if (m.stored[TAG_GOALS_BY_TIME]) {
+    memset(settings.transitionByTime, 0, sizeof(settings.transitionByTime));
+  } else {
+    memcpy(settings.transitionByTime, m.profile.transitionByTime, sizeof(settings.transitionByTime));
+  }
+}
+
+static void migrateTransitionByTimeLeft(const Migration& m) {
+  if (m.stored[TAG_GOALS_BY_TIME_LEFT]) {
+    memset(settings.transitionByTimeLeft, 0, sizeof(settings.transitionByTimeLeft));
+  } else {
+    memcpy(settings.transitionByTimeLeft, m.profile.transitionByTimeLeft,
+           sizeof(settings.transitionByTimeLeft));
+  }
+}
+
+// Version 6: no named profiles yet; the stored profile runs as a custom one
+static void migrateLibrary(const Migration& m) {
+  memset(&settings.library, 0, sizeof(settings.library));
+}
+
+static void migrateActiveProfile(const Migration& m) {
+  settings.activeProfile[0] = '\0';
+}
+
+// Version 7: the first connect scans as before
+static void migrateScaleAddress(const Migration& m) {
+  settings.scaleAddress[0] = '\0';
+}
+
+// Version 8
+static void migrateWeightFilter(const Migration& m) {
+  settings.weightFilter = WEIGHT_FILTER_DEFAULTS;
+}
+
+static const SettingsField FIELDS[] = {
+  FIELD(TAG_GOAL_WEIGHT,             1, goalWeight,           migrateGoalWeight),
+  FIELD(TAG_WEIGHT_OFFSET,           1, weightOffset,         migrateWeightOffset),
+  FIELD(TAG_NUM_GOALS_BY_TIME,       1, numGoalsByTime,       migrateNumGoalsByTime),
+  FIELD(TAG_NUM_GOALS_BY_TIME_LEFT,  1, numGoalsByTimeLeft,   migrateNumGoalsByTimeLeft),
+  FIELD(TAG_GOALS_BY_TIME,           1, goalsByTime,          migrateGoalsByTime),
+  FIELD(TAG_GOALS_BY_TIME_LEFT,      1, goalsByTimeLeft,      migrateGoalsByTimeLeft),
+  FIELD(TAG_CLEANING,                1, cleaning,             migrateCleaning),
+  FIELD(TAG_WIFI_SSID,               1, wifiSsid,             migrateWifiSsid),
+  FIELD(TAG_WIFI_PASSWORD,           1, wifiPassword,         migrateWifiPassword),
+  FIELD(TAG_PUMP_CAL,                2, pumpCal,              migratePumpCal),
+  FIELD(TAG_FLOW_BY_TIME,            3, flowByTime,           migrateFlowByTime),
+  FIELD(TAG_FLOW_BY_TIME_LEFT,       3, flowByTimeLeft,       migrateFlowByTimeLeft),
+  FIELD(TAG_CONTROL_LAW,             4, controlLaw,           migrateControlLaw),
+  FIELD(TAG_TRANSITION_BY_TIME,      5, transitionByTime,     migrateTransitionByTime),
+  FIELD(TAG_TRANSITION_BY_TIME_LEFT, 5, transitionByTimeLeft, migrateTransitionByTimeLeft),
+  FIELD(TAG_LIBRARY,                 6, library,              migrateLibrary),
+  FIELD(TAG_ACTIVE_PROFILE,          6, activeProfile,        migrateActiveProfile),
+  FIELD(TAG_SCALE_ADDRESS,           7, scaleAddress,         migrateScaleAddress),
+  FIELD(TAG_WEIGHT_FILTER,           8, weightFilter,         migrateWeightFilter),
+};
+#define FIELD_COUNT (int)(sizeof(FIELDS) / sizeof(FIELDS[0]))
+
+static_assert(SETTINGS_ADDR + SETTINGS_HEADER_SIZE + sizeof(PersistentSettings)
+                  + (TAG_COUNT - 1) * SETTINGS_RECORD_HEADER_SIZE <= SETTINGS_EEPROM_SIZE,
+              "PersistentSettings no longer fits the EEPROM region - grow SETTINGS_EEPROM_SIZE");
+
+static const SettingsField* fieldByTag(uint8_t tag) {
+  for (const SettingsField& f : FIELDS) {
+    if (f.tag == tag) {
+      return &f;
+    }
+  }
+  return nullptr;
+}
+
 // ============================================================================
 // VALIDATION
 // ============================================================================
@@ -40,7 +301,8 @@ static bool inRange(float v, float lo, float hi) {
 // the magic check and out-of-range legacy migration values). Ranges mirror
 // the /set_* handlers; cleaning fields fall back to the compiled-in defaults
 // still present in cleaningConfig when this runs during boot.
-static void validateSettings(const CleaningConfig& cleaningDefaults) {
+static void validateSettings(const CleaningConfig& cleaningDefaults,
+                             const PressureProfile& profileDefault, int controlLawDefault) {
   if (!inRange(settings.goalWeight, 10, 200)) {
     settings.goalWeight = 36;
     DEBUG_STARTUP_PRINT("Goal weight out of range, set to default: 36 g");
@@ -50,11 +312,29 @@ static void validateSettings(const CleaningConfig& cleaningDefaults) {
     DEBUG_STARTUP_PRINT("Offset out of range, set to default: 1.5 g");
   }
 
-  if (settings.numGoalsByTime > MAX_PRESSURE_GOALS) {
-    settings.numGoalsByTime = 0;
-  }
-  if (settings.numGoalsByTimeLeft > MAX_PRESSURE_GOALS) {
-    settings.numGoalsByTimeLeft = 0;
+  // Same rules as web input; an invalid stored profile falls back whole to
+  // the compiled-in one rather than being patched goal by goal
+  PressureProfile stored;
+  stored.numByTime = settings.numGoalsByTime;
+  stored.numByTimeLeft = settings.numGoalsByTimeLeft;
+  memcpy(stored.byTime, settings.goalsByTime, sizeof(stored.byTime));
+  memcpy(stored.byTimeLeft, settings.goalsByTimeLeft, sizeof(stored.byTimeLeft));
+  memcpy(stored.flowByTime, settings.flowByTime, sizeof(stored.flowByTime));
+  memcpy(stored.flowByTimeLeft, settings.flowByTimeLeft, sizeof(stored.flowByTimeLeft));
+  memcpy(stored.transitionByTime, settings.transitionByTime, sizeof(stored.transitionByTime));
+  memcpy(stored.transitionByTimeLeft, settings.transitionByTimeLeft, sizeof(stored.transitionByTimeLeft));
+  const char* profileError = profileValidate(stored);
+  if (profileError) {
+    DEBUG_STARTUP_PRINT("Stored pressure profile invalid (%s), set to default", profileError);
+    settings.numGoalsByTime = profileDefault.numByTime;
+    settings.numGoalsByTimeLeft = profileDefault.numByTimeLeft;
+    memcpy(settings.goalsByTime, profileDefault.byTime, sizeof(settings.goalsByTime));
+    memcpy(settings.goalsByTimeLeft, profileDefault.byTimeLeft, sizeof(settings.goalsByTimeLeft));
+    memcpy(settings.flowByTime, profileDefault.flowByTime, sizeof(settings.flowByTime));
+    memcpy(settings.flowByTimeLeft, profileDefault.flowByTimeLeft, sizeof(settings.flowByTimeLeft));
+    memcpy(settings.transitionByTime, profileDefault.transitionByTime, sizeof(settings.transitionByTime));
+    memcpy(settings.transitionByTimeLeft, profileDefault.transitionByTimeLeft,
+           sizeof(settings.transitionByTimeLeft));
   }
 
   CleaningConfig& c = settings.cleaning;
@@ -66,50 +346,160 @@ static void validateSettings(const CleaningConfig& cleaningDefaults) {
   if (!inRange(c.soakS, 0, 600))              c.soakS = cleaningDefaults.soakS;
   if (!inRange(c.awaitUserTimeoutS, 30, 3600)) c.awaitUserTimeoutS = cleaningDefaults.awaitUserTimeoutS;
 
+  if (!pressureControlLaw(settings.controlLaw)) {
+    settings.controlLaw = controlLawDefault;
+  }
+
+  if (weightFilterValidate(settings.weightFilter)) {
+    settings.weightFilter = WEIGHT_FILTER_DEFAULTS;
+  }
+
   // A truncated/corrupted blob must never yield unterminated strings
   settings.wifiSsid[sizeof(settings.wifiSsid) - 1] = '\0';
   settings.wifiPassword[sizeof(settings.wifiPassword) - 1] = '\0';
+  settings.scaleAddress[sizeof(settings.scaleAddress) - 1] = '\0';
 }
 
 // ============================================================================
 // LOAD / SAVE
 // ============================================================================
 
+static uint16_t readU16(int addr) {
+  return EEPROM.read(addr) | (uint16_t)EEPROM.read(addr + 1) << 8;
+}
+
+static uint32_t readU32(int addr) {
+  return readU16(addr) | (uint32_t)readU16(addr + 2) << 16;
+}
+
+static void writeU16(int addr, uint16_t v) {
+  EEPROM.write(addr, v & 0xFF);
+  EEPROM.write(addr + 1, v >> 8);
+}
+
+static void writeU32(int addr, uint32_t v) {
+  writeU16(addr, v & 0xFFFF);
+  writeU16(addr + 2, v >> 16);
+}
+
+static void readBytes(int addr, void* dst, size_t len) {
+  uint8_t* d = (uint8_t*)dst;
+  for (size_t i = 0; i < len; i++) {
+    d[i] = EEPROM.read(addr + i);
+  }
+}
+
+static void writeBytes(int addr, const void* src, size_t len) {
+  const uint8_t* s = (const uint8_t*)src;
+  for (size_t i = 0; i < len; i++) {
+    EEPROM.write(addr + i, s[i]);
+  }
+}
+
+// Fields of a record blob into settings, marking them in stored. Returns the
+// blob's version, 0 if there is none.
+static int loadRecords(bool* stored) {
+  if (readU32(SETTINGS_ADDR) != SETTINGS_MAGIC) {
+    return 0;
+  }
+  int version = EEPROM.read(SETTINGS_ADDR + 4);
+  int pos = SETTINGS_ADDR + SETTINGS_HEADER_SIZE;
+  int end = pos + readU16(SETTINGS_ADDR + 6);
+  if (version == 0 || end > SETTINGS_EEPROM_SIZE) {
+    return 0;
+  }
+  while (pos + SETTINGS_RECORD_HEADER_SIZE <= end) {
+    uint8_t tag = EEPROM.read(pos);
+    int len = readU16(pos + 1);
+    pos += SETTINGS_RECORD_HEADER_SIZE;
+    if (pos + len > end) {
+      break;  // Truncated: the fields from here on migrate
+    }
+    const SettingsField* f = fieldByTag(tag);
+    if (f && len == f->size) {
+      readBytes(pos, (uint8_t*)&settings + f->offset, len);
+      stored[tag] = true;
+    }
+    pos += len;
+  }
+  return version;
+}
+
+// Fields of a raw version 1-8 blob into settings: those its version had
+static int loadLegacy(bool* stored) {
+  uint32_t magic = readU32(SETTINGS_ADDR + offsetof(LegacySettingsV8, magic));
+  int version = EEPROM.read(SETTINGS_ADDR + offsetof(LegacySettingsV8, version));
+  if (magic != LEGACY_BLOB_MAGIC || version < 1 || version > LEGACY_BLOB_VERSION_MAX) {
+    return 0;
+  }
+  for (const SettingsField& f : FIELDS) {
+    if (f.since <= version && f.legacySize == f.size) {
+      readBytes(SETTINGS_ADDR + f.legacyOffset, (uint8_t*)&settings + f.offset, f.size);
+      stored[f.tag] = true;
+    }
+  }
+  return version;
+}
+
 // Write the blob without touching the live state; callers hold settingsLock
-// (or run single-threaded during setup). EEPROM.commit() only hits flash if
-// a byte actually changed, so calling this on every boot costs nothing.
+// (or run single-threaded during setup). EEPROM.write() only marks bytes
+// that differ and EEPROM.commit() only hits flash if one did, so calling
+// this on every boot costs nothing. Records of tags this firmware doesn't
+// know are not carried over.
 static void commitBlob() {
-  settings.magic = SETTINGS_MAGIC;
-  settings.version = SETTINGS_VERSION;
-  EEPROM.put(SETTINGS_ADDR, settings);
+  int start = SETTINGS_ADDR + SETTINGS_HEADER_SIZE;
+  int pos = start;
+  for (const SettingsField& f : FIELDS) {
+    EEPROM.write(pos, f.tag);
+    writeU16(pos + 1, f.size);
+    writeBytes(pos + SETTINGS_RECORD_HEADER_SIZE, (const uint8_t*)&settings + f.offset, f.size);
+    pos += SETTINGS_RECORD_HEADER_SIZE + f.size;
+  }
+  writeU32(SETTINGS_ADDR, SETTINGS_MAGIC);
+  EEPROM.write(SETTINGS_ADDR + 4, SETTINGS_VERSION);
+  EEPROM.write(SETTINGS_ADDR + 5, 0);
+  writeU16(SETTINGS_ADDR + 6, pos - start);
+  uint32_t startUs = micros();
   EEPROM.commit();
+  commitLastUs = micros() - startUs;
+  commitTotalUs += commitLastUs;
+  commitCount++;
 }
 
 void settingsLoad() {
   settingsLock = xSemaphoreCreateMutex();
+  dirtySignal = xSemaphoreCreateBinary();
   EEPROM.begin(SETTINGS_EEPROM_SIZE);
 
   // Compiled-in defaults, captured before anything overwrites the live state
   const CleaningConfig cleaningDefaults = cleaningConfig;
+  PressureProfile profileDefault;
+  profileSnapshot(&profileDefault);
+  const int controlLawDefault = pressureControlSelected;
 
-  EEPROM.get(SETTINGS_ADDR, settings);
-  if (settings.magic != SETTINGS_MAGIC || settings.version != SETTINGS_VERSION) {
-    // First boot with this layout: seed from the legacy two-byte slots (their
-    // out-of-range/erased-flash values are caught by validateSettings) and
-    // the compiled-in defaults for everything the old layout never stored
+  bool stored[TAG_COUNT] = {};
+  int version = loadRecords(stored);
+  if (version == 0) {
+    version = loadLegacy(stored);
+  }
+  if (version == 0) {
     DEBUG_STARTUP_PRINT("No settings blob found - migrating legacy EEPROM values and defaults");
-    settings.goalWeight = EEPROM.read(LEGACY_WEIGHT_ADDR);
-    settings.weightOffset = EEPROM.read(LEGACY_OFFSET_ADDR) / 10.0f;
-    settings.numGoalsByTime = shot.numPressureGoalsByTime;
-    settings.numGoalsByTimeLeft = shot.numPressureGoalsByTimeLeft;
-    memcpy(settings.goalsByTime, shot.pressureGoalByTime, sizeof(settings.goalsByTime));
-    memcpy(settings.goalsByTimeLeft, shot.pressureGoalByTimeLeft, sizeof(settings.goalsByTimeLeft));
-    settings.cleaning = cleaningDefaults;
-    settings.wifiSsid[0] = '\0';
-    settings.wifiPassword[0] = '\0';
+  } else if (version != SETTINGS_VERSION) {
+    DEBUG_STARTUP_PRINT("Settings blob v%d, schema v%d - migrating", version, SETTINGS_VERSION);
   }
 
-  validateSettings(cleaningDefaults);
+  // Chained in the order the fields were introduced
+  const Migration migration = { cleaningDefaults, profileDefault, controlLawDefault, stored };
+  for (const SettingsField& f : FIELDS) {
+    if (!stored[f.tag]) {
+      if (version != 0) {
+        DEBUG_STARTUP_PRINT("Settings field %s (v%d) not stored - migrating", f.name, f.since);
+      }
+      f.migrate(migration);
+    }
+  }
+
+  validateSettings(cleaningDefaults, profileDefault, controlLawDefault);
 
   // Apply to the live state (tasks aren't running yet, no locking needed)
   shot.goalWeight = settings.goalWeight;
@@ -118,41 +508,158 @@ void settingsLoad() {
   shot.numPressureGoalsByTimeLeft = settings.numGoalsByTimeLeft;
   memcpy(shot.pressureGoalByTime, settings.goalsByTime, sizeof(shot.pressureGoalByTime));
   memcpy(shot.pressureGoalByTimeLeft, settings.goalsByTimeLeft, sizeof(shot.pressureGoalByTimeLeft));
+  memcpy(shot.flowGoalByTime, settings.flowByTime, sizeof(shot.flowGoalByTime));
+  memcpy(shot.flowGoalByTimeLeft, settings.flowByTimeLeft, sizeof(shot.flowGoalByTimeLeft));
+  memcpy(shot.transitionByTime, settings.transitionByTime, sizeof(shot.transitionByTime));
+  memcpy(shot.transitionByTimeLeft, settings.transitionByTimeLeft, sizeof(shot.transitionByTimeLeft));
   cleaningConfig = settings.cleaning;
+  pressureControlSelected = settings.controlLaw;
+  // Falls back to the model prior itself if the stored state is invalid
+  pumpCalibrationInit(stored[TAG_PUMP_CAL] ? &settings.pumpCal : nullptr);
+  pumpCalibrationSnapshot(&settings.pumpCal);
+  // Drops entries that no longer decode; applies the active one over the
+  // profile above (normally identical to it)
+  settings.activeProfile[PROFILE_NAME_MAX - 1] = '\0';
+  profileLibraryInit(&settings.library, settings.activeProfile);
+  profileLibrarySnapshot(&settings.library, settings.activeProfile);
+  scaleFilterConfigure(settings.weightFilter);
 
   // Persist migration/sanitization results (no-op flash-wise if unchanged)
   commitBlob();
 
-  DEBUG_STARTUP_PRINT("Settings loaded: goal %.0f g, offset %.1f g, profile %d+%d goals, WiFi '%s'",
+  DEBUG_STARTUP_PRINT("Settings loaded: goal %.0f g, offset %.1f g, profile %d+%d goals, WiFi '%s', pump calibration %d windows, %s control",
                       settings.goalWeight, settings.weightOffset,
                       settings.numGoalsByTime, settings.numGoalsByTimeLeft,
-                      settings.wifiSsid[0] ? settings.wifiSsid : "(compile-time)");
+                      settings.wifiSsid[0] ? settings.wifiSsid : "(compile-time)",
+                      settings.pumpCal.samples, pressureControlLawName(settings.controlLaw));
 }
 
-void settingsSave() {
+// Snapshot the live state and commit, if anything is pending
+static void commitPending() {
   if (settingsLock && xSemaphoreTake(settingsLock, pdMS_TO_TICKS(500)) != pdTRUE) {
-    DEBUG_STARTUP_PRINT("Settings save skipped - lock timeout");
+    DEBUG_STARTUP_PRINT("Settings commit postponed - lock timeout");
+    xSemaphoreGive(dirtySignal);  // Still dirty: next round
     return;
   }
+  if (dirty) {
+    // Cleared before the snapshot: a request arriving during it commits again
+    dirty = false;
+    settings.goalWeight = shot.goalWeight;
+    settings.weightOffset = shot.weightOffset;
+    PressureProfile profile;
+    profileSnapshot(&profile);  // Consistent copy even mid-swap
+    settings.numGoalsByTime = profile.numByTime;
+    settings.numGoalsByTimeLeft = profile.numByTimeLeft;
+    memcpy(settings.goalsByTime, profile.byTime, sizeof(settings.goalsByTime));
+    memcpy(settings.goalsByTimeLeft, profile.byTimeLeft, sizeof(settings.goalsByTimeLeft));
+    memcpy(settings.flowByTime, profile.flowByTime, sizeof(settings.flowByTime));
+    memcpy(settings.flowByTimeLeft, profile.flowByTimeLeft, sizeof(settings.flowByTimeLeft));
+    memcpy(settings.transitionByTime, profile.transitionByTime, sizeof(settings.transitionByTime));
+    memcpy(settings.transitionByTimeLeft, profile.transitionByTimeLeft, sizeof(settings.transitionByTimeLeft));
+    settings.cleaning = cleaningConfig;
+    pumpCalibrationSnapshot(&settings.pumpCal);
+    settings.controlLaw = pressureControlSelected;
+    profileLibrarySnapshot(&settings.library, settings.activeProfile);
+    scaleFilterConfig(&settings.weightFilter);
+    commitBlob();
+  }
 
-  settings.goalWeight = shot.goalWeight;
-  settings.weightOffset = shot.weightOffset;
-  settings.numGoalsByTime = shot.numPressureGoalsByTime;
-  settings.numGoalsByTimeLeft = shot.numPressureGoalsByTimeLeft;
-  memcpy(settings.goalsByTime, shot.pressureGoalByTime, sizeof(settings.goalsByTime));
-  memcpy(settings.goalsByTimeLeft, shot.pressureGoalByTimeLeft, sizeof(settings.goalsByTimeLeft));
-  settings.cleaning = cleaningConfig;
-  commitBlob();
+  if (settingsLock) {
+    xSemaphoreGive(settingsLock);
+  }
+}
 
+void settingsSave() {
+  portENTER_CRITICAL(&requestMux);
+  lastRequestMs = millis();
+  dirty = true;
+  requestCount++;
+  portEXIT_CRITICAL(&requestMux);
+  if (dirtySignal) {
+    xSemaphoreGive(dirtySignal);
+  }
+}
+
+void settingsFlush() {
+  commitPending();
+}
+
+// A commit stalls the flash cache - and with it everything not in IRAM -
+// for tens of ms; not while the pump is under control
+static bool machineBusy() {
+  return shot.brewing || cleaningActive() || autotuneActive();
+}
+
+void settingsTask(void* param) {
+  for (;;) {
+    xSemaphoreTake(dirtySignal, portMAX_DELAY);
+
+    // Coalesce: wait until requests stop for SETTINGS_DEBOUNCE_MS (a slider
+    // being dragged), but no longer than SETTINGS_MAX_DEFER_MS in total
+    uint32_t firstMs = millis();
+    while (millis() - lastRequestMs < SETTINGS_DEBOUNCE_MS
+           && millis() - firstMs < SETTINGS_MAX_DEFER_MS) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    if (machineBusy()) {
+      deferredCount++;
+      DEBUG_STARTUP_PRINT("Settings commit deferred until the shot/cycle ends");
+      while (machineBusy()) {
+        vTaskDelay(pdMS_TO_TICKS(250));
+      }
+    }
+    commitPending();
+  }
+}
+
+uint32_t settingsCommitCount() {
+  return commitCount;
+}
+
+float settingsCommitTotalS() {
+  return commitTotalUs / 1e6f;
+}
+
+float settingsCommitLastS() {
+  return commitLastUs / 1e6f;
+}
+
+uint32_t settingsSaveRequestCount() {
+  return requestCount;
+}
+
+uint32_t settingsDeferredCount() {
+  return deferredCount;
+}
+
+bool settingsPending() {
+  return dirty;
+}
+
+// Written in place, under the lock so no commit copies them half-written
+static void setString(char* field, const char* value, size_t size) {
+  if (settingsLock) {
+    xSemaphoreTake(settingsLock, portMAX_DELAY);
+  }
+  strlcpy(field, value, size);
   if (settingsLock) {
     xSemaphoreGive(settingsLock);
   }
 }
 
 void settingsSetWifi(const char* newSsid, const char* newPass) {
-  strlcpy(settings.wifiSsid, newSsid, sizeof(settings.wifiSsid));
-  strlcpy(settings.wifiPassword, newPass, sizeof(settings.wifiPassword));
+  setString(settings.wifiSsid, newSsid, sizeof(settings.wifiSsid));
+  setString(settings.wifiPassword, newPass, sizeof(settings.wifiPassword));
   settingsSave();
   DEBUG_STARTUP_PRINT("WiFi credentials stored for '%s' (used on next boot)",
                       settings.wifiSsid[0] ? settings.wifiSsid : "(compile-time)");
 }
+
+void settingsSetScaleAddress(const char* address) {
+  if (strcmp(settings.scaleAddress, address) == 0) {
+    return;
+  }
+  setString(settings.scaleAddress, address, sizeof(settings.scaleAddress));
+  settingsSave();
+  DEBUG_STARTUP_PRINT("Scale address %s stored for fast reconnects", settings.scaleAddress);
+}
@@ -5,25 +5,33 @@
 // PERSISTENT SETTINGS (EEPROM)
 // ============================================================================
 // One versioned blob holding everything that should survive a reboot:
-// goal weight, learned weight offset, the pressure profile, the cleaning
-// cycle configuration and optional WiFi credentials. Stored with EEPROM.put
-// at SETTINGS_ADDR; the two legacy single-byte slots (goal weight at byte 0,
-// offset x10 at byte 1) are read once for migration when no blob exists yet.
+// goal weight, learned weight offset, the pressure/flow profile, the cleaning
+// cycle configuration, optional WiFi credentials, the learned pump
+// calibration, the selected pressure control law, the named profile
+// library, the last connected scale's address and the weight sanitizer
+// config. Stored at SETTINGS_ADDR as one tagged record per field (layout
+// and schema registry in settings.cpp); blobs of every earlier version -
+// raw struct dumps up to version 8, and the two legacy single-byte slots
+// (goal weight at byte 0, offset x10 at byte 1) before that - migrate
+// forward at boot, field by field.
 //
 // settingsLoad() runs in setup() before the FreeRTOS tasks start: it reads
 // and validates the blob (or migrates/derives defaults) and applies it to the
-// live state (shot, cleaningConfig). settingsSave() snapshots the live state
-// back into the blob and commits - call it after any change worth keeping.
+// live state (shot, cleaningConfig). settingsSave() has the live state
+// written back - call it after any change worth keeping; the persistence
+// task decides when.
 
 #include <Arduino.h>
 
 #include "cleaning_cycle.h"
+#include "profile_library.h"
+#include "pump_calibration.h"
 #include "shot_stopper.h"
 
+// A new field needs an entry (new tag, migration) in the schema registry
+// in settings.cpp; so does a field whose type changes. The version notes
+// are the schema version that added each field.
 struct PersistentSettings {
-  uint32_t magic;    // SETTINGS_MAGIC when the blob is valid
-  uint8_t version;   // Bump on any layout change (no cross-version migration)
-
   // Brewing
   float goalWeight;
   float weightOffset;
@@ -42,25 +50,81 @@ struct PersistentSettings {
   // whose ssid/password macros would clobber these field names)
   char wifiSsid[33];      // 32 chars max per 802.11 + NUL
   char wifiPassword[65];  // 64 chars max WPA2 passphrase + NUL
+
+  // Learned flow-per-click curve (version 2+)
+  PumpCalibration pumpCal;
+
+  // Flow side of the profile goals, same indices as goalsByTime /
+  // goalsByTimeLeft (version 3+)
+  GoalFlow flowByTime[MAX_PRESSURE_GOALS];
+  GoalFlow flowByTimeLeft[MAX_PRESSURE_GOALS];
+
+  // PRESSURE_CONTROL_* for new shots (version 4+)
+  uint8_t controlLaw;
+
+  // How each profile goal takes over, same indices as goalsByTime /
+  // goalsByTimeLeft (version 5+)
+  GoalTransition transitionByTime[MAX_PRESSURE_GOALS];
+  GoalTransition transitionByTimeLeft[MAX_PRESSURE_GOALS];
+
+  // Named profiles as compiled tables, and the one selected ("" = the
+  // profile above is a custom one) (version 6+)
+  ProfileLibraryStore library;
+  char activeProfile[PROFILE_NAME_MAX];
+
+  // BLE address of the last connected scale, "aa:bb:cc:dd:ee:ff"; empty =
+  // none yet (reconnects try it before scanning) (version 7+)
+  char scaleAddress[18];
+
+  // Weight sanitizer between the scale and the shot trajectory (version 8+)
+  WeightFilterConfig weightFilter;
 };
 
 // The persisted state. WiFi fields are authoritative here; everything else
 // is a snapshot of the live state taken by settingsSave().
 extern PersistentSettings settings;
 
-// Read + validate the blob from EEPROM (migrating the legacy two-byte layout
-// if none exists) and apply it to shot and cleaningConfig. Call once in
+// Read + validate the blob from EEPROM (migrating older versions and the
+// legacy two-byte layout) and apply it to shot and cleaningConfig. Call once in
 // setup(), before the control task starts.
 void settingsLoad();
 
-// Snapshot live state (shot goals/profile, cleaningConfig) into the blob and
-// commit to EEPROM. Safe to call from any task (internally serialized).
+// Persistence: settingsSave() marks the blob dirty and returns at once.
+// The persistence task (settingsTask, low priority) snapshots the live state
+// (shot goals/profile, cleaningConfig, pump calibration, selected control
+// law, profile library, weight filter) and commits once requests have been
+// quiet for SETTINGS_DEBOUNCE_MS - a burst of /set_* calls is one commit -
+// and never while a shot, cleaning cycle or autotune runs: the commit
+// stalls the flash cache. Any task.
+#define SETTINGS_DEBOUNCE_MS 2000
+#define SETTINGS_MAX_DEFER_MS 10000  // Longest a steady stream of requests waits
 void settingsSave();
 
+// Commit anything pending now, whatever the machine is doing (before a
+// reboot). Blocks for the commit.
+void settingsFlush();
+
+// Persistence task body; started by setup() after settingsLoad()
+void settingsTask(void* param);
+
+// Since boot: save requests, EEPROM commits, the time spent in them, the
+// last one's duration and commits held back by a running shot/cycle;
+// whether a commit is pending (/metrics)
+uint32_t settingsSaveRequestCount();
+uint32_t settingsCommitCount();
+float settingsCommitTotalS();
+float settingsCommitLastS();
+uint32_t settingsDeferredCount();
+bool settingsPending();
+
 // Store new WiFi credentials (applied on next boot). Empty SSID reverts to
 // the compile-time secrets.h credentials. Parameter names must not be
 // ssid/password: secrets.h defines those as macros and webserver.cpp
 // includes both headers.
 void settingsSetWifi(const char* newSsid, const char* newPass);
 
+// Remember the scale's BLE address (scale task, after a discovery scan);
+// commits only if it changed
+void settingsSetScaleAddress(const char* address);
+
 #endif // SETTINGS_H
@@ -11,17 +11,50 @@ SemaphoreHandle_t shotHistoryLock = nullptr;
 
 static uint32_t nextShotId = 1;
 
+static volatile uint32_t lockContended = 0;
+static volatile uint32_t lockTimeouts = 0;
+
 void initShotHistory() {
   shotHistoryLock = xSemaphoreCreateMutex();
 }
 
+bool shotHistoryLockTake(TickType_t timeout) {
+  if (!shotHistoryLock) {
+    return true;
+  }
+  if (xSemaphoreTake(shotHistoryLock, 0) == pdTRUE) {
+    return true;
+  }
+  lockContended++;
+  if (xSemaphoreTake(shotHistoryLock, timeout) == pdTRUE) {
+    return true;
+  }
+  lockTimeouts++;
+  return false;
+}
+
+void shotHistoryLockGive() {
+  if (shotHistoryLock) {
+    xSemaphoreGive(shotHistoryLock);
+  }
+}
+
+uint32_t shotHistoryLockContended() {
+  return lockContended;
+}
+
+uint32_t shotHistoryLockTimeouts() {
+  return lockTimeouts;
+}
+
 void recordShot(const float* timeS, const float* weight, const float* pressure,
-                int datapoints, float durationS, float peakPressure, int endReason) {
+                int datapoints, float durationS, float peakPressure, int endReason,
+                int controlLaw, const ControlScore& control, const char* profileName) {
   if (datapoints <= 0) {
     return;
   }
 
-  if (shotHistoryLock && xSemaphoreTake(shotHistoryLock, pdMS_TO_TICKS(100)) != pdTRUE) {
+  if (!shotHistoryLockTake(pdMS_TO_TICKS(100))) {
     DEBUG_SHOT_PRINT("Shot history lock busy - shot not recorded");
     return;
   }
@@ -33,6 +66,9 @@ void recordShot(const float* timeS, const float* weight, const float* pressure,
   rec.finalWeight = weight[datapoints - 1];
   rec.peakPressure = peakPressure;
   rec.endReason = endReason;
+  rec.controlLaw = controlLaw;
+  rec.control = control;
+  strlcpy(rec.profileName, profileName, sizeof(rec.profileName));
 
   // Downsample by stride, always keeping the last point
   int stride = (datapoints + HISTORY_MAX_POINTS - 1) / HISTORY_MAX_POINTS;
@@ -58,11 +94,10 @@ void recordShot(const float* timeS, const float* weight, const float* pressure,
     shotHistoryCount++;
   }
 
-  if (shotHistoryLock) {
-    xSemaphoreGive(shotHistoryLock);
-  }
+  shotHistoryLockGive();
 
-  DEBUG_SHOT_PRINT("Shot #%lu recorded to history (%d points, %.1f g, %.1f s, peak %.1f bar)",
+  DEBUG_SHOT_PRINT("Shot #%lu recorded to history (%d points, %.1f g, %.1f s, peak %.1f bar, %s: IAE %.2f bar*s)",
                    (unsigned long)rec.id, rec.numPoints, rec.finalWeight,
-                   rec.durationS, rec.peakPressure);
+                   rec.durationS, rec.peakPressure,
+                   pressureControlLawName(rec.controlLaw), rec.control.iaeBarS);
 }
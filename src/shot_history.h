@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 
+#include "pressure_control.h"
+#include "profile_library.h"
+
 // ============================================================================
 // SHOT HISTORY (RAM-only ring buffer)
 // ============================================================================
@@ -22,6 +25,9 @@ struct ShotRecord {
   float finalWeight;                  // Weight at shot stop (before drip)
   float peakPressure;                 // Highest pressure seen during the shot
   int endReason;                      // EndType cast to int (BUTTON/WEIGHT/TIME/UNDEF)
+  int controlLaw;                     // PRESSURE_CONTROL_* that ran the shot
+  ControlScore control;               // How well it tracked the profile
+  char profileName[PROFILE_NAME_MAX]; // Library profile that ran, "" = custom
   int numPoints;                      // Valid points in the arrays below
   float timeS[HISTORY_MAX_POINTS];    // Downsampled time axis
   float weight[HISTORY_MAX_POINTS];   // Downsampled weight trajectory
@@ -38,9 +44,18 @@ extern SemaphoreHandle_t shotHistoryLock;
 
 void initShotHistory();
 
+// Take/give shotHistoryLock (no-ops before initShotHistory()). Takes that
+// had to wait and takes that timed out are counted for /metrics.
+bool shotHistoryLockTake(TickType_t timeout);
+void shotHistoryLockGive();
+uint32_t shotHistoryLockContended();
+uint32_t shotHistoryLockTimeouts();
+
 // Snapshot + downsample a finished shot's trajectory into the ring buffer.
-// endReason is the EndType value at shot end (before it gets reset).
+// endReason is the EndType value at shot end (before it gets reset);
+// profileName the library profile in force ("" = custom).
 void recordShot(const float* timeS, const float* weight, const float* pressure,
-                int datapoints, float durationS, float peakPressure, int endReason);
+                int datapoints, float durationS, float peakPressure, int endReason,
+                int controlLaw, const ControlScore& control, const char* profileName);
 
 #endif // SHOT_HISTORY_H
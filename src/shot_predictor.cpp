@@ -0,0 +1,135 @@
+#include "shot_predictor.h"
+
+#include <math.h>
+#include <string.h>
+
+// Benchmark time step: the scale task's poll period, which is where the
+// firmware stamps packets
+static const float BENCHMARK_STEP_S = 0.005f;
+
+bool predictEndTime(const float* timeS, const float* weight, int datapoints,
+                    float targetWeight, float* endS) {
+  if (datapoints < TREND_LINE_DATAPOINTS || weight[datapoints - 1] < PREDICTOR_MIN_WEIGHT_G) {
+    return false;
+  }
+
+  float sumXY = 0, sumX = 0, sumY = 0, sumSquaredX = 0;
+  for (int i = datapoints - TREND_LINE_DATAPOINTS; i < datapoints; i++) {
+    sumXY += timeS[i] * weight[i];
+    sumX += timeS[i];
+    sumY += weight[i];
+    sumSquaredX += timeS[i] * timeS[i];
+  }
+
+  float m = (TREND_LINE_DATAPOINTS * sumXY - sumX * sumY)
+            / (TREND_LINE_DATAPOINTS * sumSquaredX - sumX * sumX);
+  float meanX = sumX / TREND_LINE_DATAPOINTS;
+  float meanY = sumY / TREND_LINE_DATAPOINTS;
+  float b = meanY - m * meanX;
+
+  // Time at which the target weight will be reached: x = (y - b) / m
+  *endS = (targetWeight - b) / m;
+  return true;
+}
+
+// ============================================================================
+// OFFLINE BENCHMARK
+// ============================================================================
+
+// First trace time at which the weight reaches target, < 0 if it never does
+static float idealStop(const float* timeS, const float* weight, int len, float target) {
+  for (int i = 0; i < len; i++) {
+    if (weight[i] >= target) {
+      if (i == 0) {
+        return timeS[0];
+      }
+      float x = (target - weight[i - 1]) / (weight[i] - weight[i - 1]);
+      return timeS[i - 1] + x * (timeS[i] - timeS[i - 1]);
+    }
+  }
+  return -1.0f;
+}
+
+void predictorBenchmark(const float* timeS, const float* weight, int len,
+                        float targetWeight, float minStopS,
+                        const VirtualScaleConfig& config, const WeightFilterConfig* filter,
+                        int runs, PredictorBenchmarkResult* out) {
+  memset(out, 0, sizeof(*out));
+  out->idealStopS = idealStop(timeS, weight, len, targetWeight);
+  if (len < 1) {
+    return;
+  }
+  if (runs > PREDICTOR_BENCHMARK_MAX_RUNS) {
+    runs = PREDICTOR_BENCHMARK_MAX_RUNS;
+  }
+
+  float stopSum = 0.0f;
+  float errorSum = 0.0f;
+  float absErrorSum = 0.0f;
+  for (int run = 0; run < runs; run++) {
+    VirtualScale v;
+    virtualScaleInit(&v, config, timeS, weight, len, run + 1);
+    virtualScaleTare(&v, 0.0f);
+    virtualScaleStartTimer(&v, 0.0f);
+    WeightFilter f;
+    if (filter) {
+      weightFilterInit(&f, *filter);
+      weightFilterTare(&f, 0.0f);
+    }
+
+    // Only the regression window is kept: the predictor looks no further back
+    float winT[TREND_LINE_DATAPOINTS];
+    float winW[TREND_LINE_DATAPOINTS];
+    int points = 0;
+    float expectedEndS = INFINITY;
+    bool stopped = false;
+    float nowS = 0.0f;
+    // A little past the end: packets still in flight
+    float endS = (timeS[len - 1] - timeS[0]) / v.config.speed + 1.0f;
+    while (!stopped && nowS < endS) {
+      float w;
+      while (!stopped && virtualScaleRead(&v, nowS, &w)) {
+        out->packets++;
+        float pointS = nowS;
+        if (filter && !weightFilterAdd(&f, nowS, w, &w, &pointS)) {
+          out->filtered++;
+          continue;
+        }
+        if (points == TREND_LINE_DATAPOINTS) {
+          memmove(winT, winT + 1, sizeof(winT) - sizeof(winT[0]));
+          memmove(winW, winW + 1, sizeof(winW) - sizeof(winW[0]));
+          points--;
+        }
+        winT[points] = pointS;
+        winW[points] = w;
+        points++;
+        predictEndTime(winT, winW, points, targetWeight, &expectedEndS);
+        stopped = nowS > minStopS && nowS >= expectedEndS;
+      }
+      if (!stopped) {
+        nowS += BENCHMARK_STEP_S;
+      }
+    }
+    out->dropped += v.dropped;
+    out->runs++;
+    if (!stopped) {
+      continue;  // Ran past the recording without a stop
+    }
+
+    // The trace's own weight (no tare: the recording started from zero) at
+    // the moment the pump would stop
+    float error = virtualScaleTrueWeight(&v, nowS) - targetWeight;
+    out->stopped++;
+    stopSum += nowS;
+    errorSum += error;
+    absErrorSum += fabsf(error);
+    if (fabsf(error) > out->maxAbsErrorG) {
+      out->maxAbsErrorG = fabsf(error);
+    }
+  }
+  if (out->stopped > 0) {
+    out->meanStopS = stopSum / out->stopped;
+    out->meanErrorG = errorSum / out->stopped;
+    out->meanAbsErrorG = absErrorSum / out->stopped;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef SHOT_PREDICTOR_H
+#define SHOT_PREDICTOR_H
+
+// ============================================================================
+// SHOT END PREDICTOR + OFFLINE BENCHMARK
+// ============================================================================
+// The end-time regression the shot stopper runs on every weight packet: a
+// least-squares line through the last TREND_LINE_DATAPOINTS points, solved
+// for the weight to stop at.
+//
+// predictorBenchmark() replays a recorded weight trace through the virtual
+// scale (virtual_scale.h) - latency, jitter, losses - and runs the
+// predictor on the packets as the firmware would (stamped at receipt,
+// stopping once the last packet's time passes the predicted end), then
+// compares the weight the trace really had at the stop with the target.
+// Several seeded runs give the spread. With a filter config the packets go
+// through the weight sanitizer (weight_filter.h) first, as on the machine;
+// running it with and without shows what the filter buys.
+// GET /predictor_benchmark runs it on a shot from the history; like
+// virtual_scale.cpp this is plain C++, and the native test suite
+// test_predictor runs it on the built-in trace.
+
+#include <stdint.h>
+
+#include "virtual_scale.h"
+#include "weight_filter.h"
+
+#define TREND_LINE_DATAPOINTS 10  // Regression window (accuracy vs latency)
+
+// No prediction below this cup weight: the first drops run irregularly
+#define PREDICTOR_MIN_WEIGHT_G 10.0f
+
+// Time at which the line through the last TREND_LINE_DATAPOINTS of the
+// datapoints points reaches targetWeight. False (endS untouched) while there
+// are fewer points or the latest weight is below PREDICTOR_MIN_WEIGHT_G.
+bool predictEndTime(const float* timeS, const float* weight, int datapoints,
+                    float targetWeight, float* endS);
+
+#define PREDICTOR_BENCHMARK_MAX_RUNS 50
+
+struct PredictorBenchmarkResult {
+  int runs;
+  int stopped;          // Runs in which the predictor stopped the shot
+  float meanErrorG;     // Weight at stop minus target (stopped runs)
+  float meanAbsErrorG;
+  float maxAbsErrorG;
+  float meanStopS;      // Shot time of the stop
+  float idealStopS;     // When the trace itself crossed the target, < 0 = never
+  uint32_t packets;     // Delivered over all runs
+  uint32_t dropped;
+  uint32_t filtered;    // Held back by the sanitizer (spikes + blanked)
+};
+
+// Replay the trace runs times (seeds 1..runs) with config; a run stops at
+// the first packet with shot time > minStopS and >= the prediction, or at
+// the trace end. targetWeight is goal weight minus offset, as in the shot;
+// filter nullptr = raw packets.
+void predictorBenchmark(const float* timeS, const float* weight, int len,
+                        float targetWeight, float minStopS,
+                        const VirtualScaleConfig& config, const WeightFilterConfig* filter,
+                        int runs, PredictorBenchmarkResult* out);
+
+#endif // SHOT_PREDICTOR_H
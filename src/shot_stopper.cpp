@@ -2,6 +2,9 @@
 
 #include "cleaning_cycle.h"
 #include "debug.h"
+#include "pid_autotune.h"
+#include "profile_library.h"
+#include "pump_calibration.h"
 #include "settings.h"
 #include "shot_history.h"
 
@@ -9,14 +12,38 @@
 // SHARED STATE DEFINITIONS
 // ============================================================================
 
-AcaiaArduinoBLE scale(DEBUGMODE_ACAIA);
-
 volatile bool scaleConnected = false;
-volatile bool scaleNewWeight = false;
 volatile bool scaleStartSequenceRequest = false;
 volatile bool scaleStopTimerRequest = false;
 volatile bool scaleTareRequest = false;
 volatile float currentWeight = 0.0f;
+volatile uint32_t scalePacketCount = 0;
+volatile uint32_t scaleConnectCount = 0;
+
+// Weight sample queue. head is written only by the scale task, tail only by
+// the control task; each side stores its slot before publishing its index,
+// and volatile accesses are serialized (memw) on Xtensa, so the other core
+// never sees an index ahead of the data it covers.
+static ScaleSample scaleQueue[SCALE_QUEUE_SIZE];
+static volatile uint32_t scaleQueueHead = 0;
+static volatile uint32_t scaleQueueTail = 0;
+static volatile uint32_t scaleQueueDrops = 0;
+
+// Reconnect timing (scale task writes, web server reads)
+static portMUX_TYPE scaleStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static ScaleReconnectStats reconnectStats = {};
+static const uint32_t RECONNECT_BUCKET_MS[SCALE_RECONNECT_BUCKETS] = {
+  250, 500, 1000, 2000, 5000, 10000, 30000, UINT32_MAX
+};
+
+// Weight sanitizer: the filter runs in the control task; its config is set
+// from any task and picked up by generation, and /metrics reads the
+// counters, so all of it sits under filterMux (a few dozen cycles a packet)
+static portMUX_TYPE filterMux = portMUX_INITIALIZER_UNLOCKED;
+static WeightFilterConfig filterConfig = WEIGHT_FILTER_DEFAULTS;
+static uint32_t filterConfigGeneration = 1;
+static WeightFilter filter;
+static uint32_t filterGeneration = 0;  // Config generation filter runs on
 
 const int BUTTON_INPUT_PIN = REEDSWITCH ? REED_IN : BUTTON_READ_PIN;
 
@@ -46,12 +73,29 @@ Shot shot = {
     {5.0f, 4.0f}    // 5s left: 4 bar
   },
   1,     // numPressureGoalsByTimeLeft
+  {},    // flowGoalByTime (pressure-only default profile)
+  {},    // flowGoalByTimeLeft
+  // transitionByTime: ease into brew pressure instead of slamming the pump
+  // from 2 to 9 bar, ramp the decline
+  {
+    {0.0f, GoalCurve::HOLD},
+    {2.0f, GoalCurve::EASE},
+    {3.0f, GoalCurve::LINEAR}
+  },
+  // transitionByTimeLeft
+  {
+    {2.0f, GoalCurve::LINEAR}
+  },
   0,     // currentGoalPressure
+  0,     // currentGoalFlow
+  0,     // currentMaxFlow
   0,     // goalWeight (set from EEPROM later)
   0,     // weightOffset (set from EEPROM later)
   255,   // pumpPwm (idle = full speed)
   0,     // peakPressure
-  0      // pumpFlow
+  0,     // pumpFlow
+  PRESSURE_CONTROL_GAGGIUINO, // controlLaw (latched at shot start)
+  {}     // controlScorer
 };
 
 // ============================================================================
@@ -67,6 +111,9 @@ static int buttonReadings[BUTTON_STATE_ARRAY_LENGTH]; // Last raw button samples
 static unsigned long lastButtonReadMs = 0;
 static int newButtonState = 0;
 
+// Ended shots per EndType, indexed by the enum value (UNDEF included)
+static uint32_t shotEndCounts[(int)EndType::UNDEF + 1] = {};
+
 // ============================================================================
 // HELPERS
 // ============================================================================
@@ -75,6 +122,94 @@ float secondsSinceBoot() {
   return millis() / 1000.0f;
 }
 
+bool scaleQueuePush(float weight, uint32_t receivedUs, uint8_t flags) {
+  uint32_t head = scaleQueueHead;
+  if (head - scaleQueueTail >= SCALE_QUEUE_SIZE) {
+    scaleQueueDrops++;
+    return false;
+  }
+  ScaleSample& slot = scaleQueue[head & (SCALE_QUEUE_SIZE - 1)];
+  slot.weight = weight;
+  slot.receivedUs = receivedUs;
+  slot.flags = flags;
+  scaleQueueHead = head + 1;
+  return true;
+}
+
+bool scaleQueuePop(ScaleSample* out) {
+  uint32_t tail = scaleQueueTail;
+  if (tail == scaleQueueHead) {
+    return false;
+  }
+  *out = scaleQueue[tail & (SCALE_QUEUE_SIZE - 1)];
+  scaleQueueTail = tail + 1;
+  return true;
+}
+
+uint32_t scaleQueueDropCount() {
+  return scaleQueueDrops;
+}
+
+void scaleRecordReconnect(uint32_t durationMs, bool fast) {
+  int bucket = 0;
+  while (durationMs > RECONNECT_BUCKET_MS[bucket]) {
+    bucket++;
+  }
+  portENTER_CRITICAL(&scaleStatsMux);
+  reconnectStats.count++;
+  reconnectStats.fast += fast ? 1 : 0;
+  reconnectStats.sumMs += durationMs;
+  reconnectStats.lastMs = durationMs;
+  reconnectStats.buckets[bucket]++;
+  portEXIT_CRITICAL(&scaleStatsMux);
+}
+
+void scaleReconnectStats(ScaleReconnectStats* out) {
+  portENTER_CRITICAL(&scaleStatsMux);
+  *out = reconnectStats;
+  portEXIT_CRITICAL(&scaleStatsMux);
+}
+
+uint32_t scaleReconnectBucketMs(int bucket) {
+  return RECONNECT_BUCKET_MS[bucket];
+}
+
+void scaleFilterConfigure(const WeightFilterConfig& config) {
+  portENTER_CRITICAL(&filterMux);
+  filterConfig = config;
+  filterConfigGeneration++;
+  portEXIT_CRITICAL(&filterMux);
+}
+
+void scaleFilterConfig(WeightFilterConfig* out) {
+  portENTER_CRITICAL(&filterMux);
+  *out = filterConfig;
+  portEXIT_CRITICAL(&filterMux);
+}
+
+bool scaleFilterApply(const ScaleSample& sample, float receivedS,
+                      float* weight, float* sampleS) {
+  portENTER_CRITICAL(&filterMux);
+  if (filterGeneration != filterConfigGeneration) {
+    WeightFilterStats kept = filter.stats;
+    weightFilterInit(&filter, filterConfig);
+    filter.stats = kept;
+    filterGeneration = filterConfigGeneration;
+  }
+  if (sample.flags & SCALE_SAMPLE_TARED) {
+    weightFilterTare(&filter, receivedS);
+  }
+  bool accepted = weightFilterAdd(&filter, receivedS, sample.weight, weight, sampleS);
+  portEXIT_CRITICAL(&filterMux);
+  return accepted;
+}
+
+void scaleFilterStats(WeightFilterStats* out) {
+  portENTER_CRITICAL(&filterMux);
+  *out = filter.stats;
+  portEXIT_CRITICAL(&filterMux);
+}
+
 const char* endReasonName(EndType end) {
   switch (end) {
     case EndType::BUTTON: return "BUTTON";
@@ -85,6 +220,10 @@ const char* endReasonName(EndType end) {
   }
 }
 
+uint32_t shotEndCount(EndType end) {
+  return shotEndCounts[(int)end];
+}
+
 float pressureBarFromVoltage(float voltage) {
   if (voltage < 0.4f) {
     return 0.0f;
@@ -115,31 +254,13 @@ void updatePressureSensor(Shot* s) {
 // SHOT LIFECYCLE
 // ============================================================================
 
-// Predict the shot end time by fitting a line (y = mx + b) to the last
-// TREND_LINE_DATAPOINTS weight measurements and solving for the goal weight.
+// Predict the shot end time from the latest weights (shot_predictor.cpp);
+// no prediction yet = the safety timeout
 static void calculateEndTime(Shot* s) {
-  // Do not predict end time if there aren't enough espresso measurements yet
-  if ((s->datapoints < TREND_LINE_DATAPOINTS) || (s->weight[s->datapoints - 1] < 10)) {
+  if (!predictEndTime(s->timeS, s->weight, s->datapoints,
+                      s->goalWeight - s->weightOffset, &s->expectedEndS)) {
     s->expectedEndS = MAX_SHOT_DURATION_S;
-    return;
-  }
-
-  float sumXY = 0, sumX = 0, sumY = 0, sumSquaredX = 0;
-  for (int i = s->datapoints - TREND_LINE_DATAPOINTS; i < s->datapoints; i++) {
-    sumXY += s->timeS[i] * s->weight[i];
-    sumX += s->timeS[i];
-    sumY += s->weight[i];
-    sumSquaredX += s->timeS[i] * s->timeS[i];
   }
-
-  float m = (TREND_LINE_DATAPOINTS * sumXY - sumX * sumY)
-            / (TREND_LINE_DATAPOINTS * sumSquaredX - sumX * sumX);
-  float meanX = sumX / TREND_LINE_DATAPOINTS;
-  float meanY = sumY / TREND_LINE_DATAPOINTS;
-  float b = meanY - m * meanX;
-
-  // Time at which the goal weight will be reached: x = (y - b) / m
-  s->expectedEndS = (s->goalWeight - s->weightOffset - b) / m;
 }
 
 void setBrewingState(bool brewing) {
@@ -149,18 +270,31 @@ void setBrewingState(bool brewing) {
     shot.shotTimer = 0;
     shot.datapoints = 0;
     shot.peakPressure = 0;
+    pumpCalibrationShotStart();
     scaleStartSequenceRequest = true; // Scale task: resetTimer + startTimer (+ tare)
   } else {
     DEBUG_SHOT_PRINT("Shot ended by: %s (duration: %.1f s)",
                      endReasonName(shot.end), secondsSinceBoot() - shot.startTimestampS);
 
     shot.endS = secondsSinceBoot() - shot.startTimestampS;
+    shotEndCounts[(int)shot.end]++;
+
+    // Keep what the pump calibration learned from this shot
+    if (pumpCalibrationShotEnd()) {
+      settingsSave();
+    }
 
     // Snapshot the trajectory into the history ring buffer before the next
     // shot overwrites it. Skip flushes shorter than MIN_SHOT_DURATION_S.
     if (shot.endS >= MIN_SHOT_DURATION_S) {
+      // Selections only switch between shots, so the active profile is the
+      // one that ran (unless edited mid-shot: then custom)
+      char profileName[PROFILE_NAME_MAX];
+      profileLibraryActiveName(profileName);
       recordShot(shot.timeS, shot.weight, shot.pressureTrace, shot.datapoints,
-                 shot.endS, shot.peakPressure, (int)shot.end);
+                 shot.endS, shot.peakPressure, (int)shot.end,
+                 shot.controlLaw, shot.controlScorer.score, profileName);
+      pressureControlRecordShot(shot.controlLaw, shot.controlScorer.score);
     }
 
     scaleStopTimerRequest = true;
@@ -182,45 +316,37 @@ void setBrewingState(bool brewing) {
   shot.end = EndType::UNDEF;
 }
 
-void updateShotTrajectory(Shot* s, float weight) {
+void updateShotTrajectory(Shot* s, float weight, float sampleS, float receivedS) {
   if (!s->brewing || s->datapoints >= MAX_SHOT_DATAPOINTS) {
     return;
   }
+  float timeS = sampleS - s->startTimestampS;
+  if (timeS < 0.0f) {
+    return;  // Stands for a moment before the shot started
+  }
+  if (s->datapoints > 0 && timeS < s->timeS[s->datapoints - 1]) {
+    timeS = s->timeS[s->datapoints - 1];  // Keep the regression's axis monotonic
+  }
 
   // s->pressure is sampled every control iteration (main.cpp); this just
   // snapshots the latest filtered value at the scale's datapoint rate
-  s->timeS[s->datapoints] = secondsSinceBoot() - s->startTimestampS;
+  s->timeS[s->datapoints] = timeS;
   s->weight[s->datapoints] = weight;
   s->pressureTrace[s->datapoints] = s->pressure;
-  s->shotTimer = s->timeS[s->datapoints];
+  s->shotTimer = fmaxf(receivedS - s->startTimestampS, timeS);
   s->datapoints++;
 
   // Get the likely end time of the shot
   calculateEndTime(s);
 
-  // Pressure goal: latest by-time goal that has been reached...
-  float goalPressure = 0.0f;
-  for (int i = 0; i < s->numPressureGoalsByTime; i++) {
-    if (s->shotTimer >= s->pressureGoalByTime[i].timeS) {
-      goalPressure = s->pressureGoalByTime[i].pressure;
-    }
-  }
-  // ...overridden by any by-time-left goal that applies
-  float timeLeft = s->expectedEndS - s->shotTimer;
-  for (int i = 0; i < s->numPressureGoalsByTimeLeft; i++) {
-    if (timeLeft <= s->pressureGoalByTimeLeft[i].timeLeftS) {
-      goalPressure = s->pressureGoalByTimeLeft[i].pressure;
-    }
-  }
-  s->currentGoalPressure = goalPressure;
-
-  DEBUG_SHOT_PRINT("Time: %.1f s | Weight: %.1f g | Expected end: %.1f s | Goal weight: %.0f g | Pump: %s | Goal pressure: %.1f bar | Current pressure: %.1f bar",
+  // The goal itself is evaluated every control iteration (main.cpp)
+  DEBUG_SHOT_PRINT("Time: %.1f s | Weight: %.1f g | Expected end: %.1f s | Goal weight: %.0f g | Goal: %.1f bar, %.1f ml/s | Current pressure: %.1f bar",
     s->shotTimer,
     s->weight[s->datapoints - 1],
     s->expectedEndS,
     s->goalWeight,
-    (s->pressure < goalPressure) ? "ON" : "OFF",
-    goalPressure,
+    s->currentGoalPressure,
+    s->currentGoalFlow,
     s->pressure
   );
 }
@@ -305,10 +431,11 @@ void handleButtonLogic() {
         DEBUG_BUTTON_PRINT("Button pressed");
         buttonState = PRESSED;
         if (!MOMENTARY) {
-          if (cleaningActive()) {
-            // The user toggled the machine themselves - abort cleaning, do
-            // not start a shot on top of it
+          if (cleaningActive() || autotuneActive()) {
+            // The user toggled the machine themselves - abort cleaning or
+            // autotune, do not start a shot on top of it
             cleaningAbortFromButton();
+            autotuneAbortFromButton();
           } else {
             shot.brewing = true;
             setBrewingState(shot.brewing);
@@ -321,10 +448,12 @@ void handleButtonLogic() {
       if (!newButtonState) {
         DEBUG_BUTTON_PRINT("Button released");
         buttonState = RELEASED;
-        if (MOMENTARY && cleaningActive()) {
-          // Physical press during cleaning = abort; machine state already
-          // changed by the user's press, so only our tracking is released
+        if (MOMENTARY && (cleaningActive() || autotuneActive())) {
+          // Physical press during cleaning/autotune = abort; machine state
+          // already changed by the user's press, so only our tracking is
+          // released
           cleaningAbortFromButton();
+          autotuneAbortFromButton();
           break;
         }
         shot.brewing = !shot.brewing;
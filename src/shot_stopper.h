@@ -8,7 +8,10 @@
 // Implementations live in shot_stopper.cpp.
 
 #include <Arduino.h>
-#include <AcaiaArduinoBLE.h>
+
+#include "pressure_control.h"
+#include "shot_predictor.h"  // End-time regression, TREND_LINE_DATAPOINTS
+#include "weight_filter.h"
 
 // ============================================================================
 // BREWING PARAMETERS
@@ -24,7 +27,6 @@
 // EEPROM persistence (goal weight, offset, profile, cleaning, WiFi) lives in
 // settings.h/.cpp; the old two-byte layout is migrated there on first boot.
 
-#define TREND_LINE_DATAPOINTS 10  // Regression window (accuracy vs latency)
 #define MAX_SHOT_DATAPOINTS 1000  // Capacity of the per-shot trajectory arrays
 
 // ============================================================================
@@ -86,6 +88,26 @@ struct PressureGoalByTimeLeft {
   float pressure;  // Override goal pressure from this time left onwards
 };
 
+// Optional flow side of a goal, ml/s through the pump (pump_model.cpp).
+// targetFlow > 0 turns the goal into a flow goal, its pressure becoming a
+// limit (0 = none); otherwise maxFlow > 0 caps the flow while the pump
+// chases the goal pressure. All zero = plain pressure goal.
+struct GoalFlow {
+  float targetFlow;
+  float maxFlow;
+};
+
+// How a goal takes over from the value in force before it (the previous
+// goal's, possibly still ramping): HOLD steps at the goal's time, LINEAR and
+// EASE (smoothstep: gentle start and finish) ramp over rampS from there.
+// Pressure, and the flow target between two flow goals, follow the curve.
+enum class GoalCurve : uint8_t { HOLD, LINEAR, EASE };
+
+struct GoalTransition {
+  float rampS;      // Seconds from the goal's time until its value is reached
+  GoalCurve curve;  // HOLD takes no ramp
+};
+
 #define MAX_PRESSURE_GOALS 8
 
 struct Shot {
@@ -107,7 +129,13 @@ struct Shot {
   int numPressureGoalsByTime;
   PressureGoalByTimeLeft pressureGoalByTimeLeft[MAX_PRESSURE_GOALS];
   int numPressureGoalsByTimeLeft;
-  float currentGoalPressure;
+  GoalFlow flowGoalByTime[MAX_PRESSURE_GOALS];      // Same indices as above
+  GoalFlow flowGoalByTimeLeft[MAX_PRESSURE_GOALS];
+  GoalTransition transitionByTime[MAX_PRESSURE_GOALS];  // ... and here
+  GoalTransition transitionByTimeLeft[MAX_PRESSURE_GOALS];
+  float currentGoalPressure;           // Target, or the limit for a flow goal
+  float currentGoalFlow;               // Flow target (ml/s), 0 = pressure goal
+  float currentMaxFlow;                // Flow cap (ml/s), 0 = none
 
   // User parameters (persisted to EEPROM)
   float goalWeight;
@@ -117,6 +145,11 @@ struct Shot {
   int pumpPwm;         // Last PWM value written to the dimmer (0-255)
   float peakPressure;  // Highest pressure seen during the current shot
   float pumpFlow;      // Model-estimated pump flow (ml/s, pump_model.cpp)
+
+  // Pressure control law latched for this shot and its running score
+  // (pressure_control.h); written by the control task
+  int controlLaw;
+  ControlScorer controlScorer;
 };
 
 // ============================================================================
@@ -126,20 +159,78 @@ struct Shot {
 // Global shot state, shared across modules
 extern Shot shot;
 
-// BLE scale, owned exclusively by the scale task (main.cpp:scaleTask)
-extern AcaiaArduinoBLE scale;
-
-// Scale state shared between the scale task (owner of ALL BLE/scale calls)
-// and the control task (consumer). The control task never touches the scale
-// directly, so a disconnected scale can never block brewing logic or starve
-// the web server. Commands to the scale are queued as flags, mirroring the
-// webStartRequest pattern in webserver.h.
+// Scale state shared between the scale task (owner of ALL scale driver calls,
+// scale.h) and the control task (consumer). The control task never touches
+// the scale directly, so a disconnected scale can never block brewing logic
+// or starve the web server. Commands to the scale are queued as flags, mirroring the
+// webStartRequest pattern in webserver.h. Weight packets travel the other
+// way through the sample queue below.
 extern volatile bool scaleConnected;
-extern volatile bool scaleNewWeight;            // Set by scale task per weight packet
 extern volatile bool scaleStartSequenceRequest; // resetTimer + startTimer (+ tare)
 extern volatile bool scaleStopTimerRequest;
 extern volatile bool scaleTareRequest;
-extern volatile float currentWeight;            // Live scale reading (g)
+extern volatile float currentWeight;            // Latest scale reading (g), for display
+extern volatile uint32_t scalePacketCount;      // Weight packets received (/metrics)
+extern volatile uint32_t scaleConnectCount;     // Successful (re)connects (/metrics)
+
+// Weight packets from the scale task to the control task, each stamped when
+// the scale task picked it up rather than when the control task gets to it,
+// so the trajectory's time axis carries no control-loop jitter. Lock-free
+// single-producer/single-consumer ring: packets arriving within one control
+// tick queue up instead of overwriting each other.
+#define SCALE_QUEUE_SIZE 16  // Power of two; ~1.6 s of packets at 10 Hz
+
+#define SCALE_SAMPLE_TARED 0x01  // First packet after a tare took effect
+
+struct ScaleSample {
+  float weight;         // g
+  uint32_t receivedUs;  // micros() at receipt
+  uint8_t flags;        // SCALE_SAMPLE_*
+};
+
+// Scale task only. False (sample counted as dropped) if the queue is full.
+bool scaleQueuePush(float weight, uint32_t receivedUs, uint8_t flags);
+
+// Control task only. False when empty.
+bool scaleQueuePop(ScaleSample* out);
+
+// Samples dropped on a full queue since boot (/metrics)
+uint32_t scaleQueueDropCount();
+
+// Scale reconnects: time from noticing the link was lost until connected
+// again, and whether the directed fast path (cached address) made it
+#define SCALE_RECONNECT_BUCKETS 8
+
+struct ScaleReconnectStats {
+  uint32_t count;
+  uint32_t fast;      // Via the cached address
+  uint64_t sumMs;
+  uint32_t lastMs;
+  uint32_t buckets[SCALE_RECONNECT_BUCKETS];  // Per bucket, not cumulative
+};
+
+// Scale task only
+void scaleRecordReconnect(uint32_t durationMs, bool fast);
+
+// Copy for /metrics
+void scaleReconnectStats(ScaleReconnectStats* out);
+
+// Upper bound of a reconnect bucket in ms; UINT32_MAX for the last
+uint32_t scaleReconnectBucketMs(int bucket);
+
+// Weight sanitizer (weight_filter.h) between the sample queue and the shot
+// trajectory. The config is persisted and set via /set_weight_filter; a new
+// one takes effect with the next packet.
+void scaleFilterConfigure(const WeightFilterConfig& config);  // Any task
+void scaleFilterConfig(WeightFilterConfig* out);              // Any task
+
+// Control task: run a popped sample received at receivedS through the
+// filter. True with the weight to record and the time it stands for.
+bool scaleFilterApply(const ScaleSample& sample, float receivedS,
+                      float* weight, float* sampleS);
+
+// Live filter's counters since boot (/metrics)
+void scaleFilterStats(WeightFilterStats* out);
 
 // Electrical status of the button output (latching machines)
 extern bool buttonLatched;
@@ -154,6 +245,9 @@ float secondsSinceBoot();
 // Human-readable name of an EndType value
 const char* endReasonName(EndType end);
 
+// Shots ended since boot with the given EndType (/metrics)
+uint32_t shotEndCount(EndType end);
+
 // Convert MPX5500 sensor voltage to pressure (bar), clamped to 0-16
 float pressureBarFromVoltage(float voltage);
 
@@ -163,8 +257,11 @@ void updatePressureSensor(Shot* s);
 // Start or end a shot: timers, scale commands, machine button, history record
 void setBrewingState(bool brewing);
 
-// Append a weight datapoint, update prediction and current pressure goal
-void updateShotTrajectory(Shot* s, float weight);
+// Append a weight datapoint standing for time sampleS, whose packet arrived
+// at receivedS (both secondsSinceBoot() timeline; they differ by the
+// sanitizer's delay), and update the end time prediction. The shot timer
+// follows receivedS, so stopping is not delayed by the filter.
+void updateShotTrajectory(Shot* s, float weight, float sampleS, float receivedS);
 
 // Safety timeout: end the shot after MAX_SHOT_DURATION_S
 void handleMaxDurationReached(Shot* s);
@@ -173,7 +270,8 @@ void handleMaxDurationReached(Shot* s);
 void handleShotEnd(Shot* s, float weight);
 
 // Post-shot offset learning: after DRIP_DELAY_S, adopt small weight errors
-// into the offset and persist to EEPROM; larger errors are rejected
+// into the offset and persist to EEPROM; larger errors are rejected.
+// weight is the last sanitized packet, so a knock can't teach the offset.
 void detectShotError(Shot* s, float weight);
 
 // Debounced button state machine (momentary and latching switches)
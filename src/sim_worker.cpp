@@ -0,0 +1,142 @@
+#include "sim_worker.h"
+
+#include "debug.h"
+
+// Guards the job states and the DONE results (web server starts and polls,
+// the worker runs). A slot's inputs are written between claim() and
+// queue(), its results while RUNNING: neither needs the lock.
+static portMUX_TYPE jobMux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t jobSignal = nullptr;
+
+static SimJobState jobState[SIM_JOB_COUNT] = {};
+static bool jobBusy = false;  // A job of any kind queued or running
+static ControllerBenchmarkJob controllerBenchmark;
+static AutotuneSimulationJob autotuneSimulation;
+
+void simWorkerInit() {
+  jobSignal = xSemaphoreCreateBinary();
+}
+
+// ============================================================================
+// JOB QUEUE
+// ============================================================================
+
+// Claim the worker for job; the caller then fills in the job's inputs and
+// calls queue()
+static bool claim(SimJob job) {
+  bool claimed = false;
+  portENTER_CRITICAL(&jobMux);
+  if (!jobBusy) {
+    jobBusy = true;
+    jobState[(int)job] = SimJobState::QUEUED;
+    claimed = true;
+  }
+  portEXIT_CRITICAL(&jobMux);
+  return claimed;
+}
+
+static void queue() {
+  xSemaphoreGive(jobSignal);
+}
+
+static SimJobState state(SimJob job) {
+  portENTER_CRITICAL(&jobMux);
+  SimJobState s = jobState[(int)job];
+  portEXIT_CRITICAL(&jobMux);
+  return s;
+}
+
+static void setState(SimJob job, SimJobState s) {
+  portENTER_CRITICAL(&jobMux);
+  jobState[(int)job] = s;
+  if (s == SimJobState::DONE) {
+    jobBusy = false;
+  }
+  portEXIT_CRITICAL(&jobMux);
+}
+
+bool simWorkerStartControllerBenchmark(const PidGains& gains) {
+  if (!claim(SimJob::CONTROLLER_BENCHMARK)) {
+    return false;
+  }
+  // Nothing reads the slot while it is QUEUED
+  controllerBenchmark.gains = gains;
+  queue();
+  return true;
+}
+
+SimJobState simWorkerControllerBenchmark(ControllerBenchmarkJob* out) {
+  portENTER_CRITICAL(&jobMux);
+  SimJobState s = jobState[(int)SimJob::CONTROLLER_BENCHMARK];
+  if (s == SimJobState::DONE) {
+    *out = controllerBenchmark;
+  }
+  portEXIT_CRITICAL(&jobMux);
+  return s;
+}
+
+bool simWorkerStartAutotuneSimulation(const AutotuneConfig& config) {
+  if (!claim(SimJob::AUTOTUNE_SIMULATION)) {
+    return false;
+  }
+  autotuneSimulation.config = config;
+  queue();
+  return true;
+}
+
+SimJobState simWorkerAutotuneSimulation(AutotuneSimulationJob* out) {
+  portENTER_CRITICAL(&jobMux);
+  SimJobState s = jobState[(int)SimJob::AUTOTUNE_SIMULATION];
+  if (s == SimJobState::DONE) {
+    *out = autotuneSimulation;
+  }
+  portEXIT_CRITICAL(&jobMux);
+  return s;
+}
+
+// ============================================================================
+// JOBS
+// ============================================================================
+
+static void runControllerBenchmark() {
+  uint32_t startMs = millis();
+  for (int law = 0; law < PRESSURE_CONTROL_LAW_COUNT; law++) {
+    pressureControlBenchmark(law, controllerBenchmark.gains, &controllerBenchmark.laws[law]);
+  }
+  DEBUG_SHOT_PRINT("Controller benchmark done in %lu ms", (unsigned long)(millis() - startMs));
+}
+
+static void runAutotuneSimulation() {
+  uint32_t startMs = millis();
+  AutotuneSimulationJob& job = autotuneSimulation;
+  job.failReason = nullptr;
+  job.status = autotuneSimulate(job.config, &job.result, &job.failReason);
+  if (job.status == AutotuneStatus::DONE) {
+    for (int i = 0; i < AUTOTUNE_RULE_COUNT; i++) {
+      pressureControlBenchmark(PRESSURE_CONTROL_PID, job.result.candidates[i], &job.candidates[i]);
+    }
+  }
+  DEBUG_SHOT_PRINT("Autotune simulation done in %lu ms", (unsigned long)(millis() - startMs));
+}
+
+// ============================================================================
+// TASK
+// ============================================================================
+
+void simWorkerTask(void* param) {
+  for (;;) {
+    xSemaphoreTake(jobSignal, portMAX_DELAY);
+    for (int i = 0; i < SIM_JOB_COUNT; i++) {
+      SimJob job = (SimJob)i;
+      if (state(job) != SimJobState::QUEUED) {
+        continue;
+      }
+      setState(job, SimJobState::RUNNING);
+      switch (job) {
+        case SimJob::CONTROLLER_BENCHMARK: runControllerBenchmark(); break;
+        case SimJob::AUTOTUNE_SIMULATION:  runAutotuneSimulation(); break;
+      }
+      setState(job, SimJobState::DONE);
+    }
+  }
+}
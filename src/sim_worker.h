@@ -0,0 +1,61 @@
+#ifndef SIM_WORKER_H
+#define SIM_WORKER_H
+
+// ============================================================================
+// SIMULATION WORKER - OFFLINE BENCHMARKS OUTSIDE THE WEB SERVER
+// ============================================================================
+// The closed-loop simulations behind the benchmark endpoints (controller
+// benchmark, autotune simulation) take up to
+// seconds (the MPC law identifies and solves every step). Run inside an
+// AsyncTCP handler they would stall every other request and the TCP stack
+// with them, so a handler only queues a job and answers 202; this task
+// runs it and keeps the result until the next job of that kind, for the
+// handler's follow-up GET.
+//
+// One job at a time: a start while another is queued or running is
+// refused. The task runs at idle priority on core 0, so WiFi, AsyncTCP and
+// the settings task preempt it and the control task (core 1) never sees it.
+
+#include <Arduino.h>
+
+#include "pid_autotune.h"
+#include "pid_controller.h"  // PidGains
+#include "pressure_control.h"
+
+enum class SimJob : uint8_t { CONTROLLER_BENCHMARK, AUTOTUNE_SIMULATION };
+#define SIM_JOB_COUNT 2
+
+enum class SimJobState : uint8_t { IDLE, QUEUED, RUNNING, DONE };
+
+// GET /controller_benchmark: every law against the simulated group, PID
+// with the gains it was started with; indexed like pressureControlLawName()
+struct ControllerBenchmarkJob {
+  PidGains gains;
+  BenchmarkResult laws[PRESSURE_CONTROL_LAW_COUNT];
+};
+
+// GET /autotune_simulation: the relay experiment against the simulated
+// blind basket, then each candidate scored by the controller benchmark
+struct AutotuneSimulationJob {
+  AutotuneConfig config;
+  AutotuneStatus status;   // DONE or FAILED
+  const char* failReason;  // Static string, FAILED only
+  AutotuneResult result;
+  BenchmarkResult candidates[AUTOTUNE_RULE_COUNT];  // Indexed like result.candidates
+};
+
+// Create the signal; call once in setup(), before the web server starts
+void simWorkerInit();
+
+// Worker task body; started by setup() after simWorkerInit()
+void simWorkerTask(void* param);
+
+// Queue a job; false while one is queued or running
+bool simWorkerStartControllerBenchmark(const PidGains& gains);
+bool simWorkerStartAutotuneSimulation(const AutotuneConfig& config);
+
+// State of the latest job of that kind; out is filled once it is DONE
+SimJobState simWorkerControllerBenchmark(ControllerBenchmarkJob* out);
+SimJobState simWorkerAutotuneSimulation(AutotuneSimulationJob* out);
+
+#endif // SIM_WORKER_H
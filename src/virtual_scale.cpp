@@ -0,0 +1,154 @@
+#include "virtual_scale.h"
+
+#include <math.h>
+
+const VirtualScaleConfig VIRTUAL_SCALE_DEFAULTS = {
+  1.0f,   // speed
+  0.1f,   // packetPeriodS
+  0.03f,  // latencyS
+  0.02f,  // jitterS
+  0.0f,   // dropProb
+  0.0f,   // gapS
+  0.0f,   // noiseG
+  0.0f,   // spikeProb
+  0.0f,   // spikeG
+  0.0f,   // tareDipG
+};
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+// xorshift32: uniform in [0, 1)
+static float nextRandom(VirtualScale* v) {
+  uint32_t x = v->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  v->rng = x;
+  return (x >> 8) / 16777216.0f;
+}
+
+static float traceTime(const VirtualScale* v, float nowS) {
+  return v->timerRunning ? (nowS - v->timerStartS) * v->config.speed : v->frozenTraceS;
+}
+
+// Trace weight at trace time t, linearly interpolated
+static float traceWeightAt(const VirtualScale* v, float t) {
+  const float* ts = v->traceTimeS;
+  const float* ws = v->traceWeight;
+  int n = v->traceLen;
+  if (t <= ts[0]) {
+    return ws[0];
+  }
+  for (int i = 1; i < n; i++) {
+    if (t < ts[i]) {
+      float span = ts[i] - ts[i - 1];
+      float x = span > 0.0f ? (t - ts[i - 1]) / span : 1.0f;
+      return ws[i - 1] + x * (ws[i] - ws[i - 1]);
+    }
+  }
+  return ws[n - 1];
+}
+
+// The scale sends a packet at real time sentS: lose it, or queue it for
+// delivery
+static void sendPacket(VirtualScale* v, float sentS) {
+  v->generated++;
+  if (sentS < v->gapUntilS || nextRandom(v) < v->config.dropProb) {
+    if (sentS >= v->gapUntilS) {
+      v->gapUntilS = sentS + v->config.gapS;
+    }
+    v->dropped++;
+    return;
+  }
+  if (v->inFlightCount == VIRTUAL_SCALE_IN_FLIGHT) {
+    v->dropped++;  // Latency beyond the in-flight window: lost as well
+    return;
+  }
+  float raw = traceWeightAt(v, traceTime(v, sentS)) - v->tareG;
+  raw += (2.0f * nextRandom(v) - 1.0f) * v->config.noiseG;
+  if (nextRandom(v) < v->config.spikeProb) {
+    raw += nextRandom(v) < 0.5f ? v->config.spikeG : -v->config.spikeG;
+  }
+  float sinceTareS = sentS - v->tareAtS;
+  if (sinceTareS >= 0.0f && sinceTareS < VIRTUAL_SCALE_TARE_SETTLE_S) {
+    raw -= v->config.tareDipG * (1.0f - sinceTareS / VIRTUAL_SCALE_TARE_SETTLE_S);
+  }
+  float deliverS = sentS + v->config.latencyS + nextRandom(v) * v->config.jitterS;
+  if (deliverS < v->lastDeliverS) {
+    deliverS = v->lastDeliverS;  // Notifications arrive in order
+  }
+  v->lastDeliverS = deliverS;
+  int slot = (v->inFlightHead + v->inFlightCount) % VIRTUAL_SCALE_IN_FLIGHT;
+  v->inFlightWeight[slot] = roundf(raw / VIRTUAL_SCALE_RESOLUTION_G) * VIRTUAL_SCALE_RESOLUTION_G;
+  v->inFlightDeliverS[slot] = deliverS;
+  v->inFlightCount++;
+}
+
+// ============================================================================
+// API
+// ============================================================================
+
+void virtualScaleInit(VirtualScale* v, const VirtualScaleConfig& config,
+                      const float* timeS, const float* weight, int len, uint32_t seed) {
+  *v = {};
+  v->config = config;
+  if (v->config.speed <= 0.0f) {
+    v->config.speed = 1.0f;
+  }
+  if (v->config.packetPeriodS <= 0.0f) {
+    v->config.packetPeriodS = VIRTUAL_SCALE_DEFAULTS.packetPeriodS;
+  }
+  v->traceTimeS = timeS;
+  v->traceWeight = weight;
+  v->traceLen = len;
+  v->nextPacketS = -1.0f;
+  v->tareAtS = -VIRTUAL_SCALE_TARE_SETTLE_S;  // No dip before the first tare
+  v->rng = seed ? seed : 0x2545F491u;
+}
+
+void virtualScaleStartTimer(VirtualScale* v, float nowS) {
+  v->timerRunning = true;
+  v->timerStartS = nowS - v->frozenTraceS / v->config.speed;
+}
+
+void virtualScaleStopTimer(VirtualScale* v, float nowS) {
+  v->frozenTraceS = traceTime(v, nowS);
+  v->timerRunning = false;
+}
+
+void virtualScaleResetTimer(VirtualScale* v) {
+  v->timerRunning = false;
+  v->frozenTraceS = 0.0f;
+}
+
+void virtualScaleTare(VirtualScale* v, float nowS) {
+  v->tareG = virtualScaleTrueWeight(v, nowS);
+  v->tareAtS = nowS;
+}
+
+float virtualScaleTrueWeight(const VirtualScale* v, float nowS) {
+  return traceWeightAt(v, traceTime(v, nowS));
+}
+
+bool virtualScaleRead(VirtualScale* v, float nowS, float* weight) {
+  if (v->nextPacketS < 0.0f) {
+    v->nextPacketS = nowS;
+  }
+  while (v->nextPacketS <= nowS) {
+    sendPacket(v, v->nextPacketS);
+    v->nextPacketS += v->config.packetPeriodS;
+  }
+  if (v->inFlightCount == 0 || v->inFlightDeliverS[v->inFlightHead] > nowS) {
+    return false;
+  }
+  *weight = v->inFlightWeight[v->inFlightHead];
+  v->inFlightHead = (v->inFlightHead + 1) % VIRTUAL_SCALE_IN_FLIGHT;
+  v->inFlightCount--;
+  return true;
+}
+
+bool virtualScaleFinished(const VirtualScale* v, float nowS) {
+  return traceTime(v, nowS) >= v->traceTimeS[v->traceLen - 1];
+}
@@ -0,0 +1,103 @@
+#ifndef VIRTUAL_SCALE_H
+#define VIRTUAL_SCALE_H
+
+// ============================================================================
+// VIRTUAL SCALE - RECORDED WEIGHT TRACES REPLAYED AS SCALE PACKETS
+// ============================================================================
+// Replays a weight trace (time/weight pairs, e.g. a shot from the history)
+// the way a BLE scale would report it: one packet every packetPeriodS, the
+// weight at that instant of the trace rounded to the scale's 0.1 g, each
+// packet delivered latencyS plus up to jitterS later (never out of order),
+// dropped with probability dropProb - and then, if gapS > 0, everything
+// else for gapS as well (a link dropout). speed > 1 runs the trace faster
+// than real time. For the weight sanitizer (weight_filter.h) a load cell's
+// imperfections can be added: uniform noise, knocks (single packets off by
+// spikeG) and the dip of tareDipG right after a tare that recovers over
+// VIRTUAL_SCALE_TARE_SETTLE_S.
+//
+// The timer drives the replay, as the shot it stands for: the trace runs
+// from 0 with virtualScaleStartTimer() and freezes where it is on
+// virtualScaleStopTimer() (the pump stopped; drips are not modelled), so a
+// shot stopped earlier than the recording ends at the weight it had then.
+// Past the end of the trace its last weight holds. Tare subtracts the weight
+// at that moment.
+//
+// Plain C++ with time passed in and its own seeded PRNG: deterministic, no
+// Arduino, FreeRTOS or BLE - the scale driver (scale.cpp) runs it on the
+// machine, the predictor benchmark (shot_predictor.h) offline, and both
+// files build natively as they are (test_predictor in env:native).
+
+#include <stdint.h>
+
+#define VIRTUAL_SCALE_RESOLUTION_G 0.1f
+
+// Packets generated but not yet delivered (covers latency + jitter of
+// several packet periods)
+#define VIRTUAL_SCALE_IN_FLIGHT 32
+
+#define VIRTUAL_SCALE_TARE_SETTLE_S 0.4f
+
+struct VirtualScaleConfig {
+  float speed;          // Trace seconds per real second
+  float packetPeriodS;  // Time between packets the scale sends
+  float latencyS;       // Fixed delivery delay
+  float jitterS;        // Extra delay, uniform in 0..jitterS
+  float dropProb;       // Probability a packet is lost (0..1)
+  float gapS;           // After a loss, nothing is delivered for this long
+  float noiseG;         // Added to each packet, uniform in -noiseG..noiseG
+  float spikeProb;      // Probability a packet is a knock (0..1)
+  float spikeG;         // How far a knock is off, either way
+  float tareDipG;       // Reading below zero right after a tare
+};
+
+// Lunar-like defaults: 10 packets/s, a typical BLE connection interval of
+// delay, no losses, an ideal load cell
+extern const VirtualScaleConfig VIRTUAL_SCALE_DEFAULTS;
+
+struct VirtualScale {
+  VirtualScaleConfig config;
+  const float* traceTimeS;  // Not copied: must outlive the replay
+  const float* traceWeight;
+  int traceLen;
+
+  bool timerRunning;
+  float timerStartS;    // Real time the replay started
+  float frozenTraceS;   // Trace time while the timer is stopped
+  float tareG;
+  float tareAtS;        // Real time of the last tare
+  float nextPacketS;    // Real time of the next packet, < 0 = not started
+  float gapUntilS;      // Losses until this real time
+  float lastDeliverS;   // Keeps delivery in order despite jitter
+  uint32_t rng;
+
+  float inFlightWeight[VIRTUAL_SCALE_IN_FLIGHT];
+  float inFlightDeliverS[VIRTUAL_SCALE_IN_FLIGHT];
+  int inFlightHead;
+  int inFlightCount;
+
+  uint32_t generated;  // Packets the scale sent
+  uint32_t dropped;    // ... lost on the way
+};
+
+// Start on a trace (len >= 1, times increasing); seed != 0 makes a run
+// repeatable
+void virtualScaleInit(VirtualScale* v, const VirtualScaleConfig& config,
+                      const float* timeS, const float* weight, int len, uint32_t seed);
+
+void virtualScaleStartTimer(VirtualScale* v, float nowS);
+void virtualScaleStopTimer(VirtualScale* v, float nowS);
+void virtualScaleResetTimer(VirtualScale* v);
+void virtualScaleTare(VirtualScale* v, float nowS);
+
+// Weight the trace shows at real time nowS (before tare, no resolution or
+// delivery effects): the truth the packets are made from
+float virtualScaleTrueWeight(const VirtualScale* v, float nowS);
+
+// Next packet delivered by nowS, oldest first; false when none is due.
+// Call repeatedly until false.
+bool virtualScaleRead(VirtualScale* v, float nowS, float* weight);
+
+// True once the timer ran past the end of the trace
+bool virtualScaleFinished(const VirtualScale* v, float nowS);
+
+#endif // VIRTUAL_SCALE_H
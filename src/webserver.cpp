@@ -10,14 +10,28 @@
 // WiFi headers or it clobbers their parameter names
 #include <secrets.h>
 #include "cleaning_cycle.h"
-#include "dashboard.h"
 #include "debug.h"
+#include "live_config.h"
+#include "metrics.h"
+#include "pid_autotune.h"
+#include "pressure_control.h"
+#include "pressure_profile.h"
+#include "profile_library.h"
+#include "pump_calibration.h"
+#include "pump_dimmer.h"
+#include "pump_model.h"
+#include "scale.h"
 #include "settings.h"
 #include "shot_history.h"
 #include "shot_stopper.h"
+#include "sim_worker.h"
+#include "web_assets.h"  // Generated by tools/embed_web_assets.py
 
 #define WIFI_CONNECT_TIMEOUT_MS 15000
 
+// Largest accepted /config PATCH body: a full profile plus the scalar sections
+#define CONFIG_BODY_MAX (PROFILE_BODY_MAX + 512)
+
 bool wifiConnected = false;
 bool serverStarted = false;
 
@@ -25,12 +39,26 @@ volatile bool webStartRequest = false;
 volatile bool webStopRequest = false;
 volatile bool webResetRequest = false;
 volatile bool webRebootRequest = false;
+volatile uint32_t webStateGeneration = 0;
 
 static AsyncWebServer server(80);
 
 // PID controller to monitor/tune, set by initializeServer()
 static PIDController* webPid = nullptr;
 
+// /state response cache. All handlers run in the single AsyncTCP task, so
+// the cache needs no lock; the String keeps its capacity across renders, and
+// each request only copies it into its response.
+static String stateJson;
+static uint32_t stateJsonGeneration = 0;
+static bool stateJsonValid = false;
+static uint32_t stateCacheHits = 0;     // Requests served from the cache
+static uint32_t stateCacheRenders = 0;  // Requests that had to serialize
+
+// /config working copy; static (AsyncTCP task only) to keep the profile it
+// holds off that task's stack
+static LiveConfig webConfig;
+
 // Try one set of credentials with a bounded wait; returns the WiFi status
 static bool tryWifi(const char* trySsid, const char* tryPass) {
   WiFi.begin(trySsid, tryPass);
@@ -43,6 +71,425 @@ static bool tryWifi(const char* trySsid, const char* tryPass) {
   return WiFi.status() == WL_CONNECTED;
 }
 
+// Serve an embedded gzip asset. A matching If-None-Match (the browser already
+// holds this exact build of the file) gets an empty 304 instead of the blob.
+// Every browser sends Accept-Encoding: gzip, so there is no identity fallback.
+static void serveWebAsset(AsyncWebServerRequest* req, const WebAsset& asset) {
+  AsyncWebServerResponse* res;
+  if (req->hasHeader("If-None-Match")
+      && req->header("If-None-Match").indexOf(asset.etag) >= 0) {
+    res = req->beginResponse(304);
+  } else {
+    res = req->beginResponse_P(200, asset.contentType, asset.gz, asset.gzLen);
+    res->addHeader("Content-Encoding", "gzip");
+  }
+  res->addHeader("ETag", asset.etag);
+  res->addHeader("Cache-Control", asset.cacheControl);
+  req->send(res);
+}
+
+// Identified plant and candidate gains (live /state and /autotune_simulation)
+static void addAutotuneResult(JsonObject o, const AutotuneResult& r) {
+  o["ultimateGain"] = r.ultimateGain;
+  o["ultimatePeriodS"] = r.ultimatePeriodS;
+  o["amplitudeBar"] = r.amplitudeBar;
+  o["deadTimeS"] = r.deadTimeS;
+  o["riseRateBarS"] = r.riseRateBarS;
+  o["fallRateBarS"] = r.fallRateBarS;
+  o["cycles"] = r.cycles;
+  JsonObject candidates = o["candidates"].to<JsonObject>();
+  for (int i = 0; i < AUTOTUNE_RULE_COUNT; i++) {
+    JsonObject c = candidates[autotuneRuleName(i)].to<JsonObject>();
+    c["kp"] = r.candidates[i].kp;
+    c["ki"] = r.candidates[i].ki;
+    c["kd"] = r.candidates[i].kd;
+  }
+}
+
+// One shot's (or a per-law mean's) control score
+static void addControlScore(JsonObject o, const ControlScore& c) {
+  o["iaeBarS"] = c.iaeBarS;
+  o["overshootBar"] = c.overshootBar;
+  o["settlingS"] = c.settlingS;
+  o["pumpTravel"] = c.pumpTravel;
+  o["scoredS"] = c.scoredS;
+}
+
+// Swap a validated profile into the live shot (unnamed until saved to the
+// library) and persist it
+static void applyProfileAndSave(const PressureProfile& profile) {
+  profileLibraryApplyCustom(profile);
+  DEBUG_SHOT_PRINT("Pressure profile set via web: %d by-time, %d by-time-left goals",
+                   profile.numByTime, profile.numByTimeLeft);
+  settingsSave();
+}
+
+// Store a validated profile in the library under the request's name param,
+// select it and persist; answers the request either way
+static void saveProfileToLibrary(AsyncWebServerRequest* req, const PressureProfile& profile) {
+  const char* err = profileLibrarySave(req->getParam("name")->value().c_str(), profile);
+  if (err) {
+    req->send(400, "text/plain", err);
+    return;
+  }
+  settingsSave();
+  req->send(200, "text/plain", shot.brewing ? "OK - saved, selected from the next shot" : "OK");
+}
+
+// Copy a recorded shot's weight trace out of the history; false if the id
+// is not (or no longer) there or the lock timed out
+static bool copyShotTrace(uint32_t id, float* timeS, float* weight, int* len) {
+  bool found = false;
+  if (shotHistoryLockTake(pdMS_TO_TICKS(100))) {
+    for (int i = 0; i < shotHistoryCount && !found; i++) {
+      const ShotRecord& rec = shotHistory[i];
+      if (rec.id == id) {
+        memcpy(timeS, rec.timeS, rec.numPoints * sizeof(float));
+        memcpy(weight, rec.weight, rec.numPoints * sizeof(float));
+        *len = rec.numPoints;
+        found = true;
+      }
+    }
+    shotHistoryLockGive();
+  }
+  return found;
+}
+
+// Virtual scale replay settings from the request's query (ms params as in
+// the UI); anything not given keeps its value in config
+static void parseVirtualScaleParams(AsyncWebServerRequest* req, VirtualScaleConfig* config) {
+  if (req->hasParam("speed")) {
+    config->speed = constrain(req->getParam("speed")->value().toFloat(), 0.1f, 20.0f);
+  }
+  if (req->hasParam("periodMs")) {
+    config->packetPeriodS = constrain(req->getParam("periodMs")->value().toFloat(), 20.0f, 1000.0f) / 1000.0f;
+  }
+  if (req->hasParam("latencyMs")) {
+    config->latencyS = constrain(req->getParam("latencyMs")->value().toFloat(), 0.0f, 2000.0f) / 1000.0f;
+  }
+  if (req->hasParam("jitterMs")) {
+    config->jitterS = constrain(req->getParam("jitterMs")->value().toFloat(), 0.0f, 2000.0f) / 1000.0f;
+  }
+  if (req->hasParam("dropProb")) {
+    config->dropProb = constrain(req->getParam("dropProb")->value().toFloat(), 0.0f, 1.0f);
+  }
+  if (req->hasParam("gapS")) {
+    config->gapS = constrain(req->getParam("gapS")->value().toFloat(), 0.0f, 10.0f);
+  }
+  if (req->hasParam("noiseG")) {
+    config->noiseG = constrain(req->getParam("noiseG")->value().toFloat(), 0.0f, 5.0f);
+  }
+  if (req->hasParam("spikeProb")) {
+    config->spikeProb = constrain(req->getParam("spikeProb")->value().toFloat(), 0.0f, 1.0f);
+  }
+  if (req->hasParam("spikeG")) {
+    config->spikeG = constrain(req->getParam("spikeG")->value().toFloat(), 0.0f, 200.0f);
+  }
+  if (req->hasParam("tareDipG")) {
+    config->tareDipG = constrain(req->getParam("tareDipG")->value().toFloat(), 0.0f, 20.0f);
+  }
+}
+
+// Collect a POST/PATCH body into one NUL-terminated buffer (freed with the
+// request) in req->_tempObject; left unset if the body exceeds max
+static void collectBody(AsyncWebServerRequest* req, uint8_t* data, size_t len,
+                        size_t index, size_t total, size_t max) {
+  if (total > max) {
+    return;
+  }
+  if (index == 0) {
+    req->_tempObject = malloc(total + 1);
+    if (req->_tempObject) {
+      ((char*)req->_tempObject)[total] = '\0';
+    }
+  }
+  if (req->_tempObject) {
+    memcpy((uint8_t*)req->_tempObject + index, data, len);
+  }
+}
+
+// /config as JSON; the key names are the ones a PATCH takes
+static void addLiveConfig(JsonObject o, const LiveConfig& c) {
+  o["goalWeight"] = c.goalWeight;
+  o["weightOffset"] = c.weightOffset;
+
+  // Same form as the POST /api/pressure_profile body
+  JsonObject profile = o["profile"].to<JsonObject>();
+  JsonArray times = profile["times"].to<JsonArray>();
+  JsonArray pressures = profile["pressures"].to<JsonArray>();
+  JsonArray flows = profile["flows"].to<JsonArray>();
+  JsonArray maxFlows = profile["maxFlows"].to<JsonArray>();
+  JsonArray ramps = profile["ramps"].to<JsonArray>();
+  JsonArray curves = profile["curves"].to<JsonArray>();
+  const PressureProfile& p = c.profile;
+  for (int i = 0; i < p.numByTime; i++) {
+    times.add(p.byTime[i].timeS);
+    pressures.add(p.byTime[i].pressure);
+    flows.add(p.flowByTime[i].targetFlow);
+    maxFlows.add(p.flowByTime[i].maxFlow);
+    ramps.add(p.transitionByTime[i].rampS);
+    curves.add(goalCurveName(p.transitionByTime[i].curve));
+  }
+  for (int i = 0; i < p.numByTimeLeft; i++) {
+    times.add(-p.byTimeLeft[i].timeLeftS);
+    pressures.add(p.byTimeLeft[i].pressure);
+    flows.add(p.flowByTimeLeft[i].targetFlow);
+    maxFlows.add(p.flowByTimeLeft[i].maxFlow);
+    ramps.add(p.transitionByTimeLeft[i].rampS);
+    curves.add(goalCurveName(p.transitionByTimeLeft[i].curve));
+  }
+
+  JsonObject cleaning = o["cleaning"].to<JsonObject>();
+  cleaning["maxPressure"] = c.cleaning.maxPressureBar;
+  cleaning["cycles"] = c.cleaning.cyclesPerPhase;
+  cleaning["holdS"] = c.cleaning.holdS;
+  cleaning["pauseS"] = c.cleaning.pauseS;
+  cleaning["soakS"] = c.cleaning.soakS;
+
+  JsonObject pid = o["pid"].to<JsonObject>();
+  pid["kp"] = c.kp;
+  pid["ki"] = c.ki;
+  pid["kd"] = c.kd;
+
+  o["controlLaw"] = pressureControlLawName(c.controlLaw);
+
+  JsonObject filter = o["weightFilter"].to<JsonObject>();
+  filter["median"] = c.weightFilter.medianN;
+  filter["maxRate"] = c.weightFilter.maxRateGps;
+  filter["rejectLimit"] = c.weightFilter.rejectLimit;
+  filter["blankS"] = c.weightFilter.blankS;
+}
+
+// One numeric /config member; false if it isn't a number
+static bool patchNumber(JsonVariantConst v, float* out) {
+  if (!v.is<float>()) {
+    return false;
+  }
+  *out = v.as<float>();
+  return true;
+}
+
+static bool patchInt(JsonVariantConst v, int lo, int hi, int* out) {
+  if (!v.is<int>() || v.as<int>() < lo || v.as<int>() > hi) {
+    return false;
+  }
+  *out = v.as<int>();
+  return true;
+}
+
+// Merge a /config PATCH into c, marking the sections it touches. Nested
+// sections merge member by member; the profile is replaced whole. Returns
+// nullptr on success, else a static error message. Range checks are left
+// to liveConfigValidate on the merged sections.
+static const char* parseConfigPatch(JsonObjectConst patch, LiveConfig* c) {
+  for (JsonPairConst kv : patch) {
+    const char* key = kv.key().c_str();
+    JsonVariantConst v = kv.value();
+    if (strcmp(key, "goalWeight") == 0) {
+      if (!patchNumber(v, &c->goalWeight)) return "goalWeight must be a number";
+      c->sections |= LIVE_CONFIG_GOAL_WEIGHT;
+    } else if (strcmp(key, "weightOffset") == 0) {
+      if (!patchNumber(v, &c->weightOffset)) return "weightOffset must be a number";
+      c->sections |= LIVE_CONFIG_WEIGHT_OFFSET;
+    } else if (strcmp(key, "profile") == 0) {
+      // Through the strict profile parser; handlers share the AsyncTCP
+      // task, so one static buffer serves them all
+      static char profileJson[PROFILE_BODY_MAX + 1];
+      if (!v.is<JsonObjectConst>()) return "profile must be an object";
+      size_t len = serializeJson(v, profileJson, sizeof(profileJson));
+      if (len >= sizeof(profileJson) - 1) return "profile too large";
+      const char* err = profileParseJson(profileJson, &c->profile);
+      if (err) return err;
+      c->sections |= LIVE_CONFIG_PROFILE;
+    } else if (strcmp(key, "cleaning") == 0) {
+      if (!v.is<JsonObjectConst>()) return "cleaning must be an object";
+      for (JsonPairConst m : v.as<JsonObjectConst>()) {
+        const char* k = m.key().c_str();
+        bool ok;
+        if (strcmp(k, "maxPressure") == 0)   ok = patchNumber(m.value(), &c->cleaning.maxPressureBar);
+        else if (strcmp(k, "cycles") == 0)   ok = patchInt(m.value(), 1, 10, &c->cleaning.cyclesPerPhase);
+        else if (strcmp(k, "holdS") == 0)    ok = patchNumber(m.value(), &c->cleaning.holdS);
+        else if (strcmp(k, "pauseS") == 0)   ok = patchNumber(m.value(), &c->cleaning.pauseS);
+        else if (strcmp(k, "soakS") == 0)    ok = patchNumber(m.value(), &c->cleaning.soakS);
+        else return "unknown cleaning key";
+        if (!ok) return "invalid cleaning value";
+      }
+      c->sections |= LIVE_CONFIG_CLEANING;
+    } else if (strcmp(key, "pid") == 0) {
+      if (!v.is<JsonObjectConst>()) return "pid must be an object";
+      for (JsonPairConst m : v.as<JsonObjectConst>()) {
+        const char* k = m.key().c_str();
+        bool ok;
+        if (strcmp(k, "kp") == 0)        ok = patchNumber(m.value(), &c->kp);
+        else if (strcmp(k, "ki") == 0)   ok = patchNumber(m.value(), &c->ki);
+        else if (strcmp(k, "kd") == 0)   ok = patchNumber(m.value(), &c->kd);
+        else return "unknown pid key";
+        if (!ok) return "pid gains must be numbers";
+      }
+      c->sections |= LIVE_CONFIG_PID;
+    } else if (strcmp(key, "controlLaw") == 0) {
+      c->controlLaw = v.is<const char*>() ? pressureControlLawFromName(v.as<const char*>()) : -1;
+      if (c->controlLaw < 0) return "controlLaw must be pid, gaggiuino or mpc";
+      c->sections |= LIVE_CONFIG_CONTROL_LAW;
+    } else if (strcmp(key, "weightFilter") == 0) {
+      if (!v.is<JsonObjectConst>()) return "weightFilter must be an object";
+      for (JsonPairConst m : v.as<JsonObjectConst>()) {
+        const char* k = m.key().c_str();
+        int n;
+        bool ok;
+        if (strcmp(k, "median") == 0) {
+          ok = patchInt(m.value(), 0, 255, &n);
+          if (ok) c->weightFilter.medianN = n;
+        } else if (strcmp(k, "rejectLimit") == 0) {
+          ok = patchInt(m.value(), 0, 255, &n);
+          if (ok) c->weightFilter.rejectLimit = n;
+        } else if (strcmp(k, "maxRate") == 0) {
+          ok = patchNumber(m.value(), &c->weightFilter.maxRateGps);
+        } else if (strcmp(k, "blankS") == 0) {
+          ok = patchNumber(m.value(), &c->weightFilter.blankS);
+        } else {
+          return "unknown weightFilter key";
+        }
+        if (!ok) return "invalid weightFilter value";
+      }
+      c->sections |= LIVE_CONFIG_WEIGHT_FILTER;
+    } else {
+      return "unknown key";
+    }
+  }
+  return nullptr;
+}
+
+static void addBenchmarkResult(JsonObject o, const PredictorBenchmarkResult& r) {
+  o["runs"] = r.runs;
+  o["stopped"] = r.stopped;
+  o["meanErrorG"] = r.meanErrorG;
+  o["meanAbsErrorG"] = r.meanAbsErrorG;
+  o["maxAbsErrorG"] = r.maxAbsErrorG;
+  o["meanStopS"] = r.meanStopS;
+  o["packets"] = r.packets;
+  o["dropped"] = r.dropped;
+  o["filtered"] = r.filtered;
+}
+
+// Serialize everything the dashboard polls into stateJson
+static void renderStateJson() {
+  JsonDocument doc;
+  doc["brewing"] = shot.brewing;
+  doc["scaleConnected"] = (bool)scaleConnected;
+  doc["scaleDriver"] = scaleDriverName(scaleDriverSelected);
+  WeightFilterConfig filter;
+  scaleFilterConfig(&filter);
+  JsonObject wf = doc["weightFilter"].to<JsonObject>();
+  wf["median"] = filter.medianN;
+  wf["maxRate"] = filter.maxRateGps;
+  wf["rejectLimit"] = filter.rejectLimit;
+  wf["blankS"] = filter.blankS;
+  doc["shotTimer"] = shot.shotTimer;
+  doc["expectedEnd"] = shot.expectedEndS;
+  doc["weight"] = (float)currentWeight;
+  doc["goalWeight"] = shot.goalWeight;
+  doc["weightOffset"] = shot.weightOffset;
+  doc["pressure"] = shot.pressure;
+  doc["goalPressure"] = shot.currentGoalPressure;
+  doc["goalFlow"] = shot.currentGoalFlow;
+  doc["goalMaxFlow"] = shot.currentMaxFlow;
+  doc["pumpPwm"] = shot.pumpPwm;
+  doc["pumpFlow"] = shot.pumpFlow;
+  doc["psmModulator"] = psmModulatorName(pumpDimmerModulator());
+  // Law for the next shot; the one running a shot is in /shots afterwards
+  doc["controller"] = pressureControlLawName(pressureControlSelected);
+
+  // Learned pump curve (pump_calibration.h): in use once confidence > 0
+  JsonObject cal = doc["pumpCalibration"].to<JsonObject>();
+  cal["samples"] = pumpCalibrationSamples();
+  cal["relStd"] = pumpCalibrationRelStd();
+  cal["confidence"] = pumpCalibrationConfidence();
+  cal["flowPerClick9Bar"] = getPumpFlowPerClick(9.0f);
+  cal["modelFlowPerClick9Bar"] = getPumpFlowPerClickModel(9.0f);
+  // SSID only, never the password; empty = compile-time secrets.h in use
+  doc["wifiSsid"] = settings.wifiSsid;
+
+  // Cleaning cycle status + live config (for the dashboard editors)
+  JsonObject cl = doc["cleaning"].to<JsonObject>();
+  cl["active"] = cleaningActive();
+  cl["phase"] = cleaningPhaseName();
+  cl["state"] = cleaningStateName();
+  cl["cycle"] = cleaningCurrentCycle();
+  cl["cycles"] = cleaningConfig.cyclesPerPhase;
+  cl["elapsed"] = cleaningStateElapsedS();
+  cl["lastFillPeak"] = cleaningLastFillPeakBar();
+  cl["lastFillReachedMax"] = cleaningLastFillReachedMax();
+  cl["maxPressure"] = cleaningConfig.maxPressureBar;
+  cl["holdS"] = cleaningConfig.holdS;
+  cl["pauseS"] = cleaningConfig.pauseS;
+  cl["soakS"] = cleaningConfig.soakS;
+
+  JsonObject pid = doc["pid"].to<JsonObject>();
+  if (webPid) {
+    PidGains gains = webPid->getGains();
+    pid["kp"] = gains.kp;
+    pid["ki"] = gains.ki;
+    pid["kd"] = gains.kd;
+    pid["p"] = webPid->getPTerm();
+    pid["i"] = webPid->getITerm();
+    pid["d"] = webPid->getDTerm();
+    pid["out"] = webPid->getOutput();
+  }
+
+  // PID autotune (pid_autotune.h): status, and the last identified plant
+  JsonObject at = doc["autotune"].to<JsonObject>();
+  at["status"] = autotuneStatusName();
+  at["cycles"] = autotuneCyclesMeasured();
+  if (autotuneFailReason()) {
+    at["failReason"] = autotuneFailReason();
+  }
+  AutotuneResult tuned;
+  if (autotuneLastResult(&tuned)) {
+    addAutotuneResult(at["result"].to<JsonObject>(), tuned);
+  }
+
+  // Library profile in force ("" = custom) and the one the next shot runs
+  char profileName[PROFILE_NAME_MAX];
+  profileLibraryActiveName(profileName);
+  doc["profileName"] = profileName;
+  profileLibrarySelectedName(profileName);
+  doc["profileSelected"] = profileName;
+
+  // Pressure profile: by-time goals as positive times, by-time-left goals
+  // as negative times (same convention as /set_pressure_profile input)
+  JsonArray times = doc["profileTimes"].to<JsonArray>();
+  JsonArray pressures = doc["profilePressures"].to<JsonArray>();
+  JsonArray flows = doc["profileFlows"].to<JsonArray>();
+  JsonArray maxFlows = doc["profileMaxFlows"].to<JsonArray>();
+  JsonArray ramps = doc["profileRamps"].to<JsonArray>();
+  JsonArray curves = doc["profileCurves"].to<JsonArray>();
+  for (int i = 0; i < shot.numPressureGoalsByTime; i++) {
+    times.add(shot.pressureGoalByTime[i].timeS);
+    pressures.add(shot.pressureGoalByTime[i].pressure);
+    flows.add(shot.flowGoalByTime[i].targetFlow);
+    maxFlows.add(shot.flowGoalByTime[i].maxFlow);
+    ramps.add(shot.transitionByTime[i].rampS);
+    curves.add(goalCurveName(shot.transitionByTime[i].curve));
+  }
+  for (int i = 0; i < shot.numPressureGoalsByTimeLeft; i++) {
+    times.add(-shot.pressureGoalByTimeLeft[i].timeLeftS);
+    pressures.add(shot.pressureGoalByTimeLeft[i].pressure);
+    flows.add(shot.flowGoalByTimeLeft[i].targetFlow);
+    maxFlows.add(shot.flowGoalByTimeLeft[i].maxFlow);
+    ramps.add(shot.transitionByTimeLeft[i].rampS);
+    curves.add(goalCurveName(shot.transitionByTimeLeft[i].curve));
+  }
+
+  // Cache effectiveness as of this render (hits since boot / renders)
+  JsonObject cache = doc["stateCache"].to<JsonObject>();
+  cache["hits"] = stateCacheHits;
+  cache["renders"] = stateCacheRenders;
+
+  stateJson = "";
+  serializeJson(doc, stateJson);
+}
+
 bool initializeWiFi() {
   WiFi.mode(WIFI_STA);
   WiFi.setAutoReconnect(true);
@@ -77,70 +524,40 @@ void initializeServer(PIDController* pid) {
   // harmless for the dashboard (LAN-only, no credentials anywhere)
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
 
-  // Dashboard page
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest* req) {
-    req->send_P(200, "text/html", DASHBOARD_HTML);
-  });
+  // Dashboard page and its pinned Chart.js, precompressed at build time
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset& asset = WEB_ASSETS[i];
+    server.on(asset.path, HTTP_GET, [&asset](AsyncWebServerRequest* req) {
+      serveWebAsset(req, asset);
+    });
+  }
 
-  // Single JSON state endpoint: everything the dashboard polls, in one request
+  // Single JSON state endpoint: everything the dashboard polls, in one
+  // request. Rendered at most once per control snapshot (webStateGeneration)
+  // and shared by every client polling within it.
   server.on("/state", HTTP_GET, [](AsyncWebServerRequest* req) {
-    JsonDocument doc;
-    doc["brewing"] = shot.brewing;
-    doc["scaleConnected"] = (bool)scaleConnected;
-    doc["shotTimer"] = shot.shotTimer;
-    doc["expectedEnd"] = shot.expectedEndS;
-    doc["weight"] = (float)currentWeight;
-    doc["goalWeight"] = shot.goalWeight;
-    doc["weightOffset"] = shot.weightOffset;
-    doc["pressure"] = shot.pressure;
-    doc["goalPressure"] = shot.currentGoalPressure;
-    doc["pumpPwm"] = shot.pumpPwm;
-    doc["pumpFlow"] = shot.pumpFlow;
-    // SSID only, never the password; empty = compile-time secrets.h in use
-    doc["wifiSsid"] = settings.wifiSsid;
-
-    // Cleaning cycle status + live config (for the dashboard editors)
-    JsonObject cl = doc["cleaning"].to<JsonObject>();
-    cl["active"] = cleaningActive();
-    cl["phase"] = cleaningPhaseName();
-    cl["state"] = cleaningStateName();
-    cl["cycle"] = cleaningCurrentCycle();
-    cl["cycles"] = cleaningConfig.cyclesPerPhase;
-    cl["elapsed"] = cleaningStateElapsedS();
-    cl["lastFillPeak"] = cleaningLastFillPeakBar();
-    cl["lastFillReachedMax"] = cleaningLastFillReachedMax();
-    cl["maxPressure"] = cleaningConfig.maxPressureBar;
-    cl["holdS"] = cleaningConfig.holdS;
-    cl["pauseS"] = cleaningConfig.pauseS;
-    cl["soakS"] = cleaningConfig.soakS;
-
-    JsonObject pid = doc["pid"].to<JsonObject>();
-    if (webPid) {
-      pid["kp"] = webPid->kp;
-      pid["ki"] = webPid->ki;
-      pid["kd"] = webPid->kd;
-      pid["p"] = webPid->getPTerm();
-      pid["i"] = webPid->getITerm();
-      pid["d"] = webPid->getDTerm();
-      pid["out"] = webPid->getOutput();
-    }
-
-    // Pressure profile: by-time goals as positive times, by-time-left goals
-    // as negative times (same convention as /set_pressure_profile input)
-    JsonArray times = doc["profileTimes"].to<JsonArray>();
-    JsonArray pressures = doc["profilePressures"].to<JsonArray>();
-    for (int i = 0; i < shot.numPressureGoalsByTime; i++) {
-      times.add(shot.pressureGoalByTime[i].timeS);
-      pressures.add(shot.pressureGoalByTime[i].pressure);
-    }
-    for (int i = 0; i < shot.numPressureGoalsByTimeLeft; i++) {
-      times.add(-shot.pressureGoalByTimeLeft[i].timeLeftS);
-      pressures.add(shot.pressureGoalByTimeLeft[i].pressure);
+    uint32_t generation = webStateGeneration;
+    if (stateJsonValid && generation == stateJsonGeneration) {
+      stateCacheHits++;
+    } else {
+      stateCacheRenders++;
+      renderStateJson();
+      stateJsonGeneration = generation;
+      stateJsonValid = true;
     }
+    req->send(200, "application/json", stateJson);
+  });
 
-    AsyncResponseStream* res = req->beginResponseStream("application/json");
-    serializeJson(doc, *res);
-    req->send(res);
+  // Prometheus text exposition of firmware internals (metrics.cpp), for a
+  // LAN scraper graphing the machine over days
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest* req) {
+    String body;
+    metricsRender(body);
+    metricsWrite(body, "espresso_state_cache_hits_total", "counter",
+                 "/state requests served from the cached JSON", stateCacheHits);
+    metricsWrite(body, "espresso_state_cache_renders_total", "counter",
+                 "/state requests that serialized a new snapshot", stateCacheRenders);
+    req->send(200, "text/plain; version=0.0.4", body);
   });
 
   // Start/stop: request only, executed by the control task
@@ -203,18 +620,427 @@ void initializeServer(PIDController* pid) {
     req->send(200, "text/plain", "OK");
   });
 
+  // PID autotune (relay experiment, blind basket required): request flags
+  // only, executed by the control task via autotuneUpdate()
+  server.on("/start_autotune", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (shot.brewing || cleaningActive()) {
+      req->send(409, "text/plain", "busy: shot or cleaning in progress");
+      return;
+    }
+    autotuneStartRequest = true;
+    req->send(200, "text/plain", "OK");
+  });
+  server.on("/stop_autotune", HTTP_GET, [](AsyncWebServerRequest* req) {
+    autotuneStopRequest = true;
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Experiment parameters; each is optional and range-checked (not
+  // persisted - the defaults suit most machines)
+  server.on("/set_autotune", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (autotuneActive()) {
+      req->send(409, "text/plain", "autotune in progress");
+      return;
+    }
+    if (req->hasParam("setpoint")) {
+      float v = req->getParam("setpoint")->value().toFloat();
+      if (v >= 2 && v <= 10) autotuneConfig.setpointBar = v;
+    }
+    if (req->hasParam("hysteresis")) {
+      float v = req->getParam("hysteresis")->value().toFloat();
+      if (v >= 0.02f && v <= 1) autotuneConfig.hysteresisBar = v;
+    }
+    if (req->hasParam("high")) {
+      int v = req->getParam("high")->value().toInt();
+      if (v > autotuneConfig.relayLow && v <= 255) autotuneConfig.relayHigh = v;
+    }
+    if (req->hasParam("low")) {
+      int v = req->getParam("low")->value().toInt();
+      if (v >= 0 && v < autotuneConfig.relayHigh) autotuneConfig.relayLow = v;
+    }
+    if (req->hasParam("cycles")) {
+      int v = req->getParam("cycles")->value().toInt();
+      if (v >= 2 && v <= 10) autotuneConfig.cycles = v;
+    }
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Apply one candidate of the last completed experiment to the live PID
+  server.on("/apply_autotune", HTTP_GET, [](AsyncWebServerRequest* req) {
+    int rule = req->hasParam("rule")
+        ? autotuneRuleFromName(req->getParam("rule")->value().c_str()) : -1;
+    if (rule < 0) {
+      req->send(400, "text/plain", "rule must be ziegler_nichols, some_overshoot or no_overshoot");
+      return;
+    }
+    AutotuneResult r;
+    if (!webPid || !autotuneLastResult(&r)) {
+      req->send(409, "text/plain", "no completed autotune");
+      return;
+    }
+    PidGains gains = r.candidates[rule];
+    webPid->setGains(gains);
+    DEBUG_SHOT_PRINT("PID gains set from autotune (%s): Kp=%.1f Ki=%.2f Kd=%.1f",
+                     autotuneRuleName(rule), gains.kp, gains.ki, gains.kd);
+    req->send(200, "text/plain", "OK");
+  });
+
+  // The same experiment against the simulated blind basket
+  // (pressure_control.h), with each candidate then scored on the simulated
+  // puck by the controller benchmark. Runs in the simulation worker
+  // (sim_worker.h): 202, then poll /autotune_simulation_result
+  server.on("/autotune_simulation", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!webPid) {
+      req->send(503, "text/plain", "Controller not ready");
+      return;
+    }
+    if (shot.brewing) {
+      req->send(409, "text/plain", "Shot running");
+      return;
+    }
+    if (!simWorkerStartAutotuneSimulation(autotuneConfig)) {
+      req->send(409, "text/plain", "Simulation running");
+      return;
+    }
+    req->send(202, "text/plain", "Started");
+  });
+
+  // 202 while the simulation runs, then its result until the next one
+  server.on("/autotune_simulation_result", HTTP_GET, [](AsyncWebServerRequest* req) {
+    AutotuneSimulationJob job;
+    SimJobState state = simWorkerAutotuneSimulation(&job);
+    if (state == SimJobState::IDLE) {
+      req->send(404, "text/plain", "no simulation started");
+      return;
+    }
+    if (state != SimJobState::DONE) {
+      req->send(202, "text/plain", "Running");
+      return;
+    }
+    JsonDocument doc;
+    if (job.status != AutotuneStatus::DONE) {
+      doc["failReason"] = job.failReason;
+    } else {
+      JsonObject result = doc["result"].to<JsonObject>();
+      addAutotuneResult(result, job.result);
+      for (int i = 0; i < AUTOTUNE_RULE_COUNT; i++) {
+        const BenchmarkResult& b = job.candidates[i];
+        JsonArray steps = result["candidates"][autotuneRuleName(i)]["benchmark"].to<JsonArray>();
+        for (int k = 0; k < BENCHMARK_STEP_COUNT; k++) {
+          JsonObject st = steps.add<JsonObject>();
+          st["goalBar"] = b.steps[k].goalBar;
+          st["overshootBar"] = b.steps[k].overshootBar;
+          st["settlingS"] = b.steps[k].settlingS;
+          st["iaeBarS"] = b.steps[k].iaeBarS;
+        }
+      }
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
   // Live PID tuning; each gain is optional
   server.on("/set_pid", HTTP_GET, [](AsyncWebServerRequest* req) {
     if (webPid) {
-      if (req->hasParam("kp")) webPid->kp = req->getParam("kp")->value().toFloat();
-      if (req->hasParam("ki")) webPid->ki = req->getParam("ki")->value().toFloat();
-      if (req->hasParam("kd")) webPid->kd = req->getParam("kd")->value().toFloat();
+      PidGains gains = webPid->getGains();
+      if (req->hasParam("kp")) gains.kp = req->getParam("kp")->value().toFloat();
+      if (req->hasParam("ki")) gains.ki = req->getParam("ki")->value().toFloat();
+      if (req->hasParam("kd")) gains.kd = req->getParam("kd")->value().toFloat();
+      const char* err = pidGainsValidate(gains);
+      if (err) {
+        req->send(400, "text/plain", err);
+        return;
+      }
+      webPid->setGains(gains);
       DEBUG_SHOT_PRINT("PID gains set via web: Kp=%.1f Ki=%.2f Kd=%.1f",
-                       webPid->kp, webPid->ki, webPid->kd);
+                       gains.kp, gains.ki, gains.kd);
     }
     req->send(200, "text/plain", "OK");
   });
 
+  // PSM modulator (psm_modulator.h), switchable live for A/B on real shots
+  server.on("/set_psm_modulator", HTTP_GET, [](AsyncWebServerRequest* req) {
+    PsmModulator m;
+    if (!req->hasParam("type")
+        || !psmModulatorFromName(req->getParam("type")->value().c_str(), &m)) {
+      req->send(400, "text/plain", "type must be first_order, second_order or dithered");
+      return;
+    }
+    pumpDimmerSetModulator(m);
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Forget the learned pump curve (e.g. after replacing the pump). Refused
+  // mid-shot, while the control task is feeding the fit.
+  server.on("/reset_pump_calibration", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (shot.brewing) {
+      req->send(409, "text/plain", "Shot in progress");
+      return;
+    }
+    pumpCalibrationReset();
+    settingsSave();
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Offline level sweep of every PSM modulator: RMS of the low-passed click
+  // error per level (percent of full click rate, lower = smoother). Pure
+  // simulation, ~100k modulator steps; ?cycles= sets the length per level.
+  server.on("/psm_analysis", HTTP_GET, [](AsyncWebServerRequest* req) {
+    int cycles = req->hasParam("cycles") ? req->getParam("cycles")->value().toInt() : 1000;
+    cycles = constrain(cycles, 100, 5000);
+    const int levelStep = 8;
+    JsonDocument doc;
+    doc["cycles"] = cycles;
+    doc["cutoffHz"] = PSM_LF_CUTOFF_HZ;
+    JsonArray levels = doc["levels"].to<JsonArray>();
+    for (int level = levelStep; level < PSM_RANGE; level += levelStep) {
+      levels.add(level);
+    }
+    JsonObject results = doc["modulators"].to<JsonObject>();
+    for (int i = 0; i < PSM_MODULATOR_COUNT; i++) {
+      PsmModulator m = (PsmModulator)i;
+      JsonObject r = results[psmModulatorName(m)].to<JsonObject>();
+      JsonArray errors = r["lfError"].to<JsonArray>();
+      float sum = 0, worst = 0;
+      int n = 0;
+      for (int level = levelStep; level < PSM_RANGE; level += levelStep) {
+        float e = psmLowFrequencyError(m, level, cycles);
+        errors.add(e);
+        sum += e;
+        worst = max(worst, e);
+        n++;
+      }
+      r["mean"] = sum / n;
+      r["worst"] = worst;
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // Closed-loop comparison of the pressure control laws on a simulated
+  // group (pressure_control.cpp); the PID runs with the live gains. Runs
+  // in the simulation worker (sim_worker.h): 202, then poll
+  // /controller_benchmark_result
+  server.on("/controller_benchmark", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!webPid) {
+      req->send(503, "text/plain", "Controller not ready");
+      return;
+    }
+    if (shot.brewing) {
+      req->send(409, "text/plain", "Shot running");
+      return;
+    }
+    if (!simWorkerStartControllerBenchmark(webPid->getGains())) {
+      req->send(409, "text/plain", "Simulation running");
+      return;
+    }
+    req->send(202, "text/plain", "Started");
+  });
+
+  // 202 while the benchmark runs, then its result until the next one
+  server.on("/controller_benchmark_result", HTTP_GET, [](AsyncWebServerRequest* req) {
+    ControllerBenchmarkJob job;
+    SimJobState state = simWorkerControllerBenchmark(&job);
+    if (state == SimJobState::IDLE) {
+      req->send(404, "text/plain", "no benchmark started");
+      return;
+    }
+    if (state != SimJobState::DONE) {
+      req->send(202, "text/plain", "Running");
+      return;
+    }
+    JsonDocument doc;
+    doc["settleBandBar"] = CONTROL_SETTLE_BAND_BAR;
+    doc["kp"] = job.gains.kp;
+    doc["ki"] = job.gains.ki;
+    doc["kd"] = job.gains.kd;
+    JsonObject results = doc["controllers"].to<JsonObject>();
+    for (int law = 0; law < PRESSURE_CONTROL_LAW_COUNT; law++) {
+      const BenchmarkResult& r = job.laws[law];
+      JsonObject o = results[pressureControlLawName(law)].to<JsonObject>();
+      JsonArray steps = o["steps"].to<JsonArray>();
+      for (int i = 0; i < BENCHMARK_STEP_COUNT; i++) {
+        JsonObject st = steps.add<JsonObject>();
+        st["goalBar"] = r.steps[i].goalBar;
+        st["overshootBar"] = r.steps[i].overshootBar;
+        st["settlingS"] = r.steps[i].settlingS;
+        st["iaeBarS"] = r.steps[i].iaeBarS;
+      }
+      o["pumpTravel"] = r.pumpTravel;
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // Registered control laws, the one selected for new shots, and each law's
+  // mean score over the shots since boot (A/B on real shots)
+  server.on("/controllers", HTTP_GET, [](AsyncWebServerRequest* req) {
+    JsonDocument doc;
+    doc["selected"] = pressureControlLawName(pressureControlSelected);
+    doc["settleBandBar"] = CONTROL_SETTLE_BAND_BAR;
+    JsonObject laws = doc["controllers"].to<JsonObject>();
+    for (int law = 0; law < PRESSURE_CONTROL_LAW_COUNT; law++) {
+      ControlLawStats st;
+      pressureControlStats(law, &st);
+      JsonObject o = laws[pressureControlLawName(law)].to<JsonObject>();
+      o["shots"] = st.shots;
+      if (st.shots > 0) {
+        ControlScore mean = st.sum;
+        mean.iaeBarS /= st.shots;
+        mean.overshootBar /= st.shots;
+        mean.settlingS /= st.shots;
+        mean.pumpTravel /= st.shots;
+        mean.scoredS /= st.shots;
+        addControlScore(o["mean"].to<JsonObject>(), mean);
+      }
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // Control law for the following shots (a running shot keeps its own)
+  server.on("/set_controller", HTTP_GET, [](AsyncWebServerRequest* req) {
+    int law = req->hasParam("law")
+        ? pressureControlLawFromName(req->getParam("law")->value().c_str()) : -1;
+    if (law < 0) {
+      req->send(400, "text/plain", "law must be pid, gaggiuino or mpc");
+      return;
+    }
+    pressureControlSelected = law;
+    DEBUG_SHOT_PRINT("Pressure control law for new shots set via web: %s",
+                     pressureControlLawName(law));
+    settingsSave();
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Scale driver the scale task runs (scale.h); RAM-only, a reboot returns
+  // to the compiled-in default. Not mid-shot: the switch drops the link
+  server.on("/set_scale", HTTP_GET, [](AsyncWebServerRequest* req) {
+    int driver = req->hasParam("driver")
+        ? scaleDriverFromName(req->getParam("driver")->value().c_str()) : -1;
+    if (driver < 0) {
+      req->send(400, "text/plain", "driver must be acaia or virtual");
+      return;
+    }
+    if (shot.brewing) {
+      req->send(409, "text/plain", "Shot running");
+      return;
+    }
+    scaleDriverSelected = driver;
+    DEBUG_SCALE_PRINT("Scale driver set via web: %s", scaleDriverName(driver));
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Virtual scale replay: shot=<history id> replays that shot's weight
+  // (otherwise the loaded trace stays), plus speed, periodMs, latencyMs,
+  // jitterMs, dropProb, gapS, noiseG, spikeProb, spikeG, tareDipG
+  server.on("/set_virtual_scale", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (shot.brewing) {
+      req->send(409, "text/plain", "Shot running");
+      return;
+    }
+    VirtualScaleConfig config;
+    int len;
+    scaleVirtualConfig(&config, &len);
+    parseVirtualScaleParams(req, &config);
+    float timeS[HISTORY_MAX_POINTS];
+    float weight[HISTORY_MAX_POINTS];
+    len = 0;
+    if (req->hasParam("shot")) {
+      uint32_t id = (uint32_t)req->getParam("shot")->value().toInt();
+      if (!copyShotTrace(id, timeS, weight, &len) || len < 2) {
+        req->send(404, "text/plain", "shot not found");
+        return;
+      }
+    }
+    scaleVirtualConfigure(config, timeS, weight, len);
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Replays a recorded shot through the virtual scale with the given link
+  // and load cell impairments and reports how far the end-time predictor
+  // would miss the current goal weight (shot_predictor.h), on raw packets
+  // and through the live weight sanitizer. Runs in the request, so runs is
+  // capped at PREDICTOR_BENCHMARK_MAX_RUNS.
+  server.on("/predictor_benchmark", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!req->hasParam("shot")) {
+      req->send(400, "text/plain", "shot=<id> required");
+      return;
+    }
+    float timeS[HISTORY_MAX_POINTS];
+    float weight[HISTORY_MAX_POINTS];
+    int len = 0;
+    uint32_t id = (uint32_t)req->getParam("shot")->value().toInt();
+    if (!copyShotTrace(id, timeS, weight, &len) || len < 2) {
+      req->send(404, "text/plain", "shot not found");
+      return;
+    }
+    VirtualScaleConfig config = VIRTUAL_SCALE_DEFAULTS;
+    parseVirtualScaleParams(req, &config);
+    config.speed = 1.0f;  // Simulated time: speed changes nothing
+    int runs = req->hasParam("runs") ? req->getParam("runs")->value().toInt() : 10;
+    runs = constrain(runs, 1, PREDICTOR_BENCHMARK_MAX_RUNS);
+    float target = shot.goalWeight - shot.weightOffset;
+
+    // Same seeds for both: the difference is the sanitizer alone
+    WeightFilterConfig filter;
+    scaleFilterConfig(&filter);
+    PredictorBenchmarkResult raw;
+    PredictorBenchmarkResult filtered;
+    predictorBenchmark(timeS, weight, len, target, MIN_SHOT_DURATION_S, config, nullptr, runs, &raw);
+    predictorBenchmark(timeS, weight, len, target, MIN_SHOT_DURATION_S, config, &filter, runs, &filtered);
+    JsonDocument doc;
+    doc["shot"] = id;
+    doc["targetWeight"] = target;
+    doc["idealStopS"] = raw.idealStopS;
+    doc["latencyMs"] = config.latencyS * 1000.0f;
+    doc["jitterMs"] = config.jitterS * 1000.0f;
+    doc["dropProb"] = config.dropProb;
+    doc["gapS"] = config.gapS;
+    doc["noiseG"] = config.noiseG;
+    doc["spikeProb"] = config.spikeProb;
+    doc["spikeG"] = config.spikeG;
+    doc["tareDipG"] = config.tareDipG;
+    addBenchmarkResult(doc["raw"].to<JsonObject>(), raw);
+    addBenchmarkResult(doc["filtered"].to<JsonObject>(), filtered);
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // Weight sanitizer (weight_filter.h): median=1|3|5|7, maxRate (g/s, 0 =
+  // off), rejectLimit, blankS (0 = off); omitted params keep their value
+  server.on("/set_weight_filter", HTTP_GET, [](AsyncWebServerRequest* req) {
+    WeightFilterConfig config;
+    scaleFilterConfig(&config);
+    if (req->hasParam("median")) {
+      config.medianN = (uint8_t)constrain(req->getParam("median")->value().toInt(), 0, 255);
+    }
+    if (req->hasParam("rejectLimit")) {
+      config.rejectLimit = (uint8_t)constrain(req->getParam("rejectLimit")->value().toInt(), 0, 255);
+    }
+    if (req->hasParam("maxRate")) {
+      config.maxRateGps = req->getParam("maxRate")->value().toFloat();
+    }
+    if (req->hasParam("blankS")) {
+      config.blankS = req->getParam("blankS")->value().toFloat();
+    }
+    const char* err = weightFilterValidate(config);
+    if (err) {
+      req->send(400, "text/plain", err);
+      return;
+    }
+    scaleFilterConfigure(config);
+    DEBUG_SCALE_PRINT("Weight filter set via web: median %d, %.1f g/s gate (%d to step), %.2f s blanking",
+                      config.medianN, config.maxRateGps, config.rejectLimit, config.blankS);
+    settingsSave();
+    req->send(200, "text/plain", "OK");
+  });
+
   server.on("/set_goal_weight", HTTP_GET, [](AsyncWebServerRequest* req) {
     if (req->hasParam("value")) {
       float goalWeight = req->getParam("value")->value().toFloat();
@@ -237,52 +1063,164 @@ void initializeServer(PIDController* pid) {
     req->send(200, "text/plain", "OK");
   });
 
-  // Pressure profile: comma-separated times and pressures. Positive time =
-  // seconds from shot start; negative time = seconds left until expected end.
+  // Pressure profile: comma-separated times and pressures, optionally flows
+  // and maxFlows (ml/s), ramps (s) and curves (hold/linear/ease). Positive
+  // time = seconds from shot start; negative time = seconds left until
+  // expected end. Thin wrapper over the in-place parser (pressure_profile.cpp)
+  // for the dashboard editor; invalid input is rejected with 400, nothing
+  // applied.
   server.on("/set_pressure_profile", HTTP_GET, [](AsyncWebServerRequest* req) {
-    if (req->hasParam("times") && req->hasParam("pressures")) {
-      String times = req->getParam("times")->value();
-      String pressures = req->getParam("pressures")->value();
-
-      // Parse into locals first, then publish counts last, so the control
-      // task never sees a half-written profile
-      PressureGoalByTime byTime[MAX_PRESSURE_GOALS];
-      PressureGoalByTimeLeft byTimeLeft[MAX_PRESSURE_GOALS];
-      int numByTime = 0, numByTimeLeft = 0;
-
-      while (times.length() && pressures.length() &&
-             (numByTime < MAX_PRESSURE_GOALS || numByTimeLeft < MAX_PRESSURE_GOALS)) {
-        int timeIdx = times.indexOf(',');
-        String timeStr = timeIdx >= 0 ? times.substring(0, timeIdx) : times;
-        times = timeIdx >= 0 ? times.substring(timeIdx + 1) : "";
-        int pressureIdx = pressures.indexOf(',');
-        String pressureStr = pressureIdx >= 0 ? pressures.substring(0, pressureIdx) : pressures;
-        pressures = pressureIdx >= 0 ? pressures.substring(pressureIdx + 1) : "";
-
-        float timeVal = timeStr.toFloat();
-        float pressureVal = pressureStr.toFloat();
-
-        if (timeVal < 0 && numByTimeLeft < MAX_PRESSURE_GOALS) {
-          byTimeLeft[numByTimeLeft].timeLeftS = -timeVal;
-          byTimeLeft[numByTimeLeft].pressure = pressureVal;
-          numByTimeLeft++;
-        } else if (timeVal >= 0 && numByTime < MAX_PRESSURE_GOALS) {
-          byTime[numByTime].timeS = timeVal;
-          byTime[numByTime].pressure = pressureVal;
-          numByTime++;
-        }
+    if (!req->hasParam("times") || !req->hasParam("pressures")) {
+      req->send(400, "text/plain", "missing times or pressures");
+      return;
+    }
+    PressureProfile profile;
+    const char* flows = req->hasParam("flows") ? req->getParam("flows")->value().c_str() : nullptr;
+    const char* maxFlows = req->hasParam("maxFlows") ? req->getParam("maxFlows")->value().c_str() : nullptr;
+    const char* ramps = req->hasParam("ramps") ? req->getParam("ramps")->value().c_str() : nullptr;
+    const char* curves = req->hasParam("curves") ? req->getParam("curves")->value().c_str() : nullptr;
+    const char* err = profileParseCsv(req->getParam("times")->value().c_str(),
+                                      req->getParam("pressures")->value().c_str(),
+                                      flows, maxFlows, ramps, curves, &profile);
+    if (err) {
+      req->send(400, "text/plain", err);
+      return;
+    }
+    applyProfileAndSave(profile);
+    req->send(200, "text/plain", "OK");
+  });
+
+  // Same profile as a POST body: JSON {"times":[...],"pressures":[...]}
+  // (plus optional "flows"/"maxFlows"/"ramps"/"curves") or,
+  // with Content-Type application/octet-stream, the compact binary form
+  // (pressure_profile.h). The body is collected into one bounded buffer and
+  // parsed in place once complete. With ?name= it goes into the profile
+  // library under that name and is selected instead of applied at once.
+  server.on("/api/pressure_profile", HTTP_POST,
+    [](AsyncWebServerRequest* req) {
+      const char* body = (const char*)req->_tempObject;
+      if (!body) {
+        req->send(400, "text/plain", "missing or oversized body");
+        return;
+      }
+      PressureProfile profile;
+      const char* err = req->contentType() == "application/octet-stream"
+          ? profileParseBinary((const uint8_t*)body, req->contentLength(), &profile)
+          : profileParseJson(body, &profile);
+      if (err) {
+        req->send(400, "text/plain", err);
+        return;
       }
+      if (req->hasParam("name")) {
+        saveProfileToLibrary(req, profile);
+        return;
+      }
+      applyProfileAndSave(profile);
+      req->send(200, "text/plain", "OK");
+    },
+    nullptr,
+    [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+      // Oversized: _tempObject stays unset, answered with 400 above
+      collectBody(req, data, len, index, total, PROFILE_BODY_MAX);
+    });
 
-      shot.numPressureGoalsByTime = 0;
-      shot.numPressureGoalsByTimeLeft = 0;
-      memcpy(shot.pressureGoalByTime, byTime, sizeof(byTime));
-      memcpy(shot.pressureGoalByTimeLeft, byTimeLeft, sizeof(byTimeLeft));
-      shot.numPressureGoalsByTime = numByTime;
-      shot.numPressureGoalsByTimeLeft = numByTimeLeft;
-      DEBUG_SHOT_PRINT("Pressure profile set via web: %d by-time, %d by-time-left goals",
-                       numByTime, numByTimeLeft);
-      settingsSave();
+  // Every live-tunable parameter as one resource (live_config.h). GET reads
+  // it; PATCH merges any subset, validates the result as a whole and has
+  // the control task apply it between two iterations, with one settings
+  // commit - or applies nothing and answers 400. Answers with the config
+  // the patch puts in force.
+  server.on("/config", HTTP_GET, [](AsyncWebServerRequest* req) {
+    liveConfigSnapshot(webPid, &webConfig);
+    JsonDocument doc;
+    addLiveConfig(doc.to<JsonObject>(), webConfig);
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+  server.on("/config", HTTP_PATCH,
+    [](AsyncWebServerRequest* req) {
+      const char* body = (const char*)req->_tempObject;
+      if (!body) {
+        liveConfigCountRejected();
+        req->send(400, "text/plain", "missing or oversized body");
+        return;
+      }
+      JsonDocument patch;
+      if (deserializeJson(patch, body) || !patch.is<JsonObjectConst>()) {
+        liveConfigCountRejected();
+        req->send(400, "text/plain", "body must be a JSON object");
+        return;
+      }
+      liveConfigSnapshot(webPid, &webConfig);
+      const char* err = parseConfigPatch(patch.as<JsonObjectConst>(), &webConfig);
+      if (!err) {
+        err = liveConfigValidate(webConfig);
+      }
+      if (err) {
+        liveConfigCountRejected();
+        req->send(400, "text/plain", err);
+        return;
+      }
+      liveConfigStage(webConfig);
+      JsonDocument doc;
+      addLiveConfig(doc.to<JsonObject>(), webConfig);
+      AsyncResponseStream* res = req->beginResponseStream("application/json");
+      serializeJson(doc, *res);
+      req->send(res);
+    },
+    nullptr,
+    [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total) {
+      collectBody(req, data, len, index, total, CONFIG_BODY_MAX);
+    });
+
+  // Profile library (profile_library.h): stored names, the profile in force
+  // and the one selected for the next shot ("" = custom)
+  server.on("/profiles", HTTP_GET, [](AsyncWebServerRequest* req) {
+    JsonDocument doc;
+    char name[PROFILE_NAME_MAX];
+    profileLibraryActiveName(name);
+    doc["active"] = name;
+    profileLibrarySelectedName(name);
+    doc["selected"] = name;
+    doc["slots"] = PROFILE_LIBRARY_SLOTS;
+    JsonArray arr = doc["profiles"].to<JsonArray>();
+    for (int i = 0; profileLibraryName(i, name); i++) {
+      arr.add(name);
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // Save the live profile under a name (replacing one of the same name);
+  // it is recompiled, so what gets selected is the stored table
+  server.on("/save_profile", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!req->hasParam("name")) {
+      req->send(400, "text/plain", "missing name");
+      return;
+    }
+    PressureProfile profile;
+    profileSnapshot(&profile);
+    saveProfileToLibrary(req, profile);
+  });
+
+  // Switch to a stored profile: at once when idle, else from the next shot
+  server.on("/select_profile", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!req->hasParam("name") || !profileLibrarySelect(req->getParam("name")->value().c_str())) {
+      req->send(404, "text/plain", "no such profile");
+      return;
     }
+    settingsSave();
+    req->send(200, "text/plain", shot.brewing ? "OK - selected from the next shot" : "OK");
+  });
+
+  // Remove a stored profile; if it is in force it keeps running, unnamed
+  server.on("/delete_profile", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (!req->hasParam("name") || !profileLibraryDelete(req->getParam("name")->value().c_str())) {
+      req->send(404, "text/plain", "no such profile");
+      return;
+    }
+    settingsSave();
     req->send(200, "text/plain", "OK");
   });
 
@@ -309,8 +1247,8 @@ void initializeServer(PIDController* pid) {
   // Reboot (e.g. to apply new WiFi credentials); executed by loop() so the
   // response gets out first. Refused while the machine is doing anything.
   server.on("/reboot", HTTP_GET, [](AsyncWebServerRequest* req) {
-    if (shot.brewing || cleaningActive()) {
-      req->send(409, "text/plain", "busy: shot or cleaning in progress");
+    if (shot.brewing || cleaningActive() || autotuneActive()) {
+      req->send(409, "text/plain", "busy: shot, cleaning or autotune in progress");
       return;
     }
     webRebootRequest = true;
@@ -321,7 +1259,7 @@ void initializeServer(PIDController* pid) {
   server.on("/shots", HTTP_GET, [](AsyncWebServerRequest* req) {
     JsonDocument doc;
     JsonArray arr = doc["shots"].to<JsonArray>();
-    if (!shotHistoryLock || xSemaphoreTake(shotHistoryLock, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (shotHistoryLockTake(pdMS_TO_TICKS(100))) {
       for (int i = 0; i < shotHistoryCount; i++) {
         // Newest first: walk backwards from the last written slot
         int idx = (shotHistoryWriteIdx - 1 - i + HISTORY_MAX_SHOTS * 2) % HISTORY_MAX_SHOTS;
@@ -333,8 +1271,11 @@ void initializeServer(PIDController* pid) {
         o["peakPressure"] = rec.peakPressure;
         o["endReason"] = endReasonName((EndType)rec.endReason);
         o["points"] = rec.numPoints;
+        o["controller"] = pressureControlLawName(rec.controlLaw);
+        o["profile"] = rec.profileName;  // "" = custom
+        addControlScore(o["control"].to<JsonObject>(), rec.control);
       }
-      if (shotHistoryLock) xSemaphoreGive(shotHistoryLock);
+      shotHistoryLockGive();
     }
     AsyncResponseStream* res = req->beginResponseStream("application/json");
     serializeJson(doc, *res);
@@ -346,7 +1287,7 @@ void initializeServer(PIDController* pid) {
     uint32_t id = req->hasParam("id") ? (uint32_t)req->getParam("id")->value().toInt() : 0;
     JsonDocument doc;
     bool found = false;
-    if (!shotHistoryLock || xSemaphoreTake(shotHistoryLock, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (shotHistoryLockTake(pdMS_TO_TICKS(100))) {
       for (int i = 0; i < shotHistoryCount; i++) {
         ShotRecord& rec = shotHistory[i];
         if (rec.id == id) {
@@ -361,7 +1302,7 @@ void initializeServer(PIDController* pid) {
           break;
         }
       }
-      if (shotHistoryLock) xSemaphoreGive(shotHistoryLock);
+      shotHistoryLockGive();
     }
     if (!found) {
       req->send(404, "text/plain", "shot not found");
@@ -390,12 +1331,12 @@ void initializeServer(PIDController* pid) {
   // BQ reads responseJSON[0].lastShotId; id 0 = no shots yet (fetch will 404)
   server.on("/api/shots/latest", HTTP_GET, [](AsyncWebServerRequest* req) {
     uint32_t lastId = 0;
-    if (!shotHistoryLock || xSemaphoreTake(shotHistoryLock, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (shotHistoryLockTake(pdMS_TO_TICKS(100))) {
       if (shotHistoryCount > 0) {
         int idx = (shotHistoryWriteIdx - 1 + HISTORY_MAX_SHOTS) % HISTORY_MAX_SHOTS;
         lastId = shotHistory[idx].id;
       }
-      if (shotHistoryLock) xSemaphoreGive(shotHistoryLock);
+      shotHistoryLockGive();
     }
     req->send(200, "application/json", "[{\"lastShotId\":" + String(lastId) + "}]");
   });
@@ -406,7 +1347,7 @@ void initializeServer(PIDController* pid) {
     uint32_t id = (uint32_t)req->url().substring(strlen("/api/shots/")).toInt();
     JsonDocument doc;
     bool found = false;
-    if (!shotHistoryLock || xSemaphoreTake(shotHistoryLock, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (shotHistoryLockTake(pdMS_TO_TICKS(100))) {
       for (int i = 0; i < shotHistoryCount; i++) {
         ShotRecord& rec = shotHistory[i];
         if (rec.id != id) {
@@ -416,8 +1357,9 @@ void initializeServer(PIDController* pid) {
         doc["timestamp"] = rec.timestamp;  // unix seconds (BQ renders via moment.unix)
         // BQ's import modal reads the nested profile.name and silently skips
         // the whole shot if it's missing; profileName alone is not enough
-        doc["profileName"] = "Smart Espresso";
-        doc["profile"]["name"] = "Smart Espresso";
+        const char* profileName = rec.profileName[0] ? rec.profileName : "Smart Espresso";
+        doc["profileName"] = profileName;
+        doc["profile"]["name"] = profileName;
         JsonObject dp = doc["datapoints"].to<JsonObject>();
         JsonArray t = dp["timeInShot"].to<JsonArray>();
         JsonArray p = dp["pressure"].to<JsonArray>();
@@ -446,7 +1388,7 @@ void initializeServer(PIDController* pid) {
         found = true;
         break;
       }
-      if (shotHistoryLock) xSemaphoreGive(shotHistoryLock);
+      shotHistoryLockGive();
     }
     if (!found) {
       req->send(404, "application/json", "{\"error\":\"shot not found\"}");
@@ -457,6 +1399,37 @@ void initializeServer(PIDController* pid) {
     req->send(res);
   });
 
+  // Profile list as Gaggiuino serves it: ids are library slot + 1 (they
+  // shift when a profile is deleted - clients re-read the list)
+  server.on("/api/profiles/all", HTTP_GET, [](AsyncWebServerRequest* req) {
+    JsonDocument doc;
+    JsonArray arr = doc.to<JsonArray>();
+    char name[PROFILE_NAME_MAX];
+    char selected[PROFILE_NAME_MAX];
+    profileLibrarySelectedName(selected);
+    for (int i = 0; profileLibraryName(i, name); i++) {
+      JsonObject o = arr.add<JsonObject>();
+      o["id"] = i + 1;
+      o["name"] = name;
+      o["selected"] = strcmp(name, selected) == 0;
+    }
+    AsyncResponseStream* res = req->beginResponseStream("application/json");
+    serializeJson(doc, *res);
+    req->send(res);
+  });
+
+  // /api/profile-select/{id}: same rules as /select_profile
+  server.on("/api/profile-select/*", HTTP_POST, [](AsyncWebServerRequest* req) {
+    int id = req->url().substring(strlen("/api/profile-select/")).toInt();
+    char name[PROFILE_NAME_MAX];
+    if (!profileLibraryName(id - 1, name) || !profileLibrarySelect(name)) {
+      req->send(404, "application/json", "{\"error\":\"profile not found\"}");
+      return;
+    }
+    settingsSave();
+    req->send(200, "application/json", "{\"status\":\"ok\"}");
+  });
+
   server.begin();
   serverStarted = true;
   DEBUG_STARTUP_PRINT("Web server started on port 80");
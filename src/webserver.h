@@ -25,6 +25,11 @@ extern volatile bool webStopRequest;
 extern volatile bool webResetRequest;  // Stop ESP/scale shot without pressing the machine button
 extern volatile bool webRebootRequest; // Consumed by loop(); refused while brewing/cleaning
 
+// Bumped by the control task once per derived-state window (a fresh
+// snapshot of shot/pump state); /state re-renders its cached JSON only when
+// this has moved, so any number of polling dashboards cost one serialization
+extern volatile uint32_t webStateGeneration;
+
 // Connect to WiFi with a timeout so a missing network can't hang boot forever.
 // Returns true if connected; the web server is only started when it is.
 bool initializeWiFi();
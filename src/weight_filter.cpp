@@ -0,0 +1,109 @@
+#include "weight_filter.h"
+
+#include <math.h>
+
+const WeightFilterConfig WEIGHT_FILTER_DEFAULTS = {
+  3,      // medianN
+  3,      // rejectLimit
+  10.0f,  // maxRateGps
+  0.5f,   // blankS
+};
+
+// Packets closer together than this are rated as if this far apart, so
+// two packets delivered in one burst don't look like an infinite rate
+static const float MIN_RATE_INTERVAL_S = 0.05f;
+
+const char* weightFilterValidate(const WeightFilterConfig& config) {
+  if (config.medianN < 1 || config.medianN > WEIGHT_FILTER_MAX_MEDIAN || config.medianN % 2 == 0) {
+    return "median must be 1, 3, 5 or 7";
+  }
+  if (config.rejectLimit < 1 || config.rejectLimit > 20) {
+    return "rejectLimit must be 1..20";
+  }
+  if (isnan(config.maxRateGps) || config.maxRateGps < 0.0f || config.maxRateGps > 100.0f) {
+    return "maxRate must be 0..100 g/s";
+  }
+  if (isnan(config.blankS) || config.blankS < 0.0f || config.blankS > 5.0f) {
+    return "blankS must be 0..5";
+  }
+  return nullptr;
+}
+
+void weightFilterInit(WeightFilter* f, const WeightFilterConfig& config) {
+  *f = {};
+  f->config = config;
+  f->blankUntilS = -INFINITY;
+}
+
+void weightFilterTare(WeightFilter* f, float timeS) {
+  f->blankUntilS = timeS + f->config.blankS;
+  f->windowHead = 0;
+  f->windowLen = 0;
+  f->haveLast = false;
+  f->rejectRun = 0;
+}
+
+// Ring of capacity medianN, oldest at windowHead
+static void windowPush(WeightFilter* f, float timeS, float weight) {
+  int cap = f->config.medianN;
+  int slot = (f->windowHead + f->windowLen) % cap;
+  if (f->windowLen == cap) {
+    f->windowHead = (f->windowHead + 1) % cap;
+  } else {
+    f->windowLen++;
+  }
+  f->windowWeight[slot] = weight;
+  f->windowTimeS[slot] = timeS;
+}
+
+bool weightFilterAdd(WeightFilter* f, float timeS, float weight,
+                     float* outWeight, float* outTimeS) {
+  if (timeS < f->blankUntilS) {
+    f->stats.blanked++;
+    return false;
+  }
+
+  if (f->haveLast && f->config.maxRateGps > 0.0f) {
+    float dt = fmaxf(timeS - f->lastTimeS, MIN_RATE_INTERVAL_S);
+    if (fabsf(weight - f->lastWeight) > f->config.maxRateGps * dt) {
+      f->rejectRun++;
+      if (f->rejectRun < f->config.rejectLimit) {
+        f->stats.spikes++;
+        return false;
+      }
+      // Consistently elsewhere: a new level, not a spike - don't let the
+      // median smear the old level into it
+      f->stats.steps++;
+      f->windowHead = 0;
+      f->windowLen = 0;
+    }
+  }
+  f->rejectRun = 0;
+  f->haveLast = true;
+  f->lastWeight = weight;
+  f->lastTimeS = timeS;
+
+  windowPush(f, timeS, weight);
+
+  // Insertion sort of a copy; at most WEIGHT_FILTER_MAX_MEDIAN values
+  float sorted[WEIGHT_FILTER_MAX_MEDIAN];
+  int cap = f->config.medianN;
+  int n = f->windowLen;
+  for (int i = 0; i < n; i++) {
+    float w = f->windowWeight[(f->windowHead + i) % cap];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > w) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = w;
+  }
+  *outWeight = (n % 2) ? sorted[n / 2] : 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+  // Middle of the window in arrival order (the middle pair's mean while
+  // the window is filling to an even length)
+  int mid = (f->windowHead + (n - 1) / 2) % cap;
+  int midHigh = (f->windowHead + n / 2) % cap;
+  *outTimeS = 0.5f * (f->windowTimeS[mid] + f->windowTimeS[midHigh]);
+  f->stats.accepted++;
+  return true;
+}
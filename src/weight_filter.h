@@ -0,0 +1,77 @@
+#ifndef WEIGHT_FILTER_H
+#define WEIGHT_FILTER_H
+
+// ============================================================================
+// WEIGHT SANITIZER - STREAMING FILTER FOR SCALE PACKETS
+// ============================================================================
+// Sits between the scale's packets and the shot trajectory, so that the
+// end-time regression sees the cup filling and nothing else. Three stages
+// run per packet, in this order:
+//
+//   blanking   for blankS after a tare, packets are dropped. They hold the
+//              dip and bounce of the load cell settling.
+//   rate gate  a packet further from the last accepted one than maxRateGps
+//              allows is dropped as a spike (a knock on the drip tray). If
+//              rejectLimit packets in a row disagree, the new level is real
+//              (a cup placed or lifted) and is taken over at once.
+//   median     median of the last medianN accepted packets. It is stamped
+//              with the time of the window's middle packet, so a steady
+//              flow is not biased late, only delivered later.
+//
+// Cost per packet is bounded: one sort of at most WEIGHT_FILTER_MAX_MEDIAN
+// values. This is plain C++ like virtual_scale.cpp, so the predictor
+// benchmark (shot_predictor.h) replays traces through it natively as well.
+
+#include <stdint.h>
+
+#define WEIGHT_FILTER_MAX_MEDIAN 7
+
+struct WeightFilterConfig {
+  uint8_t medianN;      // Odd, 1..WEIGHT_FILTER_MAX_MEDIAN; 1 = no median
+  uint8_t rejectLimit;  // Disagreeing packets in a row taken as a real step
+  float maxRateGps;     // Rate gate; 0 = off
+  float blankS;         // Dropped after a tare; 0 = off
+};
+
+// Median of 3, 10 g/s gate (espresso flows at most ~4 g/s; a knock is a
+// jump of tens of grams), 3 packets to accept a step, 0.5 s blanking
+extern const WeightFilterConfig WEIGHT_FILTER_DEFAULTS;
+
+// Null if config is usable, otherwise what is wrong with it
+const char* weightFilterValidate(const WeightFilterConfig& config);
+
+struct WeightFilterStats {
+  uint32_t accepted;  // Packets passed on
+  uint32_t spikes;    // Dropped by the rate gate
+  uint32_t steps;     // Level changes taken over after rejectLimit packets
+  uint32_t blanked;   // Dropped after a tare
+};
+
+struct WeightFilter {
+  WeightFilterConfig config;
+
+  float windowWeight[WEIGHT_FILTER_MAX_MEDIAN];  // Ring, arrival order
+  float windowTimeS[WEIGHT_FILTER_MAX_MEDIAN];
+  int windowHead;
+  int windowLen;
+
+  bool haveLast;
+  float lastWeight;   // Last packet through the gate
+  float lastTimeS;
+  int rejectRun;
+  float blankUntilS;
+
+  WeightFilterStats stats;
+};
+
+void weightFilterInit(WeightFilter* f, const WeightFilterConfig& config);
+
+// The scale was tared at timeS: blank, and start the median afresh
+void weightFilterTare(WeightFilter* f, float timeS);
+
+// Feed a packet received at timeS. True with the cleaned weight and the
+// time it stands for; false while it is blanked or gated.
+bool weightFilterAdd(WeightFilter* f, float timeS, float weight,
+                     float* outWeight, float* outTimeS);
+
+#endif // WEIGHT_FILTER_H
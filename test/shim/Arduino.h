@@ -0,0 +1,74 @@
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+
+// ============================================================================
+// HOST SHIM FOR THE NATIVE TESTS
+// ============================================================================
+// Just enough of Arduino.h and FreeRTOS for the modules under test to build
+// on the host (env:native). Header-only, so a test suite needs nothing but
+// its own file. No tasks run here: the locks are no-ops and the clocks
+// only move when a test sets shimNowUs.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using std::isfinite;
+using std::isnan;
+using std::max;
+using std::min;
+
+#define IRAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline uint64_t shimNowUs = 0;
+
+inline unsigned long micros() { return (unsigned long)shimNowUs; }
+inline unsigned long millis() { return (unsigned long)(shimNowUs / 1000); }
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+// DEBUG_*_PRINT output goes nowhere
+struct SerialShim {
+  template <class T> void print(T) {}
+  void println() {}
+  int printf(const char*, ...) { return 0; }
+};
+inline SerialShim Serial;
+
+// FreeRTOS
+typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return nullptr; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return nullptr; }
+inline int xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) { return pdTRUE; }
+inline int xSemaphoreGive(SemaphoreHandle_t sem) { return pdTRUE; }
+inline void vTaskDelay(TickType_t ticks) { shimNowUs += ticks * 1000ull; }
+
+struct portMUX_TYPE {
+  int unused;
+};
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {}
+
+#endif // ARDUINO_SHIM_H
@@ -0,0 +1,27 @@
+#ifndef EEPROM_SHIM_H
+#define EEPROM_SHIM_H
+
+// Byte-array EEPROM for the native tests: data is the flash region, filled
+// by a test as some firmware would have left it
+
+#include <Arduino.h>
+
+#define EEPROM_SHIM_SIZE 4096
+
+class EEPROMClass {
+public:
+  uint8_t data[EEPROM_SHIM_SIZE];
+  uint32_t commits = 0;
+
+  bool begin(size_t size) { return size <= EEPROM_SHIM_SIZE; }
+  uint8_t read(int address) { return data[address]; }
+  void write(int address, uint8_t value) { data[address] = value; }
+  bool commit() {
+    commits++;
+    return true;
+  }
+};
+
+inline EEPROMClass EEPROM;
+
+#endif // EEPROM_SHIM_H
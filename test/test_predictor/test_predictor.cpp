@@ -0,0 +1,98 @@
+// Shot end predictor on the host: the built-in virtual scale trace replayed
+// through predictorBenchmark() over a clean and an impaired link, on raw
+// packets and through the weight sanitizer. virtual_scale.cpp,
+// weight_filter.cpp and shot_predictor.cpp are plain C++ and build in as
+// they are, without the Arduino shim.
+
+#include <unity.h>
+
+#include "shot_predictor.cpp"
+#include "virtual_scale.cpp"
+#include "weight_filter.cpp"
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+// The built-in trace of scale.cpp: a 1:2 shot, 36 g at ~33 s
+static const float TRACE_TIME_S[] = { 0, 4, 6, 7, 8, 10, 15, 20, 25, 30, 35, 40, 45 };
+static const float TRACE_WEIGHT[] = { 0, 0, 0.2f, 0.8f, 1.8f, 4.0f, 10.5f, 17.0f, 23.5f, 30.0f,
+                                      36.5f, 43.0f, 49.5f };
+static const int TRACE_LEN = (int)(sizeof(TRACE_TIME_S) / sizeof(TRACE_TIME_S[0]));
+
+// Default goal weight minus default offset, and the shot stopper's minimum
+static const float TARGET_G = 34.5f;
+static const float MIN_STOP_S = 3.0f;
+static const int RUNS = 20;
+
+static void run(const VirtualScaleConfig& config, const WeightFilterConfig* filter,
+                PredictorBenchmarkResult* out) {
+  predictorBenchmark(TRACE_TIME_S, TRACE_WEIGHT, TRACE_LEN, TARGET_G, MIN_STOP_S,
+                     config, filter, RUNS, out);
+}
+
+// A link that loses packets and a load cell that gets knocked
+static VirtualScaleConfig impairedLink() {
+  VirtualScaleConfig config = VIRTUAL_SCALE_DEFAULTS;
+  config.dropProb = 0.05f;
+  config.noiseG = 0.1f;
+  config.spikeProb = 0.03f;
+  config.spikeG = 20.0f;
+  return config;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+void setUp() {}
+
+void tearDown() {}
+
+// The trace crosses the target once, where the linear segment says
+static void test_ideal_stop() {
+  PredictorBenchmarkResult result;
+  run(VIRTUAL_SCALE_DEFAULTS, nullptr, &result);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 30.0f + 4.5f / 6.5f * 5.0f, result.idealStopS);
+}
+
+// Clean link: every run stops a little late (the link latency's worth of
+// flow) and the sanitizer doesn't change where
+static void test_clean_link() {
+  PredictorBenchmarkResult raw;
+  PredictorBenchmarkResult filtered;
+  run(VIRTUAL_SCALE_DEFAULTS, nullptr, &raw);
+  run(VIRTUAL_SCALE_DEFAULTS, &WEIGHT_FILTER_DEFAULTS, &filtered);
+
+  TEST_ASSERT_EQUAL(RUNS, raw.runs);
+  TEST_ASSERT_EQUAL(RUNS, raw.stopped);
+  TEST_ASSERT_EQUAL(RUNS, filtered.stopped);
+  TEST_ASSERT_EQUAL(0, raw.dropped);
+  TEST_ASSERT_TRUE(raw.meanErrorG > 0.0f);
+  TEST_ASSERT_TRUE(raw.maxAbsErrorG < 0.2f);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, raw.meanErrorG, filtered.meanErrorG);
+}
+
+// Impaired link: on raw packets a knock reaches the regression and stops
+// the shot far too early; the sanitizer holds the knocks back and keeps
+// the stop near the clean link's
+static void test_impaired_link() {
+  PredictorBenchmarkResult raw;
+  PredictorBenchmarkResult filtered;
+  run(impairedLink(), nullptr, &raw);
+  run(impairedLink(), &WEIGHT_FILTER_DEFAULTS, &filtered);
+
+  TEST_ASSERT_TRUE(raw.dropped > 0);
+  TEST_ASSERT_TRUE(filtered.filtered > 0);
+  TEST_ASSERT_TRUE(raw.meanAbsErrorG > 5.0f);
+  TEST_ASSERT_EQUAL(RUNS, filtered.stopped);
+  TEST_ASSERT_TRUE(filtered.maxAbsErrorG < 0.5f);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ideal_stop);
+  RUN_TEST(test_clean_link);
+  RUN_TEST(test_impaired_link);
+  return UNITY_END();
+}
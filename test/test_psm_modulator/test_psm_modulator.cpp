@@ -0,0 +1,111 @@
+// PSM modulators on the host: every one hits the requested duty cycle over
+// the level sweep, and their low-frequency error ranks as the header says.
+// Built into the test itself; the pump model only lends the decision rate.
+
+#include <unity.h>
+
+#include "psm_modulator.cpp"
+
+// ============================================================================
+// FAKES
+// ============================================================================
+
+int getMaxPumpClicksPerSecond() {
+  return DEFAULT_PUMP_CLICKS_PER_SECOND;
+}
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+// Same spacing as GET /psm_analysis, both ends included
+static const int SWEEP_STEP = 8;
+static const int SWEEP_CYCLES = 2000;
+
+// Fraction of cycles a modulator conducts at a level, after the same
+// warm-up psmLowFrequencyError() skips
+static float dutyCycle(PsmModulator m, uint8_t level, int cycles) {
+  PsmModulatorState state;
+  psmModulatorReset(&state);
+  for (int i = 0; i < WARMUP_CYCLES; i++) {
+    psmModulatorStep(m, &state, level);
+  }
+  int on = 0;
+  for (int i = 0; i < cycles; i++) {
+    on += psmModulatorStep(m, &state, level) ? 1 : 0;
+  }
+  return on / (float)cycles;
+}
+
+// Low-frequency error summed over the sweep levels
+static float sweepError(PsmModulator m) {
+  float sum = 0.0f;
+  for (int level = 1; level < PSM_RANGE; level += SWEEP_STEP) {
+    sum += psmLowFrequencyError(m, level, SWEEP_CYCLES);
+  }
+  return sum;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+void setUp() {}
+
+void tearDown() {}
+
+// The long-run average is the level for every modulator, to within a click
+// or two over the window (the dither only moves where clicks land)
+static void test_duty_cycle_matches_level() {
+  for (int i = 0; i < PSM_MODULATOR_COUNT; i++) {
+    PsmModulator m = (PsmModulator)i;
+    for (int level = 1; level < PSM_RANGE; level += SWEEP_STEP) {
+      char message[32];
+      snprintf(message, sizeof(message), "%s level %d", psmModulatorName(m), level);
+      TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.002f, level / (float)PSM_RANGE,
+                                       dutyCycle(m, level, SWEEP_CYCLES), message);
+    }
+  }
+}
+
+// The extremes are never modulated
+static void test_extremes_unmodulated() {
+  for (int i = 0; i < PSM_MODULATOR_COUNT; i++) {
+    PsmModulator m = (PsmModulator)i;
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, dutyCycle(m, 0, 100));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, dutyCycle(m, PSM_RANGE, 100));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, psmLowFrequencyError(m, 0, 100));
+  }
+}
+
+// FIRST_ORDER, the default, is the smoothest at one decision per mains
+// cycle; SECOND_ORDER comes next and DITHERED last
+static void test_low_frequency_ranking() {
+  float first = sweepError(PsmModulator::FIRST_ORDER);
+  float second = sweepError(PsmModulator::SECOND_ORDER);
+  float dithered = sweepError(PsmModulator::DITHERED);
+
+  TEST_ASSERT_TRUE(first < second);
+  TEST_ASSERT_TRUE(second < dithered);
+}
+
+// Names round-trip and unknown ones are refused
+static void test_names() {
+  for (int i = 0; i < PSM_MODULATOR_COUNT; i++) {
+    PsmModulator m = (PsmModulator)i;
+    PsmModulator parsed = PsmModulator::DITHERED;
+    TEST_ASSERT_TRUE(psmModulatorFromName(psmModulatorName(m), &parsed));
+    TEST_ASSERT_TRUE(parsed == m);
+  }
+  PsmModulator parsed;
+  TEST_ASSERT_FALSE(psmModulatorFromName("third_order", &parsed));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_duty_cycle_matches_level);
+  RUN_TEST(test_extremes_unmodulated);
+  RUN_TEST(test_low_frequency_ranking);
+  RUN_TEST(test_names);
+  return UNITY_END();
+}
@@ -0,0 +1,234 @@
+// Settings blob migrations on the host: raw blobs of every legacy version,
+// the version 9 record blob, and the damaged ones settingsLoad() has to
+// survive. Built into the test itself to reach the frozen legacy layout and
+// the record helpers; the modules settingsLoad() hands off to are faked.
+
+#include <unity.h>
+
+#include "settings.cpp"
+#include "weight_filter.cpp"
+
+// ============================================================================
+// FAKES
+// ============================================================================
+
+// Compiled-in defaults as settingsLoad() finds them at boot
+static const CleaningConfig CLEANING_DEFAULTS = { 9.0f, 10.0f, 2.0f, 200, 5.0f, 5, 60.0f, 300.0f };
+static const int CONTROL_LAW_DEFAULT = PRESSURE_CONTROL_MPC;
+
+CleaningConfig cleaningConfig;
+volatile int pressureControlSelected;
+Shot shot;
+
+// Two by-time goals and one by-time-left goal, the first one ramped
+void profileSnapshot(PressureProfile* out) {
+  memset(out, 0, sizeof(*out));
+  out->byTime[0] = { 0.0f, 9.0f };
+  out->byTime[1] = { 20.0f, 6.0f };
+  out->transitionByTime[0] = { 1.0f, GoalCurve::LINEAR };
+  out->numByTime = 2;
+  out->byTimeLeft[0] = { 5.0f, 4.0f };
+  out->numByTimeLeft = 1;
+}
+
+const char* profileValidate(const PressureProfile& p) {
+  return p.numByTime <= MAX_PRESSURE_GOALS && p.numByTimeLeft <= MAX_PRESSURE_GOALS
+      ? nullptr : "too many goals";
+}
+
+static const PressureControlLaw LAW = { "fake", nullptr, nullptr, nullptr };
+
+const PressureControlLaw* pressureControlLaw(int law) {
+  return law >= 0 && law < PRESSURE_CONTROL_LAW_COUNT ? &LAW : nullptr;
+}
+
+const char* pressureControlLawName(int law) {
+  return "fake";
+}
+
+// Whether settingsLoad() handed a stored calibration over
+static bool pumpCalStored;
+
+void pumpCalibrationInit(const PumpCalibration* stored) {
+  pumpCalStored = stored != nullptr;
+}
+
+void pumpCalibrationSnapshot(PumpCalibration* out) {}
+void profileLibraryInit(const ProfileLibraryStore* stored, const char* activeName) {}
+void profileLibrarySnapshot(ProfileLibraryStore* out, char* activeName) {}
+void scaleFilterConfigure(const WeightFilterConfig& config) {}
+void scaleFilterConfig(WeightFilterConfig* out) {}
+bool autotuneActive() { return false; }
+bool cleaningActive() { return false; }
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+// Where a version's raw blob ended: its layout is a prefix of version 8's
+static size_t legacyBlobSize(int version) {
+  switch (version) {
+    case 1:  return offsetof(LegacySettingsV8, pumpCal);
+    case 2:  return offsetof(LegacySettingsV8, flowByTime);
+    case 3:  return offsetof(LegacySettingsV8, controlLaw);
+    case 4:  return offsetof(LegacySettingsV8, transitionByTime);
+    case 5:  return offsetof(LegacySettingsV8, library);
+    case 6:  return offsetof(LegacySettingsV8, scaleAddress);
+    case 7:  return offsetof(LegacySettingsV8, weightFilter);
+    default: return sizeof(LegacySettingsV8);
+  }
+}
+
+// A raw blob as firmware of that version wrote it, every field it had set
+// away from the defaults
+static void writeLegacyBlob(int version) {
+  LegacySettingsV8 blob;
+  memset(&blob, 0, sizeof(blob));
+  blob.magic = LEGACY_BLOB_MAGIC;
+  blob.version = version;
+  blob.goalWeight = 40.0f;
+  blob.weightOffset = 2.0f;
+  blob.numGoalsByTime = 1;
+  blob.goalsByTime[0] = { 0.0f, 8.0f };
+  blob.cleaning = CLEANING_DEFAULTS;
+  blob.cleaning.cyclesPerPhase = 7;
+  strcpy(blob.wifiSsid, "home");
+  blob.pumpCal.samples = 12;
+  blob.flowByTime[0] = { 2.5f, 0.0f };
+  blob.controlLaw = PRESSURE_CONTROL_GAGGIUINO;
+  blob.transitionByTime[0] = { 3.0f, GoalCurve::EASE };
+  strcpy(blob.scaleAddress, "aa:bb:cc:dd:ee:ff");
+  blob.weightFilter = { 5, 3, 10.0f, 0.5f };
+  memcpy(EEPROM.data + SETTINGS_ADDR, &blob, legacyBlobSize(version));
+}
+
+// Load again from what is in EEPROM now, from a scrambled live state
+static void reload() {
+  memset(&settings, 0x55, sizeof(settings));
+  cleaningConfig = CLEANING_DEFAULTS;
+  pressureControlSelected = CONTROL_LAW_DEFAULT;
+  pumpCalStored = false;
+  settingsLoad();
+}
+
+static void assertRecordBlob() {
+  TEST_ASSERT_EQUAL_HEX32(SETTINGS_MAGIC, readU32(SETTINGS_ADDR));
+  TEST_ASSERT_EQUAL(SETTINGS_VERSION, EEPROM.read(SETTINGS_ADDR + 4));
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+void setUp() {
+  memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+}
+
+void tearDown() {}
+
+// Fields a version had come through; the ones it lacked get their
+// migration (a stored profile keeps stepping pressure-only)
+static void test_legacy_blobs_migrate() {
+  for (int v = 1; v <= LEGACY_BLOB_VERSION_MAX; v++) {
+    char message[16];
+    snprintf(message, sizeof(message), "version %d", v);
+    setUp();
+    writeLegacyBlob(v);
+    reload();
+
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(40.0f, settings.goalWeight, message);
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(2.0f, settings.weightOffset, message);
+    TEST_ASSERT_EQUAL_MESSAGE(1, settings.numGoalsByTime, message);
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(8.0f, settings.goalsByTime[0].pressure, message);
+    TEST_ASSERT_EQUAL_MESSAGE(7, settings.cleaning.cyclesPerPhase, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("home", settings.wifiSsid, message);
+    TEST_ASSERT_EQUAL_MESSAGE(v >= 2, pumpCalStored, message);
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(v >= 3 ? 2.5f : 0.0f, settings.flowByTime[0].targetFlow, message);
+    TEST_ASSERT_EQUAL_MESSAGE(v >= 4 ? PRESSURE_CONTROL_GAGGIUINO : CONTROL_LAW_DEFAULT,
+                              settings.controlLaw, message);
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(v >= 5 ? 3.0f : 0.0f, settings.transitionByTime[0].rampS, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(v >= 7 ? "aa:bb:cc:dd:ee:ff" : "", settings.scaleAddress, message);
+    TEST_ASSERT_EQUAL_MESSAGE(v >= 8 ? 5 : WEIGHT_FILTER_DEFAULTS.medianN,
+                              settings.weightFilter.medianN, message);
+    assertRecordBlob();
+  }
+}
+
+// The record blob a load wrote reads back as the same settings, every
+// field stored
+static void test_record_blob_round_trip() {
+  writeLegacyBlob(LEGACY_BLOB_VERSION_MAX);
+  reload();
+  PersistentSettings written = settings;
+  uint32_t commits = EEPROM.commits;
+
+  reload();
+  TEST_ASSERT_TRUE(pumpCalStored);
+  TEST_ASSERT_EQUAL_MEMORY(&written, &settings, sizeof(settings));
+  TEST_ASSERT_EQUAL(commits + 1, EEPROM.commits);
+  assertRecordBlob();
+}
+
+// A record this firmware doesn't know (say from newer firmware) is skipped
+// and the records after it still load; its own field migrates
+static void test_unknown_tag_skipped() {
+  writeLegacyBlob(LEGACY_BLOB_VERSION_MAX);
+  reload();
+  PersistentSettings written = settings;
+
+  int first = SETTINGS_ADDR + SETTINGS_HEADER_SIZE;
+  TEST_ASSERT_EQUAL(TAG_GOAL_WEIGHT, EEPROM.read(first));
+  EEPROM.write(first, 200);
+  EEPROM.write(LEGACY_WEIGHT_ADDR, 42);
+  reload();
+
+  TEST_ASSERT_EQUAL_FLOAT(42.0f, settings.goalWeight);
+  settings.goalWeight = written.goalWeight;
+  TEST_ASSERT_EQUAL_MEMORY(&written, &settings, sizeof(settings));
+}
+
+// A payload cut short ends the load at the last whole record; the fields
+// from there on migrate
+static void test_truncated_payload() {
+  writeLegacyBlob(LEGACY_BLOB_VERSION_MAX);
+  reload();
+  TEST_ASSERT_EQUAL(5, settings.weightFilter.medianN);
+
+  // The weight filter's record is the last one
+  writeU16(SETTINGS_ADDR + 6, readU16(SETTINGS_ADDR + 6) - 3);
+  reload();
+
+  TEST_ASSERT_EQUAL(WEIGHT_FILTER_DEFAULTS.medianN, settings.weightFilter.medianN);
+  TEST_ASSERT_EQUAL_STRING("aa:bb:cc:dd:ee:ff", settings.scaleAddress);
+  TEST_ASSERT_EQUAL_FLOAT(40.0f, settings.goalWeight);
+}
+
+// Erased flash: no blob and 0xFF in the legacy bytes, so everything comes
+// out of the migrations and validation
+static void test_erased_flash() {
+  reload();
+
+  TEST_ASSERT_EQUAL_FLOAT(36.0f, settings.goalWeight);
+  TEST_ASSERT_EQUAL_FLOAT(1.5f, settings.weightOffset);
+  TEST_ASSERT_EQUAL(2, settings.numGoalsByTime);
+  TEST_ASSERT_EQUAL(1, settings.numGoalsByTimeLeft);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, settings.transitionByTime[0].rampS);
+  TEST_ASSERT_EQUAL(CLEANING_DEFAULTS.cyclesPerPhase, settings.cleaning.cyclesPerPhase);
+  TEST_ASSERT_EQUAL_STRING("", settings.wifiSsid);
+  TEST_ASSERT_FALSE(pumpCalStored);
+  TEST_ASSERT_EQUAL(CONTROL_LAW_DEFAULT, settings.controlLaw);
+  TEST_ASSERT_EQUAL(0, settings.library.count);
+  TEST_ASSERT_EQUAL_STRING("", settings.scaleAddress);
+  TEST_ASSERT_EQUAL(WEIGHT_FILTER_DEFAULTS.medianN, settings.weightFilter.medianN);
+  assertRecordBlob();
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_legacy_blobs_migrate);
+  RUN_TEST(test_record_blob_round_trip);
+  RUN_TEST(test_unknown_tag_skipped);
+  RUN_TEST(test_truncated_payload);
+  RUN_TEST(test_erased_flash);
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+"""Embed the web dashboard assets into the firmware as gzip blobs.
+
+PlatformIO pre-build script (platformio.ini: extra_scripts), also runnable
+standalone: python tools/embed_web_assets.py
+
+Every file in ASSETS is gzipped (deterministically, mtime 0) and written to
+src/web_assets.h as a PROGMEM byte array together with its URL path, content
+type, a strong ETag (hash of the gzip bytes) and its Cache-Control header.
+webserver.cpp serves them with Content-Encoding: gzip and answers matching
+If-None-Match requests with 304, so repeat dashboard loads cost one tiny
+round trip and Chart.js is never fetched from the internet by the client.
+
+Chart.js is pinned: dist/chart.umd.min.js of CHART_JS_VERSION is committed
+under web/vendor/, so what goes into flash is whatever the repository
+reviewed, and builds never touch the network. The build fails if the file
+is missing or isn't that release. The version is part of its URL path, so
+it can be cached forever. Updating it: bump CHART_JS_VERSION, download the
+new dist/chart.umd.min.js from the npm package into web/vendor/ under the
+new name, and commit it (the old one removed) together with the script.
+"""
+
+import gzip
+import hashlib
+import os
+
+CHART_JS_VERSION = "4.4.9"
+CHART_JS_FILE = "web/vendor/chart-%s.umd.min.js" % CHART_JS_VERSION
+
+# Every Chart.js dist file opens with its release banner
+CHART_JS_BANNER = b"Chart.js v%s" % CHART_JS_VERSION.encode()
+
+# (URL path, source file relative to the project root, content type,
+# Cache-Control). The dashboard revalidates on every load (cheap 304 via the
+# ETag) so a firmware update shows up immediately; versioned assets never do.
+ASSETS = [
+    ("/", "web/dashboard.html", "text/html", "no-cache"),
+    ("/assets/chart-%s.umd.min.js" % CHART_JS_VERSION,
+     CHART_JS_FILE,
+     "application/javascript", "public, max-age=31536000, immutable"),
+]
+
+OUTPUT = "src/web_assets.h"
+
+
+def check_vendored(project_dir):
+    path = os.path.join(project_dir, CHART_JS_FILE)
+    if not os.path.exists(path):
+        raise SystemExit("embed_web_assets: %s is missing - commit Chart.js %s "
+                         "dist/chart.umd.min.js there" % (CHART_JS_FILE, CHART_JS_VERSION))
+    with open(path, "rb") as f:
+        head = f.read(256)
+    if CHART_JS_BANNER not in head:
+        raise SystemExit("embed_web_assets: %s is not Chart.js %s (no release banner)"
+                         % (CHART_JS_FILE, CHART_JS_VERSION))
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 20):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 20]) + ",")
+    return "\n".join(lines)
+
+
+def generate(project_dir):
+    check_vendored(project_dir)
+
+    blobs = []
+    table = []
+    total_raw = total_gz = 0
+    for idx, (url, src, ctype, cache) in enumerate(ASSETS):
+        with open(os.path.join(project_dir, src), "rb") as f:
+            raw = f.read()
+        gz = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha256(gz).hexdigest()[:16]
+        total_raw += len(raw)
+        total_gz += len(gz)
+        blobs.append("// %s (%d B raw, %d B gzip)\n"
+                     "static const uint8_t WEB_ASSET_%d_GZ[] PROGMEM = {\n%s\n};\n"
+                     % (src, len(raw), len(gz), idx, c_bytes(gz)))
+        table.append('  {"%s", "%s", WEB_ASSET_%d_GZ, sizeof(WEB_ASSET_%d_GZ), "%s", "%s"},'
+                     % (url, ctype, idx, idx, etag.replace('"', '\\"'), cache))
+
+    out = """// GENERATED by tools/embed_web_assets.py from web/ - do not edit.
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+
+// Gzipped static asset, served as-is with Content-Encoding: gzip
+struct WebAsset {
+  const char* path;          // URL path
+  const char* contentType;
+  const uint8_t* gz;         // PROGMEM gzip stream
+  size_t gzLen;
+  const char* etag;          // Strong ETag, quoted
+  const char* cacheControl;
+};
+
+%s
+static const WebAsset WEB_ASSETS[] = {
+%s
+};
+
+static const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);
+
+#endif // WEB_ASSETS_H
+""" % ("\n".join(blobs), "\n".join(table))
+
+    # Only touch the header when the content changed, so unchanged assets
+    # don't trigger a recompile of webserver.cpp on every build
+    out_path = os.path.join(project_dir, OUTPUT)
+    if os.path.exists(out_path):
+        with open(out_path) as f:
+            if f.read() == out:
+                return
+    with open(out_path, "w") as f:
+        f.write(out)
+    print("embed_web_assets: %d assets, %d B -> %d B gzip"
+          % (len(ASSETS), total_raw, total_gz))
+
+
+if __name__ == "__main__":
+    generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+else:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
@@ -0,0 +1,180 @@
+"""HTTP load generator for the dashboard and Beanconqueror routes.
+
+Replays a realistic request mix against a running machine at increasing
+concurrency and reports throughput and latency percentiles per level, plus
+what the firmware itself saw during each level (from /metrics): lowest free
+heap, largest free block, control-loop overruns and the longest control
+period. Use it as a regression benchmark after touching the web server:
+
+    python tools/http_load.py 192.168.1.50
+    python tools/http_load.py 192.168.1.50 --levels 1,2,4,8,16 --duration 20
+    python tools/http_load.py 192.168.1.50 --mix state=60,shots=10,api_shot=30
+
+Mix entries (relative weights):
+    state     GET /state                 (one open dashboard tab polls 2/s)
+    shots     GET /shots                 (history table refresh)
+    shot      GET /shot?id=N             (history chart trajectory)
+    api_shot  GET /api/shots/N           (Beanconqueror import)
+    latest    GET /api/shots/latest      (Beanconqueror shot check)
+
+Each request uses its own connection, like the dashboard's fetch() calls
+against the ESP32's non-keep-alive server. Stdlib only.
+
+This drives the device, not a host build under env:native: what it
+measures - heap and largest block under AsyncTCP's per-connection
+buffers, control-loop overruns while core 0 serves - only exists there.
+A host build of initializeServer() would also need stand-ins for
+ESPAsyncWebServer, AsyncTCP, WiFi and String plus fakes for nearly every
+module the routes read, and would then time those stand-ins.
+"""
+
+import argparse
+import http.client
+import random
+import re
+import sys
+import threading
+import time
+
+DEFAULT_MIX = "state=80,shots=5,shot=5,api_shot=5,latest=5"
+
+
+def get(host, port, path, timeout):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request("GET", path)
+        res = conn.getresponse()
+        body = res.read()
+        return res.status, body
+    finally:
+        conn.close()
+
+
+def scrape_metrics(host, port, timeout):
+    try:
+        status, body = get(host, port, "/metrics", timeout)
+    except OSError:
+        return {}
+    if status != 200:
+        return {}
+    metrics = {}
+    for line in body.decode(errors="replace").splitlines():
+        m = re.match(r"^([a-z_]+)(?:\{[^}]*\})?\s+(\S+)$", line)
+        if m:
+            metrics[m.group(1)] = float(m.group(2))
+    return metrics
+
+
+def shot_ids(host, port, timeout):
+    try:
+        status, body = get(host, port, "/shots", timeout)
+    except OSError:
+        return []
+    if status != 200:
+        return []
+    return [int(i) for i in re.findall(rb'"id":(\d+)', body)]
+
+
+def build_paths(kind, ids):
+    shot_id = random.choice(ids) if ids else 1
+    return {
+        "state": "/state",
+        "shots": "/shots",
+        "shot": "/shot?id=%d" % shot_id,
+        "api_shot": "/api/shots/%d" % shot_id,
+        "latest": "/api/shots/latest",
+    }[kind]
+
+
+def percentile(sorted_vals, pct):
+    if not sorted_vals:
+        return float("nan")
+    k = min(len(sorted_vals) - 1, int(round(pct / 100.0 * (len(sorted_vals) - 1))))
+    return sorted_vals[k]
+
+
+def run_level(args, mix, ids, concurrency):
+    kinds, weights = zip(*mix)
+    latencies = []
+    errors = [0]
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.duration
+
+    def worker():
+        while time.monotonic() < deadline:
+            path = build_paths(random.choices(kinds, weights)[0], ids)
+            start = time.monotonic()
+            try:
+                status, _ = get(args.host, args.port, path, args.timeout)
+                ok = 200 <= status < 300 or (status == 404 and "shot" in path)
+            except OSError:
+                ok = False
+            elapsed = time.monotonic() - start
+            with lock:
+                if ok:
+                    latencies.append(elapsed)
+                else:
+                    errors[0] += 1
+
+    threads = [threading.Thread(target=worker, daemon=True) for _ in range(concurrency)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    wall = time.monotonic() - start
+    latencies.sort()
+    return latencies, errors[0], wall
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--levels", default="1,2,4,8",
+                        help="comma-separated concurrency levels")
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="seconds per level")
+    parser.add_argument("--mix", default=DEFAULT_MIX)
+    parser.add_argument("--timeout", type=float, default=5.0)
+    parser.add_argument("--cooldown", type=float, default=2.0,
+                        help="idle seconds between levels")
+    args = parser.parse_args()
+
+    mix = []
+    for entry in args.mix.split(","):
+        kind, weight = entry.split("=")
+        if kind not in ("state", "shots", "shot", "api_shot", "latest"):
+            sys.exit("unknown mix entry: %s" % kind)
+        mix.append((kind, float(weight)))
+
+    ids = shot_ids(args.host, args.port, args.timeout)
+    print("target http://%s:%d/  shots in history: %s  mix: %s"
+          % (args.host, args.port, ids or "none (shot routes will 404)", args.mix))
+    print()
+    print("%5s %8s %6s %8s %8s %8s %8s %8s | %9s %9s %8s %9s"
+          % ("conc", "requests", "errors", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms",
+             "minheap", "maxblock", "overruns", "maxper ms"))
+
+    for concurrency in [int(c) for c in args.levels.split(",")]:
+        # Scraping resets the firmware's per-scrape maxima
+        before = scrape_metrics(args.host, args.port, args.timeout)
+        latencies, errors, wall = run_level(args, mix, ids, concurrency)
+        after = scrape_metrics(args.host, args.port, args.timeout)
+
+        overruns = (after.get("espresso_control_overruns_total", 0)
+                    - before.get("espresso_control_overruns_total", 0))
+        print("%5d %8d %6d %8.1f %8.1f %8.1f %8.1f %8.1f | %9.0f %9.0f %8.0f %9.1f"
+              % (concurrency, len(latencies), errors, len(latencies) / wall,
+                 percentile(latencies, 50) * 1000, percentile(latencies, 90) * 1000,
+                 percentile(latencies, 99) * 1000,
+                 (latencies[-1] if latencies else float("nan")) * 1000,
+                 after.get("espresso_heap_min_free_bytes", float("nan")),
+                 after.get("espresso_heap_largest_free_block_bytes", float("nan")),
+                 overruns,
+                 after.get("espresso_control_period_max_seconds", float("nan")) * 1000))
+        time.sleep(args.cooldown)
+
+
+if __name__ == "__main__":
+    main()